@@ -0,0 +1,8 @@
+gcc -O2 -o MiniDBMS_bench bench/bench.c database/sql_struct.c database/db_api.c database/db_stats.c database/db_codec.c -lm
+MiniDBMS_bench -o bench_result.json
+cd .\compiler\
+bison -d parser.y
+flex lexer.l
+cd ..
+gcc -O2 -o MiniDBMS_parser_bench bench/parser_bench.c compiler/parser.tab.c compiler/lex.yy.c database/sql_struct.c database/db_api.c database/db_stats.c database/db_codec.c -lm
+MiniDBMS_parser_bench -o parser_bench_result.json
\ No newline at end of file
@@ -0,0 +1,412 @@
+// MiniDBMS 基准测试：直接链接 database/ 层，生成合成数据并测量各操作的吞吐量与延迟分位数
+// 用法: MiniDBMS_bench [-n 行数] [-q 查询次数] [-j 连接表行数] [-r 范围宽度] [-s 存取轮数] [-p 写入线程数] [-o 结果文件]
+// 结果以JSON格式输出（默认写到 stderr），便于跨提交比较
+#include "../database/db_api.h"
+#include "../database/sql_struct.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#define NULL_DEVICE "NUL"
+#else
+#include <pthread.h>
+#define NULL_DEVICE "/dev/null"
+#endif
+
+#define BENCH_DUMP_FILE "bench_data.db"
+#define TAG_COUNT 16
+#define MAX_PRODUCERS 64
+
+// 单调时钟，返回微秒
+static double now_us()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER cnt;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&cnt);
+    return (double)cnt.QuadPart * 1e6 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+#endif
+}
+
+// 一项操作的测量结果
+struct BenchResult
+{
+    const char *op;    // 操作名
+    double *samples;   // 每次操作的延迟（微秒）
+    int count;         // 操作次数
+    double total_us;   // 总耗时
+};
+
+static struct BenchResult results[16];
+static int result_count = 0;
+
+static struct BenchResult *bench_begin(const char *op, int count)
+{
+    struct BenchResult *r = &results[result_count++];
+    r->op = op;
+    r->samples = (double *)malloc(sizeof(double) * (count > 0 ? count : 1));
+    r->count = 0;
+    r->total_us = 0;
+    return r;
+}
+
+static void bench_record(struct BenchResult *r, double us)
+{
+    r->samples[r->count++] = us;
+    r->total_us += us;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 取已排序样本的分位数
+static double percentile(const double *sorted, int n, double p)
+{
+    if (n == 0)
+        return 0;
+    int idx = (int)(p * (n - 1) + 0.5);
+    return sorted[idx];
+}
+
+static const char *tags[TAG_COUNT] = {"active", "pending", "closed", "failed", "north", "south", "east", "west",
+                                      "alpha", "beta", "gamma", "delta", "red", "green", "blue", "black"};
+
+// 构造条件 col op value
+static struct Condition *cond_int(const char *col, int op, int v)
+{
+    return create_condition((char *)col, op, create_value_int(v));
+}
+
+// 插入一行 (id, grp, tag) 到指定表
+static void insert_row(const char *table, int id, int grp, const char *tag)
+{
+    struct Value *v = create_value_int(id);
+    v->next = create_value_int(grp);
+    v->next->next = create_value_str((char *)tag);
+    db_insert(table, NULL, v);
+    free_value_list(v);
+}
+
+// id_constraint: id列的约束（CONSTRAINT_NONE / CONSTRAINT_PRIMARY_KEY）
+static void create_bench_table(const char *name, int id_constraint)
+{
+    struct ColumnDef *cols = create_column_defs(NULL, create_column_def("id", "INT"));
+    cols->constraint = id_constraint;
+    cols = create_column_defs(cols, create_column_def("grp", "INT"));
+    cols = create_column_defs(cols, create_column_def("tag", "CHAR(16)"));
+    db_create_table(name, cols);
+    free_column_defs(cols);
+}
+
+// 并发写入的生产者：每个线程向写入队列入队 count 行，记录每次入队的延迟
+struct Producer
+{
+    struct Ingest *q;
+    int first;       // 第一行的id
+    int count;
+    double *samples; // 指向结果样本数组中属于该线程的部分
+};
+
+#ifdef _WIN32
+static DWORD WINAPI producer_main(LPVOID arg)
+#else
+static void *producer_main(void *arg)
+#endif
+{
+    struct Producer *p = (struct Producer *)arg;
+    struct Value v[3];
+    for (int i = 0; i < p->count; ++i)
+    {
+        int id = p->first + i;
+        v[0].is_int = 1;
+        v[0].int_val = id;
+        v[0].next = &v[1];
+        v[1].is_int = 1;
+        v[1].int_val = id % 100;
+        v[1].next = &v[2];
+        v[2].is_int = 0;
+        v[2].str_val = (char *)tags[id % TAG_COUNT];
+        v[2].next = NULL;
+        double t0 = now_us();
+        db_ingest_push(p->q, v);
+        p->samples[i] = now_us() - t0;
+    }
+    return 0;
+}
+
+// 多个生产者线程经写入队列插入 total 行：样本为单次入队的延迟，
+// 总耗时取从开始入队到全部行写入表中的墙钟时间，ops_per_sec 即持续写入吞吐量
+static void bench_ingest(const char *table, int total, int producers)
+{
+    struct Ingest *q = db_ingest_open(table, 4096);
+    if (!q)
+        return;
+    struct BenchResult *r = bench_begin("ingest", total);
+    struct Producer prod[MAX_PRODUCERS];
+#ifdef _WIN32
+    HANDLE tids[MAX_PRODUCERS];
+#else
+    pthread_t tids[MAX_PRODUCERS];
+#endif
+    double t0 = now_us();
+    for (int i = 0, first = 0; i < producers; ++i)
+    {
+        prod[i].q = q;
+        prod[i].first = first;
+        prod[i].count = total / producers + (i < total % producers);
+        prod[i].samples = r->samples + first;
+        first += prod[i].count;
+#ifdef _WIN32
+        tids[i] = CreateThread(NULL, 0, producer_main, &prod[i], 0, NULL);
+#else
+        pthread_create(&tids[i], NULL, producer_main, &prod[i]);
+#endif
+    }
+    for (int i = 0; i < producers; ++i)
+    {
+#ifdef _WIN32
+        WaitForSingleObject(tids[i], INFINITE);
+        CloseHandle(tids[i]);
+#else
+        pthread_join(tids[i], NULL);
+#endif
+    }
+    db_ingest_flush(q);
+    r->count = total;
+    r->total_us = now_us() - t0;
+    db_ingest_close(q);
+}
+
+static void write_json(FILE *fp, int rows, int queries, int join_rows, int range, int rounds, int producers)
+{
+    fprintf(fp, "{\n  \"timestamp\": %ld,\n", (long)time(NULL));
+    fprintf(fp, "  \"scale\": {\"rows\": %d, \"queries\": %d, \"join_rows\": %d, \"range\": %d, \"snapshot_rounds\": %d, "
+                "\"producers\": %d},\n",
+            rows, queries, join_rows, range, rounds, producers);
+    fprintf(fp, "  \"results\": [\n");
+    for (int i = 0; i < result_count; ++i)
+    {
+        struct BenchResult *r = &results[i];
+        qsort(r->samples, r->count, sizeof(double), cmp_double);
+        fprintf(fp, "    {\"op\": \"%s\", \"count\": %d, \"total_ms\": %.3f, \"ops_per_sec\": %.1f, "
+                    "\"p50_us\": %.2f, \"p90_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f}%s\n",
+                r->op, r->count, r->total_us / 1e3, r->total_us > 0 ? r->count * 1e6 / r->total_us : 0.0,
+                percentile(r->samples, r->count, 0.50), percentile(r->samples, r->count, 0.90),
+                percentile(r->samples, r->count, 0.99), r->count ? r->samples[r->count - 1] : 0.0,
+                i + 1 < result_count ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    int rows = 10000, queries = 200, join_rows = 300, range = 100, rounds = 3, producers = 16;
+    const char *out_path = NULL;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-n") == 0)
+            rows = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-q") == 0)
+            queries = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-j") == 0)
+            join_rows = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-r") == 0)
+            range = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-s") == 0)
+            rounds = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-p") == 0)
+            producers = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-o") == 0)
+            out_path = argv[i + 1];
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (rows < 1)
+        rows = 1;
+    if (producers < 1)
+        producers = 1;
+    if (producers > MAX_PRODUCERS)
+        producers = MAX_PRODUCERS;
+    srand(12345); // 固定种子，保证每次运行的数据和查询一致
+
+    // 数据库层的结果直接打印到stdout，测试期间重定向到空设备
+    FILE *devnull = freopen(NULL_DEVICE, "w", stdout);
+    (void)devnull;
+    db_set_dump_file(BENCH_DUMP_FILE);
+    db_create_database("bench");
+    db_use_database("bench");
+    create_bench_table("bench_a", CONSTRAINT_NONE);
+    create_bench_table("bench_b", CONSTRAINT_NONE);
+    create_bench_table("bench_c", CONSTRAINT_NONE);
+    create_bench_table("bench_k", CONSTRAINT_PRIMARY_KEY);
+
+    // INSERT
+    struct BenchResult *r = bench_begin("insert", rows);
+    for (int i = 0; i < rows; ++i)
+    {
+        double t0 = now_us();
+        insert_row("bench_a", i, i % 100, tags[rand() % TAG_COUNT]);
+        bench_record(r, now_us() - t0);
+    }
+    // 带PRIMARY KEY的表：插入时维护哈希索引并检查重复
+    r = bench_begin("insert_pk", rows);
+    for (int i = 0; i < rows; ++i)
+    {
+        double t0 = now_us();
+        insert_row("bench_k", i, i % 100, tags[rand() % TAG_COUNT]);
+        bench_record(r, now_us() - t0);
+    }
+    // 并发写入：producers 个线程经写入队列向 bench_i 插入 10 倍行数
+    create_bench_table("bench_i", CONSTRAINT_NONE);
+    bench_ingest("bench_i", rows * 10, producers);
+    for (int i = 0; i < join_rows; ++i)
+    {
+        insert_row("bench_b", i, i % 10, tags[i % TAG_COUNT]);
+        insert_row("bench_c", i, i % 10, tags[(i * 7) % TAG_COUNT]);
+    }
+
+    struct ColumnList *tl_a = create_column_list("bench_a", NULL);
+    // 点查询：id = k
+    r = bench_begin("select_point", queries);
+    for (int i = 0; i < queries; ++i)
+    {
+        struct Condition *c = cond_int("id", EQ, rand() % rows);
+        double t0 = now_us();
+        db_select(tl_a, NULL, c);
+        bench_record(r, now_us() - t0);
+        free_condition(c);
+    }
+    // 主键点查询：走索引
+    struct ColumnList *tl_k = create_column_list("bench_k", NULL);
+    r = bench_begin("select_pk_point", queries);
+    for (int i = 0; i < queries; ++i)
+    {
+        struct Condition *c = cond_int("id", EQ, rand() % rows);
+        double t0 = now_us();
+        db_select(tl_k, NULL, c);
+        bench_record(r, now_us() - t0);
+        free_condition(c);
+    }
+    free_column_list(tl_k);
+    // INSERT ... ON CONFLICT DO UPDATE：一半命中已有的行
+    r = bench_begin("upsert", queries);
+    for (int i = 0; i < queries; ++i)
+    {
+        struct Value *v = create_value_int(rand() % (rows * 2));
+        v->next = create_value_int(1);
+        v->next->next = create_value_str((char *)tags[rand() % TAG_COUNT]);
+        struct Expr *e = create_expr_binop('+', create_expr_col("grp"), create_expr_excluded("grp"));
+        struct SetItem *set = create_set_list(create_set_item("grp", e), NULL);
+        double t0 = now_us();
+        db_upsert("bench_k", NULL, v, CONFLICT_UPDATE, set);
+        bench_record(r, now_us() - t0);
+        free_value_list(v);
+        free_set_list(set);
+    }
+    // 范围查询：id >= k AND id < k + range
+    r = bench_begin("select_range", queries);
+    for (int i = 0; i < queries; ++i)
+    {
+        int k = rand() % rows;
+        struct Condition *c = create_condition_and(cond_int("id", GE, k), cond_int("id", LT, k + range));
+        double t0 = now_us();
+        db_select(tl_a, NULL, c);
+        bench_record(r, now_us() - t0);
+        free_condition(c);
+    }
+    // 字符串等值查询：tag = 'xxx'
+    r = bench_begin("select_str_eq", queries);
+    for (int i = 0; i < queries; ++i)
+    {
+        struct Condition *c = create_condition("tag", EQ, create_value_str((char *)tags[rand() % TAG_COUNT]));
+        double t0 = now_us();
+        db_select(tl_a, NULL, c);
+        bench_record(r, now_us() - t0);
+        free_condition(c);
+    }
+    // 两表连接：bench_b, bench_c 的笛卡尔积上过滤
+    struct ColumnList *tl_bc = create_column_list("bench_b", create_column_list("bench_c", NULL));
+    int join_queries = queries / 10 > 0 ? queries / 10 : 1;
+    r = bench_begin("select_join", join_queries);
+    for (int i = 0; i < join_queries; ++i)
+    {
+        struct Condition *c = create_condition_and(cond_int("id", EQ, rand() % (join_rows ? join_rows : 1)),
+                                                   cond_int("grp", LT, 5));
+        double t0 = now_us();
+        db_select(tl_bc, NULL, c);
+        bench_record(r, now_us() - t0);
+        free_condition(c);
+    }
+    free_column_list(tl_bc);
+    // UPDATE ... WHERE id = k
+    r = bench_begin("update", queries);
+    for (int i = 0; i < queries; ++i)
+    {
+        struct Condition *c = cond_int("id", EQ, rand() % rows);
+        struct SetItem *set = create_set_list(create_set_item("tag", create_expr_value(create_value_str((char *)tags[rand() % TAG_COUNT]))), NULL);
+        double t0 = now_us();
+        db_update("bench_a", set, c);
+        bench_record(r, now_us() - t0);
+        free_condition(c);
+        free_set_list(set);
+    }
+    // save_db / load_db
+    struct BenchResult *rs = bench_begin("save_db", rounds);
+    struct BenchResult *rl = bench_begin("load_db", rounds);
+    struct BenchResult *rm = bench_begin("load_table", rounds);
+    for (int i = 0; i < rounds; ++i)
+    {
+        double t0 = now_us();
+        save_db();
+        bench_record(rs, now_us() - t0);
+        db_drop_database("bench");
+        t0 = now_us();
+        load_db();
+        bench_record(rl, now_us() - t0);
+        db_use_database("bench");
+        // 表数据在首次访问时读入：用一个不匹配任何行的查询触发
+        struct Condition *c = cond_int("id", LT, 0);
+        t0 = now_us();
+        db_select(tl_a, NULL, c);
+        bench_record(rm, now_us() - t0);
+        free_condition(c);
+    }
+    // DELETE ... WHERE id = k（最后执行，避免影响其他测试的数据规模）
+    r = bench_begin("delete", queries);
+    for (int i = 0; i < queries; ++i)
+    {
+        struct Condition *c = cond_int("id", EQ, rand() % rows);
+        double t0 = now_us();
+        db_delete("bench_a", c);
+        bench_record(r, now_us() - t0);
+        free_condition(c);
+    }
+    free_column_list(tl_a);
+    remove(BENCH_DUMP_FILE);
+    remove(db_journal_path());
+
+    FILE *out = stderr;
+    if (out_path && !(out = fopen(out_path, "w")))
+    {
+        fprintf(stderr, "Cannot open %s\n", out_path);
+        return 1;
+    }
+    write_json(out, rows, queries, join_rows, range, rounds, producers);
+    if (out != stderr)
+        fclose(out);
+    return 0;
+}
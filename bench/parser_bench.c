@@ -0,0 +1,213 @@
+// MiniDBMS 解析器基准测试：链接词法/语法分析器，测量从SQL文本到执行调用的开销
+// 用法: MiniDBMS_parser_bench [-w 列表宽度] [-q 重复次数] [-o 结果文件]
+// 语句都指向不存在的表，执行层立即返回，耗时基本都在词法分析、语法分析和语法树构造上
+// 结果格式与 MiniDBMS_bench 相同
+#include "../database/db_api.h"
+#include "../database/sql_struct.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+typedef void *YY_BUFFER_STATE;
+extern YY_BUFFER_STATE yy_scan_bytes(const char *bytes, int len);
+extern void yy_delete_buffer(YY_BUFFER_STATE buffer);
+extern int yyparse(void);
+extern int parse_error_count;
+
+#define SMALL_STATEMENTS 1000
+
+// 单调时钟，返回微秒
+static double now_us()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER cnt;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&cnt);
+    return (double)cnt.QuadPart * 1e6 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+#endif
+}
+
+// 一项操作的测量结果
+struct BenchResult
+{
+    const char *op;  // 操作名
+    double *samples; // 每次解析的延迟（微秒）
+    int count;       // 解析次数
+    double total_us; // 总耗时
+};
+
+static struct BenchResult results[8];
+static int result_count = 0;
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 取已排序样本的分位数
+static double percentile(const double *sorted, int n, double p)
+{
+    if (n == 0)
+        return 0;
+    int idx = (int)(p * (n - 1) + 0.5);
+    return sorted[idx];
+}
+
+// 可增长的SQL文本
+struct SqlBuf
+{
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+static void sql_printf(struct SqlBuf *b, const char *fmt, ...)
+{
+    va_list ap;
+    for (;;)
+    {
+        va_start(ap, fmt);
+        int n = vsnprintf(b->data + b->len, b->cap - b->len, fmt, ap);
+        va_end(ap);
+        if (n >= 0 && b->len + n < b->cap)
+        {
+            b->len += n;
+            return;
+        }
+        b->cap = b->cap ? b->cap * 2 : 4096;
+        while (n >= 0 && b->len + n >= b->cap)
+            b->cap *= 2;
+        b->data = (char *)realloc(b->data, b->cap);
+    }
+}
+
+// 把同一段SQL解析 count 次，每次作为一个样本
+static void bench_parse(const char *op, struct SqlBuf *sql, int count)
+{
+    struct BenchResult *r = &results[result_count++];
+    r->op = op;
+    r->samples = (double *)malloc(sizeof(double) * (count > 0 ? count : 1));
+    r->count = 0;
+    r->total_us = 0;
+    for (int i = 0; i < count; ++i)
+    {
+        double t0 = now_us();
+        YY_BUFFER_STATE bp = yy_scan_bytes(sql->data, (int)sql->len);
+        yyparse();
+        yy_delete_buffer(bp);
+        double us = now_us() - t0;
+        r->samples[r->count++] = us;
+        r->total_us += us;
+    }
+}
+
+static void write_json(FILE *fp, int width, int repeat)
+{
+    fprintf(fp, "{\n  \"timestamp\": %ld,\n", (long)time(NULL));
+    fprintf(fp, "  \"scale\": {\"width\": %d, \"repeat\": %d, \"small_statements\": %d, \"syntax_errors\": %d},\n", width,
+            repeat, SMALL_STATEMENTS, parse_error_count);
+    fprintf(fp, "  \"results\": [\n");
+    for (int i = 0; i < result_count; ++i)
+    {
+        struct BenchResult *r = &results[i];
+        qsort(r->samples, r->count, sizeof(double), cmp_double);
+        fprintf(fp, "    {\"op\": \"%s\", \"count\": %d, \"total_ms\": %.3f, \"ops_per_sec\": %.1f, "
+                    "\"p50_us\": %.2f, \"p90_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f}%s\n",
+                r->op, r->count, r->total_us / 1e3, r->total_us > 0 ? r->count * 1e6 / r->total_us : 0.0,
+                percentile(r->samples, r->count, 0.50), percentile(r->samples, r->count, 0.90),
+                percentile(r->samples, r->count, 0.99), r->count ? r->samples[r->count - 1] : 0.0,
+                i + 1 < result_count ? "," : "");
+    }
+    fprintf(fp, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    int width = 2000, repeat = 200;
+    const char *out_path = NULL;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-w") == 0)
+            width = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-q") == 0)
+            repeat = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "-o") == 0)
+            out_path = argv[i + 1];
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (width < 1)
+        width = 1;
+
+    // 执行层的输出（表不存在等）重定向到空设备
+    FILE *devnull = freopen(NULL_DEVICE, "w", stdout);
+    (void)devnull;
+    db_set_quiet(1);
+    db_create_database("bench");
+    db_use_database("bench");
+
+    // 宽INSERT：一条语句带 width 个值
+    struct SqlBuf sql = {0};
+    sql_printf(&sql, "INSERT INTO no_such_table VALUES (");
+    for (int i = 0; i < width; ++i)
+        sql_printf(&sql, i % 2 ? "%s'v%d'" : "%s%d", i ? ", " : "", i);
+    sql_printf(&sql, ");\n");
+    bench_parse("insert_wide", &sql, repeat);
+
+    // 宽投影：SELECT 列表带 width 个列名
+    sql.len = 0;
+    sql_printf(&sql, "SELECT ");
+    for (int i = 0; i < width; ++i)
+        sql_printf(&sql, "%sc%d", i ? ", " : "", i);
+    sql_printf(&sql, " FROM no_such_table WHERE c0 = 1;\n");
+    bench_parse("select_wide", &sql, repeat);
+
+    // 宽UPDATE：SET 列表带 width 项
+    sql.len = 0;
+    sql_printf(&sql, "UPDATE no_such_table SET ");
+    for (int i = 0; i < width; ++i)
+        sql_printf(&sql, "%sc%d = c%d + %d", i ? ", " : "", i, i, i);
+    sql_printf(&sql, " WHERE c0 > 1;\n");
+    bench_parse("update_wide", &sql, repeat);
+
+    // 大量短语句：每个样本是一段含 SMALL_STATEMENTS 条语句的脚本
+    sql.len = 0;
+    for (int i = 0; i < SMALL_STATEMENTS; ++i)
+    {
+        if (i % 2)
+            sql_printf(&sql, "SELECT id, name FROM no_such_table WHERE id = %d AND name <> 'x%d';\n", i, i);
+        else
+            sql_printf(&sql, "INSERT INTO no_such_table VALUES (%d, 'name%d', %d);\n", i, i, i * 7);
+    }
+    bench_parse("small_statements", &sql, repeat);
+    free(sql.data);
+
+    FILE *out = stderr;
+    if (out_path && !(out = fopen(out_path, "w")))
+    {
+        fprintf(stderr, "Cannot open %s\n", out_path);
+        return 1;
+    }
+    write_json(out, width, repeat);
+    if (out != stderr)
+        fclose(out);
+    return 0;
+}
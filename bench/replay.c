@@ -0,0 +1,486 @@
+// MiniDBMS 负载重放：在一份快照上重新执行 MiniDBMS --capture 录制的语句，统计各类语句的延迟分布并与基线比较
+// 用法: MiniDBMS_replay -c 录制文件 [-c 录制文件 ...] [-d 快照] [-m fast|paced] [-b 基线结果] [-o 结果文件]
+// 快照及其提交日志先复制为 快照.replay 再加载，重放不修改原快照，每次重放都从同一状态开始；
+// 多个录制文件（多个会话）按语句的开始时刻合并，切换会话时恢复该会话的当前数据库
+// fast 模式逐条连续执行；paced 模式按录制时的间隔执行，来不及时记录落后的时间
+// 基线默认为录制时测得的延迟，-b 指定上一次重放的结果文件（-o 的输出）时与之比较
+// 结果格式与 MiniDBMS_bench 相同，每类语句多一项出错次数
+#include "../database/db_api.h"
+#include "../database/db_codec.h"
+#include "../database/db_stats.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#define NULL_DEVICE "NUL"
+#else
+#include <unistd.h>
+#define NULL_DEVICE "/dev/null"
+#endif
+
+typedef void *YY_BUFFER_STATE;
+extern YY_BUFFER_STATE yy_scan_bytes(const char *bytes, int len);
+extern void yy_delete_buffer(YY_BUFFER_STATE buffer);
+extern int yyparse(void);
+extern int parse_allow_exit;
+
+#define CAPTURE_MAGIC "MDBCAP1\n"
+#define MAX_CAPTURES 64
+
+// 录制文件中的一条语句
+struct Record
+{
+    unsigned long long at; // 开始时刻（Unix时间，微秒）
+    long seq;              // 读入顺序，开始时刻相同时保持录制顺序
+    int session;           // 会话下标
+    int type;              // 语句类型
+    int failed;            // 录制时是否出错
+    double us;             // 录制时的延迟（微秒）
+    const char *text;      // 语句文本（指向录制文件的内容，不以'\0'结尾）
+    int len;
+};
+
+// 一个会话：录制文件头部的会话号和重放中的当前数据库
+struct Session
+{
+    unsigned id;
+    char db[128];
+};
+
+// 一类语句的样本
+struct Samples
+{
+    double *us;
+    int count;
+    int cap;
+    int errors;
+    double total_us;
+};
+
+// 一类语句的分布（基线或重放结果）
+struct Summary
+{
+    int count;
+    int errors;
+    double total_us;
+    double p50, p90, p99, max;
+};
+
+static struct Record *records = NULL;
+static long record_count = 0, record_cap = 0;
+static struct Session sessions[MAX_CAPTURES];
+static int session_count = 0;
+
+static void samples_add(struct Samples *s, double us)
+{
+    if (s->count == s->cap)
+    {
+        s->cap = s->cap ? s->cap * 2 : 256;
+        s->us = (double *)realloc(s->us, sizeof(double) * s->cap);
+    }
+    s->us[s->count++] = us;
+    s->total_us += us;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int cmp_record(const void *a, const void *b)
+{
+    const struct Record *x = (const struct Record *)a, *y = (const struct Record *)b;
+    if (x->at != y->at)
+        return x->at < y->at ? -1 : 1;
+    return x->seq < y->seq ? -1 : x->seq > y->seq;
+}
+
+// 取已排序样本的分位数
+static double percentile(const double *sorted, int n, double p)
+{
+    if (n == 0)
+        return 0;
+    int idx = (int)(p * (n - 1) + 0.5);
+    return sorted[idx];
+}
+
+static void summarize(struct Samples *s, struct Summary *out)
+{
+    if (s->count)
+        qsort(s->us, s->count, sizeof(double), cmp_double);
+    out->count = s->count;
+    out->errors = s->errors;
+    out->total_us = s->total_us;
+    out->p50 = percentile(s->us, s->count, 0.50);
+    out->p90 = percentile(s->us, s->count, 0.90);
+    out->p99 = percentile(s->us, s->count, 0.99);
+    out->max = s->count ? s->us[s->count - 1] : 0;
+}
+
+// 读入整个文件，返回内容（由调用者free），失败返回NULL
+static unsigned char *read_file(const char *path, size_t *len)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return NULL;
+    struct ByteBuf b = {0};
+    unsigned char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+        bb_put(&b, chunk, n);
+    fclose(fp);
+    *len = b.len;
+    if (!b.data)
+        b.data = (unsigned char *)malloc(1);
+    return b.data;
+}
+
+// 解析一个录制文件，把其中的语句追加到 records；文件内容须保留到重放结束
+static int load_capture(const char *path, unsigned char *data, size_t len)
+{
+    if (len < 8 || memcmp(data, CAPTURE_MAGIC, 8) != 0)
+    {
+        fprintf(stderr, "Not a capture file: %s\n", path);
+        return -1;
+    }
+    if (session_count == MAX_CAPTURES)
+    {
+        fprintf(stderr, "Too many capture files (at most %d)\n", MAX_CAPTURES);
+        return -1;
+    }
+    struct ByteReader r = {data + 8, data + len, 0};
+    struct Session *s = &sessions[session_count];
+    s->id = (unsigned)br_varint(&r);
+    snprintf(s->db, sizeof(s->db), "default"); // 与 MiniDBMS 启动时一样从 default 数据库开始
+    unsigned long long start = br_varint(&r);
+    while (!r.err && r.p < r.end)
+    {
+        unsigned long long at = br_varint(&r);
+        unsigned type = br_u8(&r);
+        unsigned long long ns = br_varint(&r);
+        unsigned long long n = br_varint(&r);
+        if (r.err || n > (unsigned long long)(r.end - r.p))
+            break; // 录制进程异常退出时最后一条记录可能不完整
+        if (record_count == record_cap)
+        {
+            record_cap = record_cap ? record_cap * 2 : 4096;
+            records = (struct Record *)realloc(records, sizeof(struct Record) * record_cap);
+        }
+        struct Record *rec = &records[record_count];
+        rec->at = start + at;
+        rec->seq = record_count++;
+        rec->session = session_count;
+        rec->type = (int)(type & 0x7f) < STMT_TYPE_COUNT ? (int)(type & 0x7f) : STMT_SELECT;
+        rec->failed = (type & 0x80) != 0;
+        rec->us = ns / 1e3;
+        rec->text = (const char *)r.p;
+        rec->len = (int)n;
+        r.p += n;
+    }
+    ++session_count;
+    return 0;
+}
+
+// 复制文件，src不存在时删除dst；返回-1表示写入失败
+static int copy_file(const char *src, const char *dst)
+{
+    size_t len;
+    unsigned char *data = read_file(src, &len);
+    if (!data)
+    {
+        remove(dst);
+        return 0;
+    }
+    FILE *fp = fopen(dst, "wb");
+    int ok = fp && fwrite(data, 1, len, fp) == len;
+    if (fp && fclose(fp) != 0)
+        ok = 0;
+    free(data);
+    return ok ? 0 : -1;
+}
+
+// 解析并执行一段SQL文本（重放快照副本的提交日志时由 db_replay_journals 调用）
+static void run_sql(const char *sql, size_t len)
+{
+    YY_BUFFER_STATE bp = yy_scan_bytes(sql, (int)len);
+    yyparse();
+    yy_delete_buffer(bp);
+}
+
+static void sleep_us(double us)
+{
+#ifdef _WIN32
+    Sleep((DWORD)(us / 1e3));
+#else
+    usleep((useconds_t)us);
+#endif
+}
+
+// 读取上一次重放的结果文件作为基线，返回读到的语句类型数
+static int load_baseline(const char *path, struct Summary *base)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return -1;
+    char line[1024];
+    int n = 0;
+    while (fgets(line, sizeof(line), fp))
+    {
+        char *op = strstr(line, "\"op\": \"");
+        if (!op)
+            continue;
+        op += 7;
+        char *end = strchr(op, '"');
+        if (!end)
+            continue;
+        *end = '\0';
+        for (int t = 0; t < STMT_TYPE_COUNT; ++t)
+        {
+            if (strcmp(op, stats_type_name(t)) != 0)
+                continue;
+            struct Summary *s = &base[t];
+            double total_ms = 0;
+            char *p;
+            if ((p = strstr(end + 1, "\"count\": ")))
+                s->count = atoi(p + 9);
+            if ((p = strstr(end + 1, "\"errors\": ")))
+                s->errors = atoi(p + 10);
+            if ((p = strstr(end + 1, "\"total_ms\": ")))
+                total_ms = atof(p + 12);
+            if ((p = strstr(end + 1, "\"p50_us\": ")))
+                s->p50 = atof(p + 10);
+            if ((p = strstr(end + 1, "\"p90_us\": ")))
+                s->p90 = atof(p + 10);
+            if ((p = strstr(end + 1, "\"p99_us\": ")))
+                s->p99 = atof(p + 10);
+            if ((p = strstr(end + 1, "\"max_us\": ")))
+                s->max = atof(p + 10);
+            s->total_us = total_ms * 1e3;
+            ++n;
+        }
+    }
+    fclose(fp);
+    return n;
+}
+
+// 相对基线的变化（百分比），基线为0时不显示
+static void format_change(char *buf, size_t n, double base, double cur)
+{
+    if (base > 0)
+        snprintf(buf, n, "%+.1f%%", (cur - base) * 100.0 / base);
+    else
+        snprintf(buf, n, "-");
+}
+
+static void print_report(FILE *fp, struct Summary *base, struct Summary *cur, const char *base_name)
+{
+    fprintf(fp, "  %-10s %8s %8s %10s %10s %8s %10s %10s %8s %10s\n", "Statement", "Count", "Errors", "p50(us)", "base", "change",
+            "p99(us)", "base", "change", "Max(us)");
+    for (int t = 0; t < STMT_TYPE_COUNT; ++t)
+    {
+        if (!cur[t].count && !base[t].count)
+            continue;
+        char errors[32], c50[16], c99[16];
+        snprintf(errors, sizeof(errors), "%d/%d", cur[t].errors, base[t].errors);
+        format_change(c50, sizeof(c50), base[t].p50, cur[t].p50);
+        format_change(c99, sizeof(c99), base[t].p99, cur[t].p99);
+        fprintf(fp, "  %-10s %8d %8s %10.2f %10.2f %8s %10.2f %10.2f %8s %10.2f\n", stats_type_name(t), cur[t].count, errors,
+                cur[t].p50, base[t].p50, c50, cur[t].p99, base[t].p99, c99, cur[t].max);
+    }
+    fprintf(fp, "  (errors: replay/%s)\n", base_name);
+}
+
+static void write_json(FILE *fp, struct Summary *cur, const char *mode, double elapsed_us, double max_lag_us)
+{
+    fprintf(fp, "{\n  \"timestamp\": %ld,\n", (long)time(NULL));
+    fprintf(fp, "  \"scale\": {\"statements\": %ld, \"sessions\": %d, \"mode\": \"%s\", \"replay_ms\": %.3f, \"max_lag_ms\": %.3f},\n",
+            record_count, session_count, mode, elapsed_us / 1e3, max_lag_us / 1e3);
+    fprintf(fp, "  \"results\": [\n");
+    int first = 1;
+    for (int t = 0; t < STMT_TYPE_COUNT; ++t)
+    {
+        struct Summary *s = &cur[t];
+        if (!s->count && !s->errors)
+            continue;
+        fprintf(fp, "%s    {\"op\": \"%s\", \"count\": %d, \"errors\": %d, \"total_ms\": %.3f, \"ops_per_sec\": %.1f, "
+                    "\"p50_us\": %.2f, \"p90_us\": %.2f, \"p99_us\": %.2f, \"max_us\": %.2f}",
+                first ? "" : ",\n", stats_type_name(t), s->count, s->errors, s->total_us / 1e3,
+                s->total_us > 0 ? s->count * 1e6 / s->total_us : 0.0, s->p50, s->p90, s->p99, s->max);
+        first = 0;
+    }
+    fprintf(fp, "\n  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *captures[MAX_CAPTURES];
+    int capture_count = 0;
+    const char *snapshot = "data.db", *mode = "fast", *baseline = NULL, *out_path = NULL;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (strcmp(argv[i], "-c") == 0 && capture_count < MAX_CAPTURES)
+            captures[capture_count++] = argv[i + 1];
+        else if (strcmp(argv[i], "-d") == 0)
+            snapshot = argv[i + 1];
+        else if (strcmp(argv[i], "-m") == 0)
+            mode = argv[i + 1];
+        else if (strcmp(argv[i], "-b") == 0)
+            baseline = argv[i + 1];
+        else if (strcmp(argv[i], "-o") == 0)
+            out_path = argv[i + 1];
+        else
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+    }
+    int paced = strcmp(mode, "paced") == 0;
+    if (!capture_count || (!paced && strcmp(mode, "fast") != 0))
+    {
+        fprintf(stderr, "Usage: %s -c workload.cap [-c ...] [-d data.db] [-m fast|paced] [-b baseline.json] [-o result.json]\n",
+                argv[0]);
+        return 1;
+    }
+
+    // 读入录制文件，按开始时刻合并
+    unsigned char *files[MAX_CAPTURES];
+    for (int i = 0; i < capture_count; ++i)
+    {
+        size_t len;
+        if (!(files[i] = read_file(captures[i], &len)))
+        {
+            fprintf(stderr, "Cannot open %s\n", captures[i]);
+            return 1;
+        }
+        if (load_capture(captures[i], files[i], len) < 0)
+            return 1;
+    }
+    qsort(records, record_count, sizeof(struct Record), cmp_record);
+
+    // 基线：录制时的延迟，或上一次重放的结果
+    struct Summary base[STMT_TYPE_COUNT], cur[STMT_TYPE_COUNT];
+    struct Samples samples[STMT_TYPE_COUNT];
+    memset(base, 0, sizeof(base));
+    memset(samples, 0, sizeof(samples));
+    if (baseline)
+    {
+        if (load_baseline(baseline, base) < 0)
+        {
+            fprintf(stderr, "Cannot open %s\n", baseline);
+            return 1;
+        }
+    }
+    else
+    {
+        for (long i = 0; i < record_count; ++i)
+        {
+            samples_add(&samples[records[i].type], records[i].us);
+            samples[records[i].type].errors += records[i].failed;
+        }
+        for (int t = 0; t < STMT_TYPE_COUNT; ++t)
+        {
+            summarize(&samples[t], &base[t]);
+            samples[t].count = 0;
+            samples[t].errors = 0;
+            samples[t].total_us = 0;
+        }
+    }
+
+    // 在快照的副本上重放：先复制快照和提交日志，原快照不受重放中写入的影响
+    char work[512], src_journal[512], src_old[512];
+    snprintf(work, sizeof(work), "%s.replay", snapshot);
+    db_set_dump_file(snapshot);
+    snprintf(src_journal, sizeof(src_journal), "%s", db_journal_path());
+    snprintf(src_old, sizeof(src_old), "%s", db_journal_old_path());
+    db_set_dump_file(work);
+    if (copy_file(snapshot, work) < 0 || copy_file(src_journal, db_journal_path()) < 0 ||
+        copy_file(src_old, db_journal_old_path()) < 0)
+    {
+        fprintf(stderr, "Cannot copy snapshot %s to %s\n", snapshot, work);
+        return 1;
+    }
+
+    // SELECT结果和执行信息重定向到空设备，报告输出到标准错误
+    FILE *devnull = freopen(NULL_DEVICE, "w", stdout);
+    (void)devnull;
+    db_set_quiet(QUIET_INFO);
+    parse_allow_exit = 0; // 录制中的EXIT不结束重放
+    load_db();
+    if (!find_db("default"))
+        db_create_database("default");
+    db_use_database("default");
+    db_replay_journals(run_sql);
+
+    int session = -1;
+    double max_lag = 0, t0 = db_now_us();
+    for (long i = 0; i < record_count; ++i)
+    {
+        struct Record *rec = &records[i];
+        if (paced)
+        {
+            double due = t0 + (double)(rec->at - records[0].at), now = db_now_us();
+            if (now < due)
+                sleep_us(due - now);
+            else if (now - due > max_lag)
+                max_lag = now - due;
+        }
+        // 所有会话共用一个引擎：切换会话时先切换到该会话的当前数据库
+        if (rec->session != session)
+        {
+            session = rec->session;
+            if (find_db(sessions[session].db))
+                db_use_database(sessions[session].db);
+        }
+        long before = stats_statement_count();
+        YY_BUFFER_STATE bp = yy_scan_bytes(rec->text, rec->len);
+        yyparse();
+        yy_delete_buffer(bp);
+        struct Samples *s = &samples[rec->type];
+        if (stats_statement_count() != before)
+        {
+            samples_add(s, stats_last_latency());
+            s->errors += stats_last_failed();
+        }
+        else
+            ++s->errors; // 语法错误：语句没有执行
+        const char *db = db_current_database();
+        if (db)
+            snprintf(sessions[session].db, sizeof(sessions[session].db), "%s", db);
+    }
+    double elapsed = db_now_us() - t0;
+    for (int t = 0; t < STMT_TYPE_COUNT; ++t)
+        summarize(&samples[t], &cur[t]);
+
+    fprintf(stderr, "[REPLAY] %ld statements from %d sessions, %.3f s (%s", record_count, session_count, elapsed / 1e6, mode);
+    if (paced)
+        fprintf(stderr, ", max lag %.3f ms", max_lag / 1e3);
+    fprintf(stderr, "), baseline: %s\n", baseline ? baseline : "capture");
+    print_report(stderr, base, cur, baseline ? "baseline" : "capture");
+
+    FILE *out = out_path ? fopen(out_path, "w") : NULL;
+    if (out_path && !out)
+    {
+        fprintf(stderr, "Cannot open %s\n", out_path);
+        return 1;
+    }
+    if (out)
+    {
+        write_json(out, cur, mode, elapsed, max_lag);
+        fclose(out);
+    }
+
+    // 关闭引擎（关闭提交日志文件）后删除快照的副本
+    db_close();
+    remove(db_journal_old_path());
+    remove(db_journal_path());
+    remove(work);
+    for (int i = 0; i < capture_count; ++i)
+        free(files[i]);
+    for (int t = 0; t < STMT_TYPE_COUNT; ++t)
+        free(samples[t].us);
+    free(records);
+    return 0;
+}
@@ -4,3 +4,6 @@ rm parser.tab.*
 cd ..
 rm data.db
 rm MiniDBMS.exe
+rm MiniDBMS_bench.exe
+rm MiniDBMS_replay.exe
+rm bench_result.json
\ No newline at end of file
@@ -1,25 +1,55 @@
 %{
 #include "../database/db_api.h"
+#include "../database/db_stats.h"
 #include "../database/sql_struct.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 void yyerror(const char *s);
 int yylex(void);
+int parse_error_count = 0; // 语法错误计数
+int parse_allow_exit = 1;  // 是否允许EXIT语句（库接口中不允许结束宿主进程）
+// 非NULL时为预编译模式（库接口）：SELECT/INSERT/UPDATE/DELETE 只把语法树存入其中，不执行
+struct ParsedStmt *parse_capture = NULL;
+static void capture_param(struct Value *v);
+const char *lex_statement_text(void);
+void lex_reset_statement(void);
+
+// 语句计时：在归约动作中包住对db_*函数的调用，按语句类型记录延迟，
+// 结束时把修改了数据的语句交给提交日志
+#define STMT_BEGIN()                     \
+    db_stmt_begin(lex_statement_text()); \
+    double stmt_t0 = stats_stmt_begin()
+#define STMT_END(type)                                                                                                \
+    do                                                                                                                \
+    {                                                                                                                 \
+        stats_stmt_end(db_explain_mode() != EXPLAIN_NONE ? STMT_EXPLAIN : (type), stmt_t0, lex_statement_text()); \
+        db_journal_statement(lex_statement_text());                                                                   \
+        db_stmt_end();                                                                                                \
+    } while (0)
+// 预编译模式下记录语句类型，返回非0表示不执行
+#define CAPTURE(t) (parse_capture && (parse_capture->type = (t), ++parse_capture->count))
 %}
 
+// 语法树节点都分配在当前语句的内存池中（见 lexer.l），动作中不逐个释放；
+// 链表归约时带着尾指针，追加为O(1)，使用时取 .head
 %union {
     char* str;
     int num;
     struct ColumnDef* coldef;
-    struct ColumnDef* coldefs;
+    struct { struct ColumnDef *head, *tail; } coldefs;
     struct ColumnList* collist;
+    struct { struct ColumnList *head, *tail; } names;
     struct Value* value;
-    struct Value* vlist;
+    struct { struct Value *head, *tail; } vlist;
     struct SelectList* sellist;
+    struct { struct SelectList *head, *tail; } selitems;
     struct Condition* cond;
     struct SetItem* setitem;
-    struct SetItem* setlist;
+    struct { struct SetItem *head, *tail; } setlist;
+    struct Expr* expr;
+    struct { int action; struct SetItem *set; } conflict;
+    struct SubQuery* subquery;
 }
 
 // =====================
@@ -28,18 +58,30 @@ int yylex(void);
 %token <str> IDENTIFIER STRING CHAR INT
 %token <num> NUMBER
 %token CREATE DATABASE DATABASES USE TABLE SHOW TABLES INSERT INTO VALUES SELECT FROM WHERE UPDATE SET DELETE DROP EXIT
+%token EXPLAIN ANALYZE BEGIN_TXN COMMIT ROLLBACK VACUUM CHECKPOINT
+%token PRIMARY UNIQUE ON CONFLICT DO NOTHING
+%token LIKE INDEX USING IN EXISTS NOT
+%token ALTER ADD COLUMN TABLESAMPLE
 %token NEQ GEQ LEQ AND OR
 
 // 语法规则的值类型声明
 %type <coldef> column_def                               // 单个列定义
 %type <coldefs> column_defs                             // 列定义链表
-%type <collist> column_list opt_column_list table_list  // 列名/表名链表
-%type <value> value                                     // 单个值
-%type <vlist> value_list                                // 值链表
-%type <sellist> select_list select_items                // SELECT字段链表
+%type <num> opt_constraint                              // 列约束
+%type <collist> opt_column_list                         // 可选的列名链表
+%type <names> column_list table_list                    // 列名/表名链表
+%type <value> value opt_default                         // 单个值
+%type <vlist> value_list in_list                        // 值链表
+%type <sellist> select_list select_item                 // SELECT字段链表
+%type <collist> table_ref                               // FROM 中的一个表
+%type <selitems> select_items                           // SELECT字段链表（带尾指针）
 %type <cond> where_clause_opt condition predicate       // 条件表达式
 %type <setitem> set_item                                // SET项
 %type <setlist> set_list                                // SET项链表
+%type <expr> expr term factor                           // SET右侧表达式
+%type <conflict> insert_conflict                        // INSERT的冲突处理
+%type <str> index_method                                // CREATE INDEX 的索引类型
+%type <subquery> subquery                               // IN / EXISTS 的子查询
 
 %%
 
@@ -56,127 +98,247 @@ statement:
   | create_database_stmt
   | use_database_stmt
   | show_tables_stmt
+  | show_other_stmt
+  | set_var_stmt
   | create_table_stmt
+  | create_index_stmt
+  | alter_table_stmt
   | insert_stmt
   | select_stmt
   | update_stmt
   | delete_stmt
   | drop_table_stmt
   | drop_database_stmt
+  | explain_stmt
+  | transaction_stmt
+  | vacuum_stmt
+  | checkpoint_stmt
   | exit_stmt
+  | error ';' { yyerrok; } // 出错时跳过到下一个';'，继续执行后续语句
   ;
 
 show_databases_stmt:
     SHOW DATABASES ';'
-    { db_show_databases(); }
+    { STMT_BEGIN(); db_show_databases(); STMT_END(STMT_SHOW); }
   ;
 
 create_database_stmt:
     CREATE DATABASE IDENTIFIER ';'
-    { db_create_database($3); free($3); }
+    { STMT_BEGIN(); db_create_database($3); STMT_END(STMT_CREATE); }
   ;
 
 use_database_stmt:
     USE IDENTIFIER ';'
-    { db_use_database($2); free($2); }
+    { STMT_BEGIN(); db_use_database($2); STMT_END(STMT_USE); }
   ;
 
 drop_database_stmt:
     DROP DATABASE IDENTIFIER ';'
-    { db_drop_database($3); free($3); }
+    { STMT_BEGIN(); db_drop_database($3); STMT_END(STMT_DROP); }
+  ;
+
+show_other_stmt:
+    SHOW IDENTIFIER ';'
+    { STMT_BEGIN(); db_show($2); STMT_END(STMT_SHOW); }
+  | SHOW CHECKPOINT ';'
+    { STMT_BEGIN(); db_show("checkpoint"); STMT_END(STMT_SHOW); }
+  ;
+
+set_var_stmt:
+    SET IDENTIFIER '=' value ';'
+    { STMT_BEGIN(); db_set_variable($2, $4); STMT_END(STMT_SET); }
   ;
 
 show_tables_stmt:
     SHOW TABLES ';'
-    { db_show_tables(); }
+    { STMT_BEGIN(); db_show_tables(); STMT_END(STMT_SHOW); }
   ;
 
 create_table_stmt:
     CREATE TABLE IDENTIFIER '(' column_defs ')' ';'
-    { db_create_table($3, $5); free($3); free_column_defs($5); }
+    { STMT_BEGIN(); db_create_table($3, $5.head); STMT_END(STMT_CREATE); }
+  ;
+
+create_index_stmt:
+    CREATE INDEX IDENTIFIER ON IDENTIFIER '(' IDENTIFIER ')' index_method ';'
+    { STMT_BEGIN(); db_create_index($3, $5, $7, $9); STMT_END(STMT_CREATE); }
+  // CREATE BITMAP INDEX：BITMAP 不作为关键字，与 USING bitmap 相同
+  | CREATE IDENTIFIER INDEX IDENTIFIER ON IDENTIFIER '(' IDENTIFIER ')' ';'
+    {
+        if (strcasecmp_dbms($2, "BITMAP") != 0) {
+            yyerror("expected CREATE INDEX or CREATE BITMAP INDEX");
+            YYERROR;
+        }
+        STMT_BEGIN(); db_create_index($4, $6, $8, "bitmap"); STMT_END(STMT_CREATE);
+    }
+  ;
+
+index_method:
+    /* empty */         { $$ = NULL; }
+  | USING IDENTIFIER    { $$ = $2; }
   ;
 
 column_defs:
-    column_def                    { $$ = create_column_defs(NULL, $1); }
-  | column_defs ',' column_def    { $$ = create_column_defs($1, $3); }
+    column_def                    { $$.head = $$.tail = $1; }
+  | column_defs ',' column_def    { $$ = $1; $$.tail = $$.tail->next = $3; }
   ;
 
 column_def:
-    IDENTIFIER INT    { $$ = create_column_def($1, $2); free($1); free($2); }
-  | IDENTIFIER CHAR   { $$ = create_column_def($1, $2); free($1); free($2); }
+    IDENTIFIER INT opt_constraint opt_default    { $$ = create_column_def($1, $2); $$->constraint = $3; $$->def = $4; }
+  | IDENTIFIER CHAR opt_constraint opt_default   { $$ = create_column_def($1, $2); $$->constraint = $3; $$->def = $4; }
+  ;
+
+// DEFAULT 不作为关键字（默认数据库名为 default），在动作中检查
+opt_default:
+    /* empty */          { $$ = NULL; }
+  | IDENTIFIER value {
+        if (strcasecmp_dbms($1, "DEFAULT") != 0) {
+            yyerror("expected DEFAULT");
+            YYERROR;
+        }
+        $$ = $2;
+    }
+  ;
+
+// 列约束：KEY常用作列名，不设为保留字，在动作中检查
+opt_constraint:
+    /* empty */          { $$ = CONSTRAINT_NONE; }
+  | UNIQUE               { $$ = CONSTRAINT_UNIQUE; }
+  | PRIMARY IDENTIFIER {
+        if (strcasecmp_dbms($2, "key") != 0) {
+            yyerror("expected KEY after PRIMARY");
+            YYERROR;
+        }
+        $$ = CONSTRAINT_PRIMARY_KEY;
+    }
+  ;
+
+// ALTER TABLE 只修改表结构的元数据，已有的行不改写
+alter_table_stmt:
+    ALTER TABLE IDENTIFIER ADD opt_column column_def ';'
+    { STMT_BEGIN(); db_alter_add_column($3, $6); STMT_END(STMT_ALTER); }
+  | ALTER TABLE IDENTIFIER DROP opt_column IDENTIFIER ';'
+    { STMT_BEGIN(); db_alter_drop_column($3, $6); STMT_END(STMT_ALTER); }
+  ;
+
+opt_column:
+    /* empty */
+  | COLUMN
   ;
 
 drop_table_stmt:
     DROP TABLE IDENTIFIER ';'
-    { db_drop_table($3); free($3); }
+    { STMT_BEGIN(); db_drop_table($3); STMT_END(STMT_DROP); }
   ;
 
 insert_stmt:
-    INSERT INTO IDENTIFIER opt_column_list VALUES value_list ';'
-    { db_insert($3, $4, $6); free($3); }
+    INSERT INTO IDENTIFIER opt_column_list VALUES value_list insert_conflict ';'
+    {
+        if (CAPTURE(STMT_INSERT)) {
+            parse_capture->table = $3;
+            parse_capture->cols = $4;
+            parse_capture->values = $6.head;
+            parse_capture->action = $7.action;
+            parse_capture->set = $7.set;
+        } else {
+            STMT_BEGIN(); db_upsert($3, $4, $6.head, $7.action, $7.set); STMT_END(STMT_INSERT);
+        }
+    }
+  ;
+
+insert_conflict:
+    /* empty */                          { $$.action = CONFLICT_ERROR; $$.set = NULL; }
+  | ON CONFLICT DO NOTHING               { $$.action = CONFLICT_NOTHING; $$.set = NULL; }
+  | ON CONFLICT DO UPDATE SET set_list   { $$.action = CONFLICT_UPDATE; $$.set = $6.head; }
   ;
 
 opt_column_list:
     /* empty */ { $$ = NULL; }
-  | '(' column_list ')' { $$ = $2; }
+  | '(' column_list ')' { $$ = $2.head; }
   ;
 
 column_list:
-    IDENTIFIER { $$ = create_column_list($1, NULL); free($1); }
-  | column_list ',' IDENTIFIER {
-        struct ColumnList* tail = $1;
-        while (tail->next) tail = tail->next;
-        tail->next = create_column_list($3, NULL);
-        $$ = $1;
-        free($3);
-    }
+    IDENTIFIER { $$.head = $$.tail = create_column_list($1, NULL); }
+  | column_list ',' IDENTIFIER { $$ = $1; $$.tail = $$.tail->next = create_column_list($3, NULL); }
   ;
 
 value_list:
     '(' value_list ')'    { $$ = $2; }
-  | value                 { $$ = create_value_list($1, NULL); }
-  | value_list ',' value {
-        struct Value* tail = $1;
-        while (tail->next) tail = tail->next;
-        tail->next = $3;
-        $$ = $1;
-    }
+  | value                 { $$.head = $$.tail = $1; }
+  | value_list ',' value  { $$ = $1; $$.tail = $$.tail->next = $3; }
   ;
 
 value:
     NUMBER    { $$ = create_value_int($1); }
-  | STRING    { $$ = create_value_str($1); free($1); }
+  | STRING    { $$ = create_value_str($1); }
+  | '?' {
+        // 参数占位符：值在执行前由 mdb_bind_* 填入
+        if (!parse_capture) {
+            yyerror("parameters are only allowed in prepared statements");
+            YYERROR;
+        }
+        $$ = create_value_int(0);
+        capture_param($$);
+    }
   ;
 
 select_stmt:
     SELECT select_list FROM table_list where_clause_opt ';'
-    { db_select($4, $2, $5); free_select_list($2); free_column_list($4); free_condition($5); }
+    {
+        if (CAPTURE(STMT_SELECT)) {
+            parse_capture->tables = $4.head;
+            parse_capture->sel = $2;
+            parse_capture->cond = $5;
+        } else {
+            STMT_BEGIN(); db_select($4.head, $2, $5); STMT_END(STMT_SELECT);
+        }
+    }
   ;
 
 select_list:
     '*'             { $$ = NULL; }
-  | select_items    { $$ = $1; }
+  | select_items    { $$ = $1.head; }
   ;
 
 select_items:
-    IDENTIFIER { $$ = create_select_list($1, NULL); free($1); }
-  | select_items ',' IDENTIFIER {
-        struct SelectList* tail = $1;
-        while (tail->next) tail = tail->next;
-        tail->next = create_select_list($3, NULL);
-        $$ = $1;
-        free($3);
+    select_item { $$.head = $$.tail = $1; }
+  | select_items ',' select_item { $$ = $1; $$.tail = $$.tail->next = $3; }
+  ;
+
+select_item:
+    IDENTIFIER { $$ = create_select_list($1, NULL); }
+  | IDENTIFIER '(' IDENTIFIER ')'
+    {
+        // 聚合函数按名字识别，不占用关键字
+        if (strcasecmp_dbms($1, "APPROX_COUNT_DISTINCT") != 0) {
+            yyerror("unknown function");
+            YYERROR;
+        }
+        $$ = create_select_list($3, NULL);
+        $$->agg = AGG_APPROX_DISTINCT;
     }
   ;
 
 table_list:
-    IDENTIFIER { $$ = create_column_list($1, NULL); free($1); }
-  | table_list ',' IDENTIFIER {
-        struct ColumnList* tail = $1;
-        while (tail->next) tail = tail->next;
-        tail->next = create_column_list($3, NULL);
-        $$ = $1;
-        free($3);
+    table_ref { $$.head = $$.tail = $1; }
+  | table_list ',' table_ref { $$ = $1; $$.tail = $$.tail->next = $3; }
+  ;
+
+// 表名后可带 TABLESAMPLE SYSTEM (百分比)：只扫描随机选出的该比例的行块
+table_ref:
+    IDENTIFIER { $$ = create_column_list($1, NULL); }
+  | IDENTIFIER TABLESAMPLE IDENTIFIER '(' NUMBER ')'
+    {
+        if (strcasecmp_dbms($3, "SYSTEM") != 0) {
+            yyerror("only TABLESAMPLE SYSTEM is supported");
+            YYERROR;
+        }
+        if ($5 < 1 || $5 > 100) {
+            yyerror("TABLESAMPLE percentage must be between 1 and 100");
+            YYERROR;
+        }
+        $$ = create_column_list($1, NULL);
+        $$->sample = $5;
     }
   ;
 
@@ -188,50 +350,172 @@ where_clause_opt:
 condition:
     predicate                 { $$ = $1; }
   | '(' condition ')'         { $$ = $2; }
+  | NOT '(' condition ')'     { $$ = create_condition_not($3); }
+  | NOT predicate             { $$ = create_condition_not($2); }
   | condition AND condition   { $$ = create_condition_and($1, $3); }
   | condition OR condition    { $$ = create_condition_or($1, $3); }
   ;
 
 predicate:
-    IDENTIFIER '=' value { $$ = create_condition($1, EQ, $3); free($1); }
-  | IDENTIFIER NEQ value { $$ = create_condition($1, NEQ_OP, $3); free($1); }
-  | IDENTIFIER '>' value { $$ = create_condition($1, GT, $3); free($1); }
-  | IDENTIFIER '<' value { $$ = create_condition($1, LT, $3); free($1); }
-  | IDENTIFIER GEQ value { $$ = create_condition($1, GE, $3); free($1); }
-  | IDENTIFIER LEQ value { $$ = create_condition($1, LE, $3); free($1); }
+    IDENTIFIER '=' value { $$ = create_condition($1, EQ, $3); }
+  | IDENTIFIER NEQ value { $$ = create_condition($1, NEQ_OP, $3); }
+  | IDENTIFIER '>' value { $$ = create_condition($1, GT, $3); }
+  | IDENTIFIER '<' value { $$ = create_condition($1, LT, $3); }
+  | IDENTIFIER GEQ value { $$ = create_condition($1, GE, $3); }
+  | IDENTIFIER LEQ value { $$ = create_condition($1, LE, $3); }
+  | IDENTIFIER LIKE value { $$ = create_condition($1, LIKE_OP, $3); }
+  | IDENTIFIER NOT LIKE value { $$ = create_condition_not(create_condition($1, LIKE_OP, $4)); }
+  | IDENTIFIER NOT IN '(' in_list ')' { $$ = create_condition_not(create_condition_in($1, $5.head)); }
+  | IDENTIFIER IN '(' in_list ')' { $$ = create_condition_in($1, $4.head); }
+  | IDENTIFIER IN '(' subquery ')' {
+        if (!$4->col) {
+            yyerror("IN subquery must select one column");
+            YYERROR;
+        }
+        $$ = create_condition_sub($1, IN_OP, $4);
+    }
+  | IDENTIFIER NOT IN '(' subquery ')' {
+        if (!$5->col) {
+            yyerror("IN subquery must select one column");
+            YYERROR;
+        }
+        $$ = create_condition_not(create_condition_sub($1, IN_OP, $5));
+    }
+  | EXISTS '(' subquery ')' { $$ = create_condition_sub(NULL, EXISTS_OP, $3); }
+  | IDENTIFIER '=' IDENTIFIER '.' IDENTIFIER { $$ = create_condition_ref($1, $3, $5); }
+  ;
+
+in_list:
+    value                 { $$.head = $$.tail = $1; }
+  | in_list ',' value     { $$ = $1; $$.tail = $$.tail->next = $3; }
+  ;
+
+// 子查询只选一列（或 *）、只有一个表
+subquery:
+    SELECT '*' FROM IDENTIFIER where_clause_opt          { $$ = create_subquery(NULL, $4, $5); }
+  | SELECT IDENTIFIER FROM IDENTIFIER where_clause_opt   { $$ = create_subquery($2, $4, $5); }
   ;
 
 update_stmt:
     UPDATE IDENTIFIER SET set_list where_clause_opt ';'
-    { db_update($2, $4, $5); free($2); free_set_list($4); free_condition($5); }
+    {
+        if (CAPTURE(STMT_UPDATE)) {
+            parse_capture->table = $2;
+            parse_capture->set = $4.head;
+            parse_capture->cond = $5;
+        } else {
+            STMT_BEGIN(); db_update($2, $4.head, $5); STMT_END(STMT_UPDATE);
+        }
+    }
   ;
 
 set_list:
-    set_item { $$ = create_set_list($1, NULL); }
-  | set_list ',' set_item {
-        struct SetItem* tail = $1;
-        while (tail->next) tail = tail->next;
-        tail->next = $3;
-        $$ = $1;
-    }
+    set_item               { $$.head = $$.tail = $1; }
+  | set_list ',' set_item  { $$ = $1; $$.tail = $$.tail->next = $3; }
   ;
 
 set_item:
-    IDENTIFIER '=' value { $$ = create_set_item($1, $3); free($1); }
+    IDENTIFIER '=' expr { $$ = create_set_item($1, $3); }
+  ;
+
+// 四则运算表达式：* / % 优先于 + -，均为左结合
+expr:
+    expr '+' term   { $$ = create_expr_binop('+', $1, $3); }
+  | expr '-' term   { $$ = create_expr_binop('-', $1, $3); }
+  | term            { $$ = $1; }
+  ;
+
+term:
+    term '*' factor { $$ = create_expr_binop('*', $1, $3); }
+  | term '/' factor { $$ = create_expr_binop('/', $1, $3); }
+  | term '%' factor { $$ = create_expr_binop('%', $1, $3); }
+  | factor          { $$ = $1; }
+  ;
+
+factor:
+    value           { $$ = create_expr_value($1); }
+  | IDENTIFIER      { $$ = create_expr_col($1); }
+  | IDENTIFIER '.' IDENTIFIER {
+        // 只支持 EXCLUDED.col：ON CONFLICT DO UPDATE 中引用因冲突未插入的值
+        if (strcasecmp_dbms($1, "excluded") != 0) {
+            yyerror("only EXCLUDED.column is supported");
+            YYERROR;
+        }
+        $$ = create_expr_excluded($3);
+    }
+  | '(' expr ')'    { $$ = $2; }
+  | '-' factor      { $$ = create_expr_binop('-', create_expr_value(create_value_int(0)), $2); }
   ;
 
 delete_stmt:
     DELETE FROM IDENTIFIER where_clause_opt ';'
-    { db_delete($3, $4); free($3); free_condition($4); }
+    {
+        if (CAPTURE(STMT_DELETE)) {
+            parse_capture->table = $3;
+            parse_capture->cond = $4;
+        } else {
+            STMT_BEGIN(); db_delete($3, $4); STMT_END(STMT_DELETE);
+        }
+    }
+  ;
+
+transaction_stmt:
+    BEGIN_TXN ';' { STMT_BEGIN(); db_begin(); STMT_END(STMT_TXN); }
+  | COMMIT ';'    { STMT_BEGIN(); db_commit(); STMT_END(STMT_TXN); }
+  | ROLLBACK ';'  { STMT_BEGIN(); db_rollback(); STMT_END(STMT_TXN); }
+  ;
+
+vacuum_stmt:
+    VACUUM ';'            { STMT_BEGIN(); db_vacuum(NULL); STMT_END(STMT_VACUUM); }
+  | VACUUM IDENTIFIER ';' { STMT_BEGIN(); db_vacuum($2); STMT_END(STMT_VACUUM); }
+  ;
+
+checkpoint_stmt:
+    CHECKPOINT ';' { STMT_BEGIN(); db_checkpoint(); STMT_END(STMT_CHECKPOINT); }
+  ;
+
+explain_stmt:
+    EXPLAIN explain_mode explain_target
+    { db_set_explain(EXPLAIN_NONE); }
+  ;
+
+explain_mode:
+    /* empty */ { db_set_explain(EXPLAIN_PLAN); }
+  | ANALYZE     { db_set_explain(EXPLAIN_ANALYZE); }
+  ;
+
+explain_target:
+    select_stmt
+  | update_stmt
+  | delete_stmt
   ;
 
 exit_stmt:
     EXIT ';'
-    { db_exit(); }
+    {
+        if (!parse_allow_exit) {
+            db_error("[DB] EXIT is not allowed here\n");
+        } else {
+            db_exit();
+        }
+    }
   ;
 
 %%
 
 void yyerror(const char *s) {
-    fprintf(stderr, "Syntax error: %s\n", s);
+    db_set_explain(EXPLAIN_NONE);
+    lex_reset_statement();
+    ++parse_error_count;
+    db_syntax_error(s);
+}
+
+// 预编译模式：记录参数占位符的值节点
+static void capture_param(struct Value *v) {
+    struct ParsedStmt *ps = parse_capture;
+    if (ps->param_count == ps->param_cap) {
+        ps->param_cap = ps->param_cap ? ps->param_cap * 2 : 8;
+        ps->params = (struct Value **)realloc(ps->params, sizeof(struct Value *) * ps->param_cap);
+    }
+    ps->params[ps->param_count++] = v;
 }
\ No newline at end of file
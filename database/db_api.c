@@ -1,14 +1,52 @@
 #include "db_api.h"
+#include "db_codec.h"
+#include "db_stats.h"
 #include "sql_struct.h"
+#include <limits.h>
+#include <math.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 // ================== 内存数据库结构 ==================
 struct Row
 {
     struct Value *values;
     struct Row *next;
+    struct Block *block; // 所属的行块
+    unsigned int dead : 1;  // 墓碑标记：DELETE只打标记，由VACUUM从链表中摘除并释放
+    unsigned int slot : 31; // 在所属行块中的序号，块内较新的行序号较大（位图索引按序号记录行）
+    int schema; // 写入该行时表的结构版本，旧版本的行经列映射取值（见 row_value）
+};
+
+// 字符串字典：每个不同的字符串只保存一份，行中的值直接引用字典中的字符串
+// 忽略大小写相等的字符串属于同一等价类，等值比较只需比较等价类编号
+struct Dict
+{
+    char **strs;     // 条目编号 -> 字符串
+    int *fold;       // 条目编号 -> 等价类编号
+    int count;       // 条目数
+    int cap;         // 条目数组容量
+    int fold_count;  // 等价类数
+    int *slots;      // 精确匹配哈希表，存放条目编号+1，0表示空槽
+    int *fold_slots; // 忽略大小写哈希表，存放等价类代表条目编号+1
+    int slot_cap;    // 哈希表槽数（2的幂）
+    long str_bytes;  // 字符串占用的字节数
 };
 
 struct Table
@@ -16,13 +54,44 @@ struct Table
     char *name;
     struct ColumnDef *columns;
     struct Row *rows;
+    struct Block *blocks; // 行块链表（区域映射），与行链表同序
+    int col_count;       // 列数
+    struct Dict **dicts; // 每列一个字符串字典，按需创建
+    struct HashIndex **indexes; // 每列的唯一索引，没有PRIMARY KEY/UNIQUE约束的列为NULL
+    int index_count;     // 唯一索引个数
+    struct TextIndex **text_indexes; // 每列的文本索引（CREATE INDEX），NULL表示表上没有文本索引
+    int text_index_count; // 文本索引个数
+    struct BitmapIndex **bitmaps; // 每列的位图索引（CREATE BITMAP INDEX），NULL表示表上没有位图索引
+    int bitmap_count;     // 位图索引个数
+    int schema_version;  // 结构版本，每次 ALTER TABLE 加1
+    int **layouts;       // 每个旧结构版本一项：当前列下标 -> 该版本的行中值的位置，-1表示该版本没有这一列
+    struct Value **defaults; // 每列的默认值，按需建立（table_default）
+    struct Sketch **sketches; // 每列的去重计数草图，按需建立（table_sketch），NULL表示都未建立
+    long dead_count;     // 已删除但尚未回收的行数
+    long version;        // 数据版本，每次修改时更新（查询缓存据此失效）
+    long row_bytes;      // 行和值节点占用的字节数
+    long last_access;    // 最近一次访问的时刻（换出冷表时使用）
+    char *disk_path;     // 非NULL表示表数据不在内存中（尚未加载或已换出），位于该文件
+    long disk_offset;    // 数据在文件中的起始位置
+    long disk_len;       // 数据的字节数
+    long disk_rows;      // 数据的行数
+    int disk_owned;      // 1表示溢出文件，读回后删除
+    int disk_binary;     // 1表示二进制列格式，0表示旧版文本行格式
+    FILE *disk_fp;       // 检查点开始时为子进程预先打开的数据文件
     struct Table *next;
 };
 
+struct HashIndex;
+struct TextIndex;
+struct BitmapIndex;
+struct Sketch;
+struct Block;
+
 struct Database
 {
     char *name;
     struct Table *tables;
+    long mem_limit; // 内存上限（字节），0表示不限制
     struct Database *next;
 };
 
@@ -36,6 +105,283 @@ struct FieldRef
 
 struct Database *db_list = NULL;
 struct Database *current_db = NULL;
+static int loading = 0; // 正在从文件加载数据，不计入行写入统计
+static long data_version = 0; // 全局递增的数据版本号，分配给被修改的表
+// 打开的游标数：游标在两次取行之间持有行指针，期间不释放任何行和表
+// （VACUUM和换出推迟，DROP被拒绝，撤销插入只打墓碑标记）
+static int cursor_pins = 0;
+static long schema_epoch = 0; // 结构版本：每释放一个表加1
+static const char *stmt_text = NULL; // 当前语句的规范化文本（查询缓存的键）
+
+static long access_clock = 0; // 表访问计数，用于找出最久未访问的表
+
+// 表数据被修改
+#define TABLE_CHANGED(t) ((t)->version = ++data_version)
+// 每行占用的字节数：行结构和每列一个值节点
+#define ROW_BYTES(t) ((long)(sizeof(struct Row) + (t)->col_count * sizeof(struct Value)))
+
+static void table_materialize(struct Table *t);
+static long text_index_bytes(struct TextIndex *tx);
+static long bitmap_index_bytes(struct BitmapIndex *ix);
+static int mem_check_write(struct Table *t);
+static void checkpoint_poll();
+static void checkpoint_tick();
+static void checkpoint_wait();
+static void checkpoint_show();
+static void checkpoint_set_interval(int seconds);
+static void ingest_close_all();
+static void ingest_show();
+
+#define DB_DUMP_FILE "data.db"
+#define SNAPSHOT_MAGIC "MINIDBMS-SNAPSHOT 3"      // 带目录、表数据为二进制列格式的快照
+#define SNAPSHOT_MAGIC_TEXT "MINIDBMS-SNAPSHOT 2" // 带目录、表数据为文本行的快照
+static const char *db_dump_file = DB_DUMP_FILE; // 当前使用的数据文件路径
+static int quiet = QUIET_NONE; // 输出模式：QUIET_INFO 不输出执行成功的提示信息（脚本模式），QUIET_SILENT 不输出任何结果（库接口）
+
+// 输出执行成功的提示信息，静默模式下不输出
+#define DB_INFO(...)             \
+    do                           \
+    {                            \
+        if (!quiet)              \
+            printf(__VA_ARGS__); \
+    } while (0)
+
+// 设置输出模式
+void db_set_quiet(int on)
+{
+    quiet = on;
+}
+
+static char last_error[256]; // 最近一条错误信息（不含"[DB] "前缀和换行）
+static long error_count = 0; // 累计出错次数：库接口比较语句前后的值判断语句是否出错
+
+static void error_record(const char *msg)
+{
+    if (strncmp(msg, "[DB] ", 5) == 0)
+        msg += 5;
+    snprintf(last_error, sizeof(last_error), "%s", msg);
+    size_t n = strlen(last_error);
+    if (n > 0 && last_error[n - 1] == '\n')
+        last_error[n - 1] = '\0';
+    ++error_count;
+}
+
+// 输出错误信息并记录为最近一条错误，QUIET_SILENT 下只记录
+void db_error(const char *fmt, ...)
+{
+    char msg[512];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+    if (quiet < QUIET_SILENT)
+        fputs(msg, stdout);
+    error_record(msg);
+}
+
+// 语法错误：输出到 stderr 并记录
+void db_syntax_error(const char *msg)
+{
+    char buf[300];
+    snprintf(buf, sizeof(buf), "Syntax error: %s", msg);
+    if (quiet < QUIET_SILENT)
+        fprintf(stderr, "%s\n", buf);
+    error_record(buf);
+}
+
+const char *db_last_error()
+{
+    return last_error;
+}
+
+long db_error_count()
+{
+    return error_count;
+}
+
+// ================== 执行统计（EXPLAIN ANALYZE） ==================
+#define MAX_STAGES 12
+
+// 执行阶段统计
+struct ExecStage
+{
+    char name[64];   // 阶段名
+    double time_us;  // 耗时（微秒）
+    long scanned;    // 扫描行数
+    long matched;    // 满足条件的行数
+    long pred_evals; // 谓词求值次数
+    long bytes;      // 分配的字节数
+};
+
+static int explain_mode = EXPLAIN_NONE;
+static struct ExecStage stages[MAX_STAGES];
+static int stage_count = 0;
+static long pred_evals = 0;  // 累计谓词求值次数
+static long alloc_bytes = 0; // 累计为表数据分配的字节数
+static long join_scanned[8]; // 嵌套循环连接中各层扫描的行数
+static long join_combos = 0; // 参与条件判断的行组合数
+static long join_matched = 0;
+static double output_us = 0; // 输出结果的累计耗时（仅ANALYZE时统计）
+
+// ================== 语句超时与取消 ==================
+// 扫描和连接循环每检查一行调用一次 STMT_CHECK()：平时只是一次计数和比较，
+// 每 CHECK_INTERVAL 行（或到达行数上限时）才读时钟和取消标志；返回非0后语句应尽快结束，
+// 由执行函数报告已完成的工作量，修改语句回滚到语句开始时的状态
+#define CHECK_INTERVAL 1024
+static int statement_timeout = 0;                  // SET statement_timeout（毫秒），0表示不限
+static long statement_row_limit = 0;               // SET statement_row_limit：一条语句最多检查的行数，0表示不限
+static int cancel_enabled = 0;                     // db_enable_cancel：每条语句都检查取消标志
+static volatile sig_atomic_t cancel_requested = 0; // db_cancel 置位（可在信号处理函数中调用）
+static int stmt_checking = 0;                      // 当前语句是否检查超时和取消
+static long stmt_rows = 0;                         // 当前语句已检查的行数
+static long stmt_check_at = LONG_MAX;              // 检查到这么多行时做下一次检查
+static double stmt_start_us = 0;
+static const char *stmt_cancel_reason = NULL; // 非NULL表示当前语句已被取消
+#define STMT_CHECK() (++stmt_rows >= stmt_check_at && stmt_check())
+
+// 语句开始：设置了超时、行数上限或允许取消时开始检查
+static void stmt_checks_begin()
+{
+    cancel_requested = 0;
+    stmt_cancel_reason = NULL;
+    stmt_rows = 0;
+    stmt_checking = statement_timeout > 0 || statement_row_limit > 0 || cancel_enabled;
+    stmt_start_us = stmt_checking ? db_now_us() : 0;
+    stmt_check_at = !stmt_checking ? LONG_MAX
+                    : statement_row_limit > 0 && statement_row_limit < CHECK_INTERVAL ? statement_row_limit + 1
+                                                                                       : CHECK_INTERVAL;
+}
+
+// 语句结束：之后游标逐行取结果时不再检查
+static void stmt_checks_end()
+{
+    stmt_checking = 0;
+    stmt_cancel_reason = NULL;
+    stmt_check_at = LONG_MAX;
+}
+
+// 检查取消标志、行数上限和超时，返回1表示语句已被取消
+static int stmt_check()
+{
+    if (stmt_cancel_reason)
+        return 1;
+    if (cancel_requested)
+        stmt_cancel_reason = "cancelled by user";
+    else if (statement_row_limit > 0 && stmt_rows > statement_row_limit)
+        stmt_cancel_reason = "statement_row_limit exceeded";
+    else if (statement_timeout > 0 && db_now_us() - stmt_start_us > statement_timeout * 1e3)
+        stmt_cancel_reason = "statement_timeout exceeded";
+    if (stmt_cancel_reason)
+    {
+        stmt_check_at = 0; // 之后每次调用都直接返回
+        return 1;
+    }
+    stmt_check_at = stmt_rows + CHECK_INTERVAL;
+    if (statement_row_limit > 0 && stmt_check_at > statement_row_limit + 1)
+        stmt_check_at = statement_row_limit + 1;
+    return 0;
+}
+
+// 报告被取消的语句已完成的工作量；rolled_back 表示修改已回滚
+static void stmt_cancel_report(const char *what, long matched, int rolled_back)
+{
+    db_error("[DB] %s cancelled: %s after %.3f ms, %ld rows examined, %ld rows matched%s\n", what, stmt_cancel_reason,
+             (db_now_us() - stmt_start_us) / 1e3, stmt_rows, matched, rolled_back ? ", no rows changed" : "");
+}
+
+// 取消当前语句：只设置标志，语句在下一次检查时中止
+void db_cancel()
+{
+    cancel_requested = 1;
+}
+
+// 允许取消后每条语句都检查取消标志（交互模式下由Ctrl-C取消）
+void db_enable_cancel(int on)
+{
+    cancel_enabled = on != 0;
+}
+
+// 单调时钟，返回微秒
+double db_now_us()
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER cnt;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&cnt);
+    return (double)cnt.QuadPart * 1e6 / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+#endif
+}
+
+// 设置EXPLAIN模式，由语法分析器在EXPLAIN语句前后调用
+void db_set_explain(int mode)
+{
+    explain_mode = mode;
+}
+
+int db_explain_mode()
+{
+    return explain_mode;
+}
+
+// 开始一个新的执行阶段，记录起始时的谓词求值次数和分配字节数
+static struct ExecStage *stage_begin(const char *name)
+{
+    if (stage_count == MAX_STAGES)
+        return &stages[MAX_STAGES - 1];
+    struct ExecStage *st = &stages[stage_count++];
+    snprintf(st->name, sizeof(st->name), "%s", name);
+    st->time_us = db_now_us();
+    st->scanned = st->matched = 0;
+    st->pred_evals = pred_evals;
+    st->bytes = alloc_bytes;
+    return st;
+}
+
+// 结束执行阶段，计算耗时和各项增量
+static void stage_end(struct ExecStage *st, long scanned, long matched)
+{
+    st->time_us = db_now_us() - st->time_us;
+    st->scanned = scanned;
+    st->matched = matched;
+    st->pred_evals = pred_evals - st->pred_evals;
+    st->bytes = alloc_bytes - st->bytes;
+}
+
+// 输出EXPLAIN ANALYZE的各阶段统计
+static void print_stages(const char *stmt)
+{
+    double total = 0;
+    printf("[EXPLAIN ANALYZE] %s\n", stmt);
+    printf("  %-28s %10s %10s %10s %10s %10s\n", "Stage", "Time(ms)", "Scanned", "Matched", "PredEvals", "Bytes");
+    for (int i = 0; i < stage_count; ++i)
+    {
+        printf("  %-28s %10.3f %10ld %10ld %10ld %10ld\n", stages[i].name, stages[i].time_us / 1e3,
+               stages[i].scanned, stages[i].matched, stages[i].pred_evals, stages[i].bytes);
+        total += stages[i].time_us;
+    }
+    printf("  %-28s %10.3f\n", "Total", total / 1e3);
+    stage_count = 0;
+}
+
+// 带统计的内存分配：表数据（行、值、字典）均通过这里分配
+static void *db_alloc(size_t n)
+{
+    alloc_bytes += (long)n;
+    return calloc(1, n);
+}
+
+static char *db_strdup(const char *s)
+{
+    size_t n = strlen(s) + 1;
+    alloc_bytes += (long)n;
+    return (char *)memcpy(malloc(n), s, n);
+}
 
 // 辅助：不区分大小写字符串比较
 // 返回0表示相等，非0表示不等
@@ -61,6 +407,22 @@ int strcasecmp_dbms(const char *a, const char *b)
     return (unsigned char)*a - (unsigned char)*b;
 }
 
+// 辅助：不区分大小写比较两个字符串的前n个字符，返回0表示相等
+int strncasecmp_dbms(const char *a, const char *b, size_t n)
+{
+    for (; n > 0; --n, ++a, ++b)
+    {
+        char ca = *a, cb = *b;
+        if (ca >= 'A' && ca <= 'Z')
+            ca += 'a' - 'A';
+        if (cb >= 'A' && cb <= 'Z')
+            cb += 'a' - 'A';
+        if (ca != cb || !ca)
+            return (unsigned char)ca - (unsigned char)cb;
+    }
+    return 0;
+}
+
 // 查找数据库链表中指定名称的数据库，找不到返回NULL
 struct Database *find_db(const char *name)
 {
@@ -72,6 +434,12 @@ struct Database *find_db(const char *name)
     return NULL;       // 未找到返回NULL
 }
 
+// 当前数据库名，没有选择数据库时返回NULL
+const char *db_current_database()
+{
+    return current_db ? current_db->name : NULL;
+}
+
 // 查找当前数据库中指定名称的表，找不到返回NULL
 struct Table *find_table(const char *name)
 {
@@ -81,8 +449,13 @@ struct Table *find_table(const char *name)
     for (struct Table *t = current_db->tables; t; t = t->next)
         // 比较表名（不区分大小写）
         if (strcasecmp_dbms(t->name, name) == 0)
-            return t; // 找到则返回指针
-    return NULL;      // 未找到返回NULL
+        {
+            t->last_access = ++access_clock;
+            if (t->disk_path)
+                table_materialize(t); // 未加载或已换出的表在首次访问时读入
+            return t;            // 找到则返回指针
+        }
+    return NULL; // 未找到返回NULL
 }
 
 // 获取列名在列链表中的索引，找不到返回-1
@@ -96,809 +469,6413 @@ int col_index(struct ColumnDef *cols, const char *name)
     return -1;
 }
 
-// 判断一行数据是否满足条件表达式（单表where）
-// 返回1表示满足，0表示不满足
-int row_match(struct Row *row, struct ColumnDef *cols, struct Condition *cond)
+// ================== 字符串字典 ==================
+// 字典哈希：FNV-1a，fold非0时按小写字母计算
+static unsigned int dict_hash(const char *s, int fold)
 {
-    // 没有条件，直接返回满足
-    if (!cond)
-        return 1;
-    // 递归处理AND/OR条件
-    if (cond->op == 6)
-        return row_match(row, cols, cond->left) && row_match(row, cols, cond->right);
-    if (cond->op == 7)
-        return row_match(row, cols, cond->left) || row_match(row, cols, cond->right);
-    // 查找条件字段在列链表中的索引
-    int idx = col_index(cols, cond->col);
-    if (idx < 0)
-        return 0;
-    // 找到对应字段的值
-    struct Value *v = row->values;
-    for (int i = 0; i < idx && v; ++i)
-        v = v->next;
-    if (!v)
-        return 0;
-    // 整型比较
-    if (cond->value->is_int && v->is_int)
+    unsigned int h = 2166136261u;
+    for (; *s; ++s)
     {
-        int a = v->int_val, b = cond->value->int_val;
-        switch (cond->op)
-        {
-        case 0:
-            return a == b;
-        case 1:
-            return a != b;
-        case 2:
-            return a > b;
-        case 3:
-            return a < b;
-        case 4:
-            return a >= b;
-        case 5:
-            return a <= b;
-        }
+        unsigned char ch = (unsigned char)*s;
+        if (fold && ch >= 'A' && ch <= 'Z')
+            ch += 'a' - 'A';
+        h = (h ^ ch) * 16777619u;
     }
-    // 字符串比较
-    else if (!cond->value->is_int && !v->is_int)
+    return h;
+}
+
+static struct Dict *dict_create()
+{
+    struct Dict *d = (struct Dict *)db_alloc(sizeof(struct Dict));
+    d->slot_cap = 16;
+    d->slots = (int *)db_alloc(d->slot_cap * sizeof(int));
+    d->fold_slots = (int *)db_alloc(d->slot_cap * sizeof(int));
+    return d;
+}
+
+static void dict_free(struct Dict *d)
+{
+    if (!d)
+        return;
+    for (int i = 0; i < d->count; ++i)
+        free(d->strs[i]);
+    free(d->strs);
+    free(d->fold);
+    free(d->slots);
+    free(d->fold_slots);
+    free(d);
+}
+
+// 查找忽略大小写的等价类代表条目在哈希表中的槽位
+static int dict_fold_slot(struct Dict *d, const char *s)
+{
+    unsigned int mask = d->slot_cap - 1;
+    unsigned int i = dict_hash(s, 1) & mask;
+    while (d->fold_slots[i] && strcasecmp_dbms(d->strs[d->fold_slots[i] - 1], s) != 0)
+        i = (i + 1) & mask;
+    return i;
+}
+
+// 查找精确匹配条目在哈希表中的槽位
+static int dict_exact_slot(struct Dict *d, const char *s)
+{
+    unsigned int mask = d->slot_cap - 1;
+    unsigned int i = dict_hash(s, 0) & mask;
+    while (d->slots[i] && strcmp(d->strs[d->slots[i] - 1], s) != 0)
+        i = (i + 1) & mask;
+    return i;
+}
+
+// 哈希表扩容：条目数超过槽数一半时翻倍并重新插入
+static void dict_grow(struct Dict *d)
+{
+    free(d->slots);
+    free(d->fold_slots);
+    d->slot_cap *= 2;
+    d->slots = (int *)db_alloc(d->slot_cap * sizeof(int));
+    d->fold_slots = (int *)db_alloc(d->slot_cap * sizeof(int));
+    int *seen = (int *)calloc(d->fold_count, sizeof(int));
+    for (int i = 0; i < d->count; ++i)
     {
-        int cmp = strcasecmp_dbms(v->str_val, cond->value->str_val);
-        switch (cond->op)
+        d->slots[dict_exact_slot(d, d->strs[i])] = i + 1;
+        // 每个等价类只登记第一次出现的条目作为代表
+        if (!seen[d->fold[i]])
         {
-        case 0:
-            return cmp == 0;
-        case 1:
-            return cmp != 0;
-        case 2:
-            return cmp > 0;
-        case 3:
-            return cmp < 0;
-        case 4:
-            return cmp >= 0;
-        case 5:
-            return cmp <= 0;
+            seen[d->fold[i]] = 1;
+            d->fold_slots[dict_fold_slot(d, d->strs[i])] = i + 1;
         }
     }
-    return 0;
+    free(seen);
 }
 
-// 多表where条件判断：只支持字段名唯一的简单条件
-// 返回1表示满足，0表示不满足
-int row_match_multi(struct Row **rows, struct Table **tables, int n, struct Condition *cond)
+// 查询字符串所属的等价类编号，字典中不存在返回-2（不会与任何行匹配）
+static int dict_lookup_fold(struct Dict *d, const char *s)
 {
-    // 没有条件，直接返回满足
-    if (!cond)
-        return 1;
-    switch (cond->op)
+    if (!d || !s)
+        return -2;
+    int slot = dict_fold_slot(d, s);
+    return d->fold_slots[slot] ? d->fold[d->fold_slots[slot] - 1] : -2;
+}
+
+// 将字符串加入字典，返回字典持有的字符串，*code 输出等价类编号
+static char *dict_intern(struct Dict *d, const char *s, int *code)
+{
+    int slot = dict_exact_slot(d, s);
+    if (d->slots[slot])
     {
-    case 6: // AND
-        return row_match_multi(rows, tables, n, cond->left) && row_match_multi(rows, tables, n, cond->right);
-    case 7: // OR
-        return row_match_multi(rows, tables, n, cond->left) || row_match_multi(rows, tables, n, cond->right);
-    default:
+        int e = d->slots[slot] - 1;
+        *code = d->fold[e];
+        return d->strs[e];
+    }
+    if ((d->count + 1) * 2 > d->slot_cap)
     {
-        // 遍历所有表，查找条件字段属于哪个表
-        for (int i = 0; i < n; ++i)
-        {
-            int idx = col_index(tables[i]->columns, cond->col);
-            if (idx >= 0)
-            {
-                // 找到字段，取对应行的值
-                struct Value *v = rows[i]->values;
-                for (int j = 0; j < idx && v; ++j)
-                    v = v->next;
-                if (!v)
-                    return 0;
-                // 整型比较
-                if (cond->value->is_int && v->is_int)
-                {
-                    int a = v->int_val, b = cond->value->int_val;
-                    switch (cond->op)
-                    {
-                    case 0:
-                        return a == b;
-                    case 1:
-                        return a != b;
-                    case 2:
-                        return a > b;
-                    case 3:
-                        return a < b;
-                    case 4:
-                        return a >= b;
-                    case 5:
-                        return a <= b;
-                    }
-                }
-                // 字符串比较
-                else if (!cond->value->is_int && !v->is_int)
-                {
-                    int cmp = strcasecmp_dbms(v->str_val, cond->value->str_val);
-                    switch (cond->op)
-                    {
-                    case 0:
-                        return cmp == 0;
-                    case 1:
-                        return cmp != 0;
-                    case 2:
-                        return cmp > 0;
-                    case 3:
-                        return cmp < 0;
-                    case 4:
-                        return cmp >= 0;
-                    case 5:
-                        return cmp <= 0;
-                    }
-                }
-                return 0;
-            }
-        }
-        // 没有找到字段
-        return 0;
+        dict_grow(d);
+        slot = dict_exact_slot(d, s);
+    }
+    if (d->count == d->cap)
+    {
+        alloc_bytes += (long)((d->cap ? d->cap : 8) * (sizeof(char *) + sizeof(int)));
+        d->cap = d->cap ? d->cap * 2 : 8;
+        d->strs = (char **)realloc(d->strs, d->cap * sizeof(char *));
+        d->fold = (int *)realloc(d->fold, d->cap * sizeof(int));
     }
+    int e = d->count++;
+    d->strs[e] = db_strdup(s);
+    d->str_bytes += (long)strlen(s) + 1;
+    d->slots[slot] = e + 1;
+    // 新字符串若与已有字符串忽略大小写相等，则复用其等价类
+    int fslot = dict_fold_slot(d, s);
+    if (d->fold_slots[fslot] && d->fold_slots[fslot] - 1 != e)
+        d->fold[e] = d->fold[d->fold_slots[fslot] - 1];
+    else
+    {
+        d->fold[e] = d->fold_count++;
+        d->fold_slots[fslot] = e + 1;
     }
+    *code = d->fold[e];
+    return d->strs[e];
 }
 
-// 多表select * 输出所有表所有字段
-// 递归枚举所有表的行组合并输出
-void print_rows_multi(int idx, struct Row **rows, int n, struct Table **table_arr, struct Condition *cond)
+// 字典占用的字节数
+static long dict_bytes(struct Dict *d)
 {
-    // 递归出口：所有表的行都已选定
-    if (idx == n)
-    {
-        // 判断当前行组合是否满足where条件
-        if (!row_match_multi(rows, table_arr, n, cond))
-            return;
-        // 依次输出每个表的所有字段
-        for (int i = 0; i < n; ++i)
-        {
-            struct Value *v = rows[i]->values;
-            for (struct ColumnDef *c = table_arr[i]->columns; c; c = c->next)
-            {
-                if (v)
-                {
-                    if (v->is_int)
-                        printf("%12d", v->int_val);
-                    else
-                        printf("%12s", v->str_val ? v->str_val : "NULL");
-                    v = v->next;
-                }
-                else
-                {
-                    printf("%12s", "NULL");
-                }
-            }
-        }
-        printf("\n");
+    if (!d)
+        return 0;
+    return (long)(sizeof(struct Dict) + d->cap * (sizeof(char *) + sizeof(int)) + 2 * d->slot_cap * sizeof(int)) +
+           d->str_bytes;
+}
+
+// 将字符串值存入表的第idx列：字符串由该列字典持有
+static void table_set_str(struct Table *t, int idx, struct Value *v, const char *s)
+{
+    v->is_int = 0;
+    v->code = -1;
+    v->str_val = NULL;
+    if (!s || idx < 0 || idx >= t->col_count)
         return;
-    }
-    // 递归：枚举当前表的每一行
-    for (struct Row *r = table_arr[idx]->rows; r; r = r->next)
+    if (!t->dicts[idx])
+        t->dicts[idx] = dict_create();
+    v->str_val = dict_intern(t->dicts[idx], s, &v->code);
+}
+
+// 按值拷贝一个字段到表的第idx列
+static struct Value *table_copy_value(struct Table *t, int idx, const struct Value *src)
+{
+    struct Value *nv = (struct Value *)db_alloc(sizeof(struct Value));
+    nv->code = -1;
+    if (src->is_int)
     {
-        rows[idx] = r;                                       // 记录当前表选中的行
-        print_rows_multi(idx + 1, rows, n, table_arr, cond); // 递归处理下一个表
+        nv->is_int = 1;
+        nv->int_val = src->int_val;
     }
+    else
+        table_set_str(t, idx, nv, src->str_val);
+    return nv;
 }
 
-// 递归枚举所有表的行组合，只输出指定字段
-static void print_rows_multi_sel(int idx, struct Row **rows, int n, struct Table **table_arr, struct Condition *cond, struct FieldRef *fields, int field_count)
+// ================== 表结构版本（ALTER TABLE） ==================
+// ADD/DROP COLUMN 只修改列定义，不改写已有的行：每行记下写入时的结构版本，
+// 表为每个旧版本保存一个列映射，读取旧版本的行时按映射取值，该版本没有的列取默认值。
+// UPDATE 修改旧版本的行之前、VACUUM 时把行改写为当前结构
+#define ROW_CURRENT(t, r) ((r)->schema == (t)->schema_version)
+static int altered_tables = 0; // 有旧结构版本的表数，为0时所有行都按当前结构存储
+
+// 第idx列的默认值：列定义中的 DEFAULT，没有时INT列为0、CHAR列为NULL
+// 首次使用时建立，字符串存入列字典；表换出或修改结构时释放（table_free_defaults）
+static struct Value *table_default(struct Table *t, int idx)
 {
-    // 递归出口：所有表的行都已选定
-    if (idx == n)
+    if (!t->defaults)
+        t->defaults = (struct Value **)calloc(t->col_count ? t->col_count : 1, sizeof(struct Value *));
+    if (!t->defaults[idx])
     {
-        // 判断当前行组合是否满足where条件
-        if (!row_match_multi(rows, table_arr, n, cond))
-            return;
-        // 只输出指定字段
-        for (int i = 0; i < field_count; ++i)
+        struct ColumnDef *c = t->columns;
+        for (int i = 0; i < idx; ++i)
+            c = c->next;
+        struct Value *nv;
+        if (c->def)
+            nv = table_copy_value(t, idx, c->def);
+        else
         {
-            int t_idx = fields[i].table_idx;
-            int c_idx = fields[i].col_idx;
-            struct Value *v = rows[t_idx]->values;
-            for (int j = 0; j < c_idx && v; ++j)
-                v = v->next;
-            if (v)
-            {
-                if (v->is_int)
-                    printf("%12d", v->int_val);
-                else
-                    printf("%12s", v->str_val ? v->str_val : "NULL");
-            }
-            else
-            {
-                printf("%12s", "NULL");
-            }
+            nv = (struct Value *)db_alloc(sizeof(struct Value));
+            nv->code = -1;
+            nv->is_int = strncmp(c->type, "CHAR", 4) != 0;
         }
-        printf("\n");
-        return;
-    }
-    // 递归：枚举当前表的每一行
-    for (struct Row *r = table_arr[idx]->rows; r; r = r->next)
-    {
-        rows[idx] = r;                                                                // 记录当前表选中的行
-        print_rows_multi_sel(idx + 1, rows, n, table_arr, cond, fields, field_count); // 递归处理下一个表
+        nv->next = NULL;
+        t->defaults[idx] = nv;
     }
+    return t->defaults[idx];
 }
 
-// 显示所有数据库名
-void db_show_databases()
+static void table_free_defaults(struct Table *t)
 {
-    printf("[DB] Databases:\n");
-    for (struct Database *db = db_list; db; db = db->next)
-        printf("%12s\n", db->name);
+    if (!t->defaults)
+        return;
+    for (int i = 0; i < t->col_count; ++i)
+        free(t->defaults[i]);
+    free(t->defaults);
+    t->defaults = NULL;
 }
 
-// 创建数据库
-void db_create_database(const char *name)
+// 一行第idx列的值：当前结构的行按位置取，旧版本的行经列映射取，缺少的列为NULL
+static struct Value *row_value(struct Table *t, struct Row *r, int idx)
 {
-    if (find_db(name))
+    int pos = ROW_CURRENT(t, r) ? idx : t->layouts[r->schema][idx];
+    if (pos < 0)
+        return table_default(t, idx);
+    struct Value *v = r->values;
+    for (int i = 0; i < pos && v; ++i)
+        v = v->next;
+    return v;
+}
+
+// 把旧版本的行改写为当前结构：按当前列重新分配值节点，字符串仍由列字典持有
+static void row_upgrade(struct Table *t, struct Row *r)
+{
+    if (ROW_CURRENT(t, r))
+        return;
+    struct Value *head = NULL, **tail = &head;
+    for (int i = 0; i < t->col_count; ++i)
+    {
+        struct Value *src = row_value(t, r, i);
+        struct Value *nv = (struct Value *)db_alloc(sizeof(struct Value));
+        *nv = *(src ? src : table_default(t, i));
+        nv->next = NULL;
+        *tail = nv;
+        tail = &nv->next;
+    }
+    struct Value *v = r->values;
+    while (v)
+    {
+        struct Value *tmp = v;
+        v = v->next;
+        free(tmp);
+    }
+    r->values = head;
+    r->schema = t->schema_version;
+}
+
+// 表中已没有旧版本的行（全部改写或换出）：释放列映射，结构版本从0重新计数
+static void table_drop_layouts(struct Table *t)
+{
+    for (int v = 0; v < t->schema_version; ++v)
+        free(t->layouts[v]);
+    free(t->layouts);
+    t->layouts = NULL;
+    altered_tables -= t->schema_version > 0;
+    t->schema_version = 0;
+}
+
+// 把所有旧版本的行改写为当前结构（VACUUM），返回改写的行数
+static long table_upgrade_rows(struct Table *t)
+{
+    if (!t->schema_version)
+        return 0;
+    long n = 0;
+    for (struct Row *r = t->rows; r; r = r->next)
+    {
+        n += !ROW_CURRENT(t, r);
+        row_upgrade(t, r);
+        r->schema = 0;
+    }
+    table_drop_layouts(t);
+    return n;
+}
+
+// ================== 唯一索引（PRIMARY KEY / UNIQUE） ==================
+// 每个带约束的列一个开放寻址哈希表（线性探测），键为整数值或字符串的等价类编号，值为行指针。
+// 键与WHERE的等值比较一致：字符串唯一性忽略大小写，整数列中以字符串插入的值与整数互不冲突。
+// 只登记未删除的行；NULL字符串没有键，UNIQUE列允许多个NULL，PRIMARY KEY列拒绝NULL
+struct IndexSlot
+{
+    struct Row *row; // NULL表示空槽
+    int is_int;
+    int key;
+};
+
+struct HashIndex
+{
+    const char *name; // 列名（引用表的列定义）
+    int primary;      // 1表示PRIMARY KEY
+    struct IndexSlot *slots;
+    int cap;          // 槽数（2的幂）
+    int count;        // 已登记的行数
+};
+
+static unsigned int index_hash(int is_int, int key)
+{
+    unsigned int h = (unsigned int)key * 2654435761u;
+    return is_int ? h : h ^ 0x9e3779b9u;
+}
+
+// 取值的索引键，NULL没有键返回0
+static int index_key(const struct Value *v, int *is_int, int *key)
+{
+    if (!v || (!v->is_int && !v->str_val))
+        return 0;
+    *is_int = v->is_int;
+    *key = v->is_int ? v->int_val : v->code;
+    return 1;
+}
+
+static struct HashIndex *index_create(const char *name, int primary)
+{
+    struct HashIndex *ix = (struct HashIndex *)db_alloc(sizeof(struct HashIndex));
+    ix->name = name;
+    ix->primary = primary;
+    ix->cap = 16;
+    ix->slots = (struct IndexSlot *)db_alloc(ix->cap * sizeof(struct IndexSlot));
+    return ix;
+}
+
+static void index_free(struct HashIndex *ix)
+{
+    if (!ix)
+        return;
+    free(ix->slots);
+    free(ix);
+}
+
+// 清空索引（表数据换出时）
+static void index_clear(struct HashIndex *ix)
+{
+    free(ix->slots);
+    ix->cap = 16;
+    ix->slots = (struct IndexSlot *)db_alloc(ix->cap * sizeof(struct IndexSlot));
+    ix->count = 0;
+}
+
+static void index_put(struct HashIndex *ix, struct Row *r, int is_int, int key)
+{
+    int mask = ix->cap - 1;
+    int i = index_hash(is_int, key) & mask;
+    while (ix->slots[i].row)
+        i = (i + 1) & mask;
+    ix->slots[i].row = r;
+    ix->slots[i].is_int = is_int;
+    ix->slots[i].key = key;
+    ++ix->count;
+}
+
+// 负载超过一半时扩容
+static void index_grow(struct HashIndex *ix)
+{
+    struct IndexSlot *old = ix->slots;
+    int old_cap = ix->cap;
+    ix->cap *= 2;
+    ix->slots = (struct IndexSlot *)db_alloc(ix->cap * sizeof(struct IndexSlot));
+    ix->count = 0;
+    for (int i = 0; i < old_cap; ++i)
+        if (old[i].row)
+            index_put(ix, old[i].row, old[i].is_int, old[i].key);
+    free(old);
+}
+
+// 登记一行，v为该行在索引列上的值；不检查重复（由调用者先调用 index_find）
+static void index_add(struct HashIndex *ix, struct Row *r, const struct Value *v)
+{
+    int is_int, key;
+    if (!index_key(v, &is_int, &key))
+        return;
+    if ((ix->count + 1) * 2 > ix->cap)
+        index_grow(ix);
+    index_put(ix, r, is_int, key);
+}
+
+// 查找键对应的行，没有返回NULL
+static struct Row *index_find(struct HashIndex *ix, int is_int, int key)
+{
+    int mask = ix->cap - 1;
+    for (int i = index_hash(is_int, key) & mask; ix->slots[i].row; i = (i + 1) & mask)
+        if (ix->slots[i].key == key && ix->slots[i].is_int == is_int)
+            return ix->slots[i].row;
+    return NULL;
+}
+
+// 移除一行的登记，v为该行在索引列上的当前值；行未登记时不做任何事
+// 删除后把同一探测链上的后续条目前移，不留墓碑
+static void index_remove(struct HashIndex *ix, struct Row *r, const struct Value *v)
+{
+    int is_int, key;
+    if (!index_key(v, &is_int, &key))
+        return;
+    int mask = ix->cap - 1;
+    int i = index_hash(is_int, key) & mask;
+    while (ix->slots[i].row && ix->slots[i].row != r)
+        i = (i + 1) & mask;
+    if (!ix->slots[i].row)
+        return;
+    --ix->count;
+    for (int j = i;;)
     {
-        printf("[DB] Database exists: %s\n", name);
+        ix->slots[i].row = NULL;
+        while (1)
+        {
+            j = (j + 1) & mask;
+            if (!ix->slots[j].row)
+                return;
+            // 条目的理想位置k不在(i, j]之间时，可以移到空出的位置i
+            int k = index_hash(ix->slots[j].is_int, ix->slots[j].key) & mask;
+            if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+                continue;
+            ix->slots[i] = ix->slots[j];
+            i = j;
+            break;
+        }
+    }
+}
+
+// 一行各列的值：vals[i]为第i列，缺少的列为NULL
+static void row_value_array(struct Value *values, struct Value **vals, int n)
+{
+    int i = 0;
+    for (struct Value *v = values; v && i < n; v = v->next)
+        vals[i++] = v;
+    while (i < n)
+        vals[i++] = NULL;
+}
+
+// 把一行登记到表的所有唯一索引
+static void table_index_row(struct Table *t, struct Row *r)
+{
+    if (!t->index_count)
+        return;
+    for (int i = 0; i < t->col_count; ++i)
+        if (t->indexes[i])
+            index_add(t->indexes[i], r, row_value(t, r, i));
+}
+
+// 从表的所有唯一索引中移除一行
+static void table_unindex_row(struct Table *t, struct Row *r)
+{
+    if (!t->index_count)
         return;
+    for (int i = 0; i < t->col_count; ++i)
+        if (t->indexes[i])
+            index_remove(t->indexes[i], r, row_value(t, r, i));
+}
+
+// 检查一行的值（vals按列排列）是否违反唯一约束，self为该行自身（新行为NULL）
+// 违反时返回错误信息，与已有行重复时*conflict为该行
+static const char *table_index_check(struct Table *t, struct Value **vals, struct Row *self, struct Row **conflict)
+{
+    static char msg[160];
+    *conflict = NULL;
+    for (int i = 0; i < t->col_count && t->index_count; ++i)
+    {
+        struct HashIndex *ix = t->indexes[i];
+        int is_int, key;
+        if (!ix)
+            continue;
+        if (!index_key(vals[i], &is_int, &key))
+        {
+            if (!ix->primary)
+                continue;
+            snprintf(msg, sizeof(msg), "NULL value for PRIMARY KEY column %s", ix->name);
+            return msg;
+        }
+        struct Row *r = index_find(ix, is_int, key);
+        if (r && r != self)
+        {
+            *conflict = r;
+            snprintf(msg, sizeof(msg), "duplicate value for %s column %s", ix->primary ? "PRIMARY KEY" : "UNIQUE",
+                     ix->name);
+            return msg;
+        }
     }
-    // 分配新数据库结构体
-    struct Database *db = (struct Database *)malloc(sizeof(struct Database));
-    db->name = strdup(name); // 拷贝数据库名
-    db->tables = NULL;
-    // 头插法插入数据库链表
-    db->next = db_list;
-    db_list = db;
-    printf("[DB] Create database: %s\n", name);
+    return NULL;
 }
 
-// 切换当前数据库
-void db_use_database(const char *name)
+// 表数据读入后重建所有唯一索引
+static void table_rebuild_indexes(struct Table *t)
 {
-    struct Database *db = find_db(name);
-    if (!db)
+    for (struct Row *r = t->rows; r && t->index_count; r = r->next)
+        if (!r->dead)
+            table_index_row(t, r);
+}
+
+// 索引占用的字节数
+static long table_index_bytes(struct Table *t)
+{
+    long n = 0;
+    for (int i = 0; i < t->col_count && t->index_count; ++i)
+        if (t->indexes[i])
+            n += sizeof(struct HashIndex) + t->indexes[i]->cap * sizeof(struct IndexSlot);
+    for (int i = 0; i < t->col_count && t->text_index_count; ++i)
+        if (t->text_indexes[i])
+            n += text_index_bytes(t->text_indexes[i]);
+    for (int i = 0; i < t->col_count && t->bitmap_count; ++i)
+        if (t->bitmaps[i])
+            n += bitmap_index_bytes(t->bitmaps[i]);
+    return n;
+}
+
+// 访问路径：条件（或其AND分支）是唯一索引列上的等值比较时返回该比较，否则返回NULL
+// 条件需先经 bind_condition 绑定
+static struct Condition *index_condition(struct Table *t, struct Condition *cond)
+{
+    if (!cond || !t->index_count)
+        return NULL;
+    if (cond->op == 6)
+    {
+        struct Condition *c = index_condition(t, cond->left);
+        return c ? c : index_condition(t, cond->right);
+    }
+    if (cond->op != EQ || cond->col_idx < 0 || !t->indexes[cond->col_idx])
+        return NULL;
+    return cond;
+}
+
+// 取出唯一可能满足等值比较的行，没有返回NULL
+static struct Row *index_probe(struct Table *t, struct Condition *c)
+{
+    if (!c->value->is_int && c->code < 0)
+        return NULL; // 字符串不在列字典中，没有行与之相等
+    return index_find(t->indexes[c->col_idx], c->value->is_int, c->value->is_int ? c->value->int_val : c->code);
+}
+
+// ================== 文本索引与LIKE ==================
+// LIKE 的模式只在列字典的每个等价类上匹配一次（字符串不重复、忽略大小写相等的串结果相同），
+// 结果是等价类编号上的位图，逐行判断只需按行值的编号查表。
+// CREATE INDEX 在CHAR列上建文本索引，在字典上维护：
+// - 按忽略大小写排序的等价类代表串：有字面前缀的模式（'abc%'）二分查找出前缀范围内的等价类
+// - USING trigram 时的三元组倒排表：三元组 -> 含有它的等价类代表条目，中缀模式（'%abc%'）
+//   取各三元组倒排表的交集作为候选，再逐个验证
+// 并在每个行块中记录该列出现过的等价类（布隆过滤器），扫描时跳过不含任何匹配等价类的块。
+// 字典只增不减，排序数组和倒排表在绑定条件时追加字典新增的条目；布隆过滤器与区域映射一样只扩大
+#define BLOOM_BYTES 2048   // 每个行块每个文本索引的布隆过滤器字节数（块内字符串都不同时每个约8位）
+#define BLOOM_HASHES 3     // 每个等价类置位的个数
+#define LIKE_BLOOM_MAX 16  // 匹配的等价类超过该数时布隆过滤器几乎总是命中，不用于剪枝
+
+struct Gram
+{
+    unsigned int key; // 三元组（三个小写字节）| 0x1000000，0表示空槽
+    int count;
+    int cap;
+    int *ents; // 含有该三元组的等价类代表条目，递增
+};
+
+struct TextIndex
+{
+    char *name;
+    int trigram;      // 1表示 USING trigram
+    int slot;         // 在行块布隆过滤器中的序号
+    int entries;      // 已处理的字典条目数
+    int *sorted;      // 等价类代表条目，按忽略大小写的顺序排列
+    int sorted_count; // 已处理的等价类数
+    int sorted_cap;
+    struct Gram *grams; // 三元组倒排表（开放寻址）
+    int gram_cap;
+    int gram_count;
+};
+
+// LIKE 模式在一列字典上的匹配结果。绑定条件时创建，挂在全局链表上，
+// 下一条语句开始且没有打开的游标时统一释放
+struct LikeSet
+{
+    unsigned char *bits; // 等价类编号 -> 是否匹配
+    int nclasses;        // 创建时字典的等价类数，之后新增的字符串逐个匹配
+    int *classes;        // 匹配的等价类
+    int count;
+    int slot;            // 用于剪枝的布隆过滤器序号，-1表示列上没有文本索引
+    const char *method;  // 候选的来源：dictionary scan / prefix range / trigram
+    long candidates;     // 逐个验证过的字符串数
+    struct LikeSet *next;
+};
+
+static struct LikeSet *like_sets = NULL;
+
+static int fold_char(int c)
+{
+    return c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c;
+}
+
+// LIKE 匹配（忽略大小写）：'%' 匹配任意个字符，'_' 匹配一个字符
+static int like_match(const char *s, const char *p)
+{
+    const char *star = NULL, *resume = NULL;
+    while (*s)
+    {
+        if (*p == '%')
+        {
+            star = ++p;
+            resume = s;
+        }
+        else if (*p && (*p == '_' || fold_char((unsigned char)*p) == fold_char((unsigned char)*s)))
+        {
+            ++p;
+            ++s;
+        }
+        else if (star)
+        {
+            // 回到上一个'%'，让它多匹配一个字符
+            p = star;
+            s = ++resume;
+        }
+        else
+            return 0;
+    }
+    while (*p == '%')
+        ++p;
+    return *p == '\0';
+}
+
+// 按忽略大小写比较s的前n个字符与前缀p，s较短时视为较小
+static int prefix_cmp(const char *s, const char *p, int n)
+{
+    for (int i = 0; i < n; ++i)
+    {
+        int a = fold_char((unsigned char)s[i]), b = fold_char((unsigned char)p[i]);
+        if (a != b)
+            return a - b; // s[i]为'\0'时a为0，小于任何字符
+    }
+    return 0;
+}
+
+// 模式的字面前缀长度（第一个通配符之前的字符数）
+static int like_prefix_len(const char *p)
+{
+    int n = 0;
+    while (p[n] && p[n] != '%' && p[n] != '_')
+        ++n;
+    return n;
+}
+
+static unsigned int gram_key(const char *s)
+{
+    return ((unsigned int)fold_char((unsigned char)s[0]) << 16 | (unsigned int)fold_char((unsigned char)s[1]) << 8 |
+            (unsigned int)fold_char((unsigned char)s[2])) |
+           0x1000000u;
+}
+
+static int gram_slot(struct TextIndex *tx, unsigned int key)
+{
+    unsigned int mask = tx->gram_cap - 1;
+    unsigned int i = (key * 2654435761u) & mask;
+    while (tx->grams[i].key && tx->grams[i].key != key)
+        i = (i + 1) & mask;
+    return i;
+}
+
+// 把代表条目e登记到字符串s中每个三元组的倒排表
+static void gram_add_string(struct TextIndex *tx, const char *s, int e)
+{
+    int len = (int)strlen(s);
+    for (int i = 0; i + 3 <= len; ++i)
+    {
+        if ((tx->gram_count + 1) * 2 > tx->gram_cap)
+        {
+            // 扩容后重新插入
+            struct Gram *old = tx->grams;
+            int old_cap = tx->gram_cap;
+            tx->gram_cap = old_cap ? old_cap * 2 : 256;
+            tx->grams = (struct Gram *)calloc(tx->gram_cap, sizeof(struct Gram));
+            for (int j = 0; j < old_cap; ++j)
+                if (old[j].key)
+                    tx->grams[gram_slot(tx, old[j].key)] = old[j];
+            free(old);
+        }
+        struct Gram *g = &tx->grams[gram_slot(tx, gram_key(s + i))];
+        if (!g->key)
+        {
+            g->key = gram_key(s + i);
+            ++tx->gram_count;
+        }
+        if (g->count > 0 && g->ents[g->count - 1] == e)
+            continue; // 同一字符串中重复的三元组
+        if (g->count == g->cap)
+        {
+            g->cap = g->cap ? g->cap * 2 : 4;
+            g->ents = (int *)realloc(g->ents, g->cap * sizeof(int));
+        }
+        g->ents[g->count++] = e;
+    }
+}
+
+static struct Gram *gram_find(struct TextIndex *tx, const char *s)
+{
+    if (!tx->gram_cap)
+        return NULL;
+    struct Gram *g = &tx->grams[gram_slot(tx, gram_key(s))];
+    return g->key ? g : NULL;
+}
+
+static struct Dict *sort_dict; // text_index_refresh 排序时比较函数使用的字典
+
+static int cmp_dict_entry(const void *a, const void *b)
+{
+    return strcasecmp_dbms(sort_dict->strs[*(const int *)a], sort_dict->strs[*(const int *)b]);
+}
+
+// 追加字典中新增的等价类：新的代表条目排序后与已排序数组归并，trigram 索引同时登记三元组
+static void text_index_refresh(struct TextIndex *tx, struct Dict *d)
+{
+    if (!d || tx->entries >= d->count)
+        return;
+    int *fresh = (int *)malloc(sizeof(int) * (d->count - tx->entries));
+    int n = 0;
+    // 等价类按首次出现的顺序编号，条目的等价类编号等于已见等价类数时是新等价类的代表
+    for (int e = tx->entries; e < d->count; ++e)
     {
-        printf("[DB] Database not found: %s\n", name);
+        if (d->fold[e] != tx->sorted_count + n)
+            continue;
+        fresh[n++] = e;
+        if (tx->trigram)
+            gram_add_string(tx, d->strs[e], e);
+    }
+    tx->entries = d->count;
+    if (n == 0)
+    {
+        free(fresh);
         return;
     }
-    // 切换当前数据库指针
-    current_db = db;
-    printf("[DB] Use database: %s\n", name);
+    sort_dict = d;
+    qsort(fresh, n, sizeof(int), cmp_dict_entry);
+    if (tx->sorted_count + n > tx->sorted_cap)
+    {
+        tx->sorted_cap = (tx->sorted_count + n) * 2;
+        tx->sorted = (int *)realloc(tx->sorted, tx->sorted_cap * sizeof(int));
+    }
+    // 从尾部归并，不需要额外的数组
+    int i = tx->sorted_count - 1, j = n - 1, k = tx->sorted_count + n - 1;
+    while (j >= 0)
+    {
+        if (i >= 0 && strcasecmp_dbms(d->strs[tx->sorted[i]], d->strs[fresh[j]]) > 0)
+            tx->sorted[k--] = tx->sorted[i--];
+        else
+            tx->sorted[k--] = fresh[j--];
+    }
+    tx->sorted_count += n;
+    free(fresh);
 }
 
-// 删除数据库及其所有表
-void db_drop_database(const char *name)
+// 字典被释放（表数据换出）时清空，读回后在下次绑定时重建
+static void text_index_reset(struct TextIndex *tx)
 {
-    struct Database **p = &db_list;
-    while (*p)
+    if (!tx)
+        return;
+    for (int i = 0; i < tx->gram_cap; ++i)
+        free(tx->grams[i].ents);
+    free(tx->grams);
+    tx->grams = NULL;
+    tx->gram_cap = tx->gram_count = 0;
+    tx->entries = tx->sorted_count = 0;
+}
+
+static void text_index_free(struct TextIndex *tx)
+{
+    if (!tx)
+        return;
+    text_index_reset(tx);
+    free(tx->sorted);
+    free(tx->name);
+    free(tx);
+}
+
+static long text_index_bytes(struct TextIndex *tx)
+{
+    long n = sizeof(struct TextIndex) + tx->sorted_cap * sizeof(int) + tx->gram_cap * sizeof(struct Gram);
+    for (int i = 0; i < tx->gram_cap; ++i)
+        n += tx->grams[i].cap * sizeof(int);
+    return n;
+}
+
+// 布隆过滤器：等价类编号的两个哈希值组合出 BLOOM_HASHES 个位
+static unsigned int bloom_bit(int code, int i)
+{
+    unsigned int h1 = (unsigned int)code * 2654435761u, h2 = ((unsigned int)code ^ 0x9e3779b9u) * 0x85ebca6bu;
+    return ((h1 + i * (h2 | 1)) >> 13) & (BLOOM_BYTES * 8 - 1);
+}
+
+static void bloom_add(unsigned char *bloom, int code)
+{
+    for (int i = 0; i < BLOOM_HASHES; ++i)
     {
-        if (strcasecmp_dbms((*p)->name, name) == 0)
+        unsigned int bit = bloom_bit(code, i);
+        bloom[bit >> 3] |= 1 << (bit & 7);
+    }
+}
+
+static int bloom_test(const unsigned char *bloom, int code)
+{
+    for (int i = 0; i < BLOOM_HASHES; ++i)
+    {
+        unsigned int bit = bloom_bit(code, i);
+        if (!(bloom[bit >> 3] >> (bit & 7) & 1))
+            return 0;
+    }
+    return 1;
+}
+
+// 验证一个候选等价类（代表条目e）
+static void like_check(struct LikeSet *ls, struct Dict *d, int e, const char *pattern)
+{
+    int c = d->fold[e];
+    ++ls->candidates;
+    if (ls->bits[c] || !like_match(d->strs[e], pattern))
+        return;
+    ls->bits[c] = 1;
+    ls->classes[ls->count++] = c;
+}
+
+// 计算模式在表第col列字典上的匹配结果：列上有文本索引时由前缀范围或三元组交集给出候选，
+// 否则验证字典中的每个等价类
+static struct LikeSet *like_bind(struct Table *t, int col, const char *pattern)
+{
+    struct Dict *d = t->dicts[col];
+    struct TextIndex *tx = t->text_indexes ? t->text_indexes[col] : NULL;
+    struct LikeSet *ls = (struct LikeSet *)calloc(1, sizeof(struct LikeSet));
+    ls->nclasses = d ? d->fold_count : 0;
+    ls->bits = (unsigned char *)calloc(ls->nclasses ? ls->nclasses : 1, 1);
+    ls->classes = (int *)malloc(sizeof(int) * (ls->nclasses ? ls->nclasses : 1));
+    ls->slot = tx ? tx->slot : -1;
+    ls->method = "dictionary scan";
+    ls->next = like_sets;
+    like_sets = ls;
+    if (!d)
+        return ls;
+    int plen = like_prefix_len(pattern);
+    if (tx)
+    {
+        text_index_refresh(tx, d);
+        if (plen > 0)
         {
-            struct Database *del = *p;
-            *p = del->next; // 从链表中移除
-            // 释放所有表及其数据
-            struct Table *t = del->tables;
-            while (t)
+            // 前缀范围：二分查找第一个不小于前缀的代表串，向后取到前缀不再相同为止
+            int lo = 0, hi = tx->sorted_count;
+            while (lo < hi)
             {
-                struct Table *tmp = t;
-                t = t->next;
-                free(tmp->name);
-                free_column_defs(tmp->columns);
-                struct Row *r = tmp->rows;
-                while (r)
+                int mid = (lo + hi) / 2;
+                if (prefix_cmp(d->strs[tx->sorted[mid]], pattern, plen) < 0)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            for (int i = lo; i < tx->sorted_count && prefix_cmp(d->strs[tx->sorted[i]], pattern, plen) == 0; ++i)
+                like_check(ls, d, tx->sorted[i], pattern);
+            ls->method = "prefix range";
+            return ls;
+        }
+        if (tx->trigram)
+        {
+            // 各字面片段的所有三元组，取倒排表最短的一个作为候选，其余的用二分查找做交集
+            struct Gram *grams[64];
+            int ng = 0, missing = 0;
+            for (const char *p = pattern; *p && ng < 64 && !missing;)
+            {
+                int run = like_prefix_len(p);
+                for (int i = 0; i + 3 <= run && ng < 64; ++i)
                 {
-                    struct Row *tr = r;
-                    r = r->next;
-                    free_value_list(tr->values);
-                    free(tr);
+                    struct Gram *g = gram_find(tx, p + i);
+                    if (!g)
+                    {
+                        missing = 1; // 某个三元组在字典中从未出现，没有字符串匹配
+                        break;
+                    }
+                    grams[ng++] = g;
                 }
-                free(tmp);
+                p += run;
+                while (*p == '%' || *p == '_')
+                    ++p;
+            }
+            if (missing || ng > 0)
+            {
+                ls->method = "trigram";
+                if (missing)
+                    return ls;
+                int best = 0;
+                for (int i = 1; i < ng; ++i)
+                    if (grams[i]->count < grams[best]->count)
+                        best = i;
+                for (int k = 0; k < grams[best]->count; ++k)
+                {
+                    int e = grams[best]->ents[k], all = 1;
+                    for (int i = 0; i < ng && all; ++i)
+                    {
+                        if (i == best)
+                            continue;
+                        int lo = 0, hi = grams[i]->count;
+                        while (lo < hi)
+                        {
+                            int mid = (lo + hi) / 2;
+                            if (grams[i]->ents[mid] < e)
+                                lo = mid + 1;
+                            else
+                                hi = mid;
+                        }
+                        all = lo < grams[i]->count && grams[i]->ents[lo] == e;
+                    }
+                    if (all)
+                        like_check(ls, d, e, pattern);
+                }
+                return ls;
             }
-            free(del->name);
-            free(del);
-            if (current_db == del)
-                current_db = NULL;
-            printf("[DB] Drop database: %s\n", name);
-            return;
         }
-        p = &(*p)->next;
     }
-    printf("[DB] Database not found: %s\n", name);
+    // 没有可用的索引：验证每个等价类的第一个条目
+    for (int e = 0, seen = 0; e < d->count && seen < ls->nclasses; ++e)
+        if (d->fold[e] == seen)
+        {
+            ++seen;
+            like_check(ls, d, e, pattern);
+        }
+    return ls;
+}
+
+// 单行的LIKE判断：字符串按编号查匹配结果，绑定后新增的字符串和整数值逐个匹配
+static int like_value_match(struct Value *v, struct Condition *cond)
+{
+    char buf[16];
+    const char *pattern = cond->value->str_val;
+    if (cond->value->is_int)
+    {
+        snprintf(buf, sizeof(buf), "%d", cond->value->int_val);
+        pattern = buf;
+    }
+    if (v->is_int)
+    {
+        char num[16];
+        snprintf(num, sizeof(num), "%d", v->int_val);
+        return like_match(num, pattern);
+    }
+    if (!v->str_val)
+        return 0;
+    struct LikeSet *ls = cond->like;
+    if (ls && v->code >= 0 && v->code < ls->nclasses)
+        return ls->bits[v->code];
+    return like_match(v->str_val, pattern);
+}
+
+// ================== IN 的哈希集合 ==================
+// col IN (值列表) 和 IN/EXISTS 子查询在绑定条件时建成哈希集合，逐行判断只做一次探测。
+// 整数值以本身为键，字符串以该列字典中的等价类编号为键（与等值比较一致，忽略大小写）
+#define SET_EMPTY LLONG_MIN
+#define SET_STR(code) (((long long)1 << 40) | (long long)(code))
+
+struct ValueSet
+{
+    long long *keys; // 开放寻址，SET_EMPTY表示空槽
+    int cap;         // 槽数（2的幂）
+    int count;
+    int str_count;   // 字符串键个数
+    int min, max;    // 整数键的范围，min > max 表示没有整数键
+    int truth;       // 不相关的 EXISTS：子查询是否有行（0/1），-1表示按键探测
+    long build_rows; // 建集合时子查询扫描的行数
+    double build_us; // 建集合的耗时（微秒）
+    struct ValueSet *next;
+};
+
+static struct ValueSet *value_sets = NULL; // 与 like_sets 一样在下一条语句开始时释放
+
+static struct ValueSet *set_create()
+{
+    struct ValueSet *s = (struct ValueSet *)calloc(1, sizeof(struct ValueSet));
+    s->cap = 16;
+    s->keys = (long long *)malloc(sizeof(long long) * s->cap);
+    for (int i = 0; i < s->cap; ++i)
+        s->keys[i] = SET_EMPTY;
+    s->min = INT_MAX;
+    s->max = INT_MIN;
+    s->truth = -1;
+    s->next = value_sets;
+    value_sets = s;
+    return s;
+}
+
+static unsigned int set_slot(struct ValueSet *s, long long key)
+{
+    unsigned int i = (unsigned int)(((unsigned long long)key * 0x9e3779b97f4a7c15ull) >> 32) & (s->cap - 1);
+    while (s->keys[i] != SET_EMPTY && s->keys[i] != key)
+        i = (i + 1) & (s->cap - 1);
+    return i;
+}
+
+static int set_contains(struct ValueSet *s, long long key)
+{
+    return s->keys[set_slot(s, key)] == key;
+}
+
+// 插入一个键，返回1表示新键
+static int set_add(struct ValueSet *s, long long key)
+{
+    if ((s->count + 1) * 2 > s->cap)
+    {
+        long long *old = s->keys;
+        int old_cap = s->cap;
+        s->cap *= 2;
+        s->keys = (long long *)malloc(sizeof(long long) * s->cap);
+        for (int i = 0; i < s->cap; ++i)
+            s->keys[i] = SET_EMPTY;
+        for (int i = 0; i < old_cap; ++i)
+            if (old[i] != SET_EMPTY)
+                s->keys[set_slot(s, old[i])] = old[i];
+        free(old);
+    }
+    unsigned int i = set_slot(s, key);
+    if (s->keys[i] == key)
+        return 0;
+    s->keys[i] = key;
+    ++s->count;
+    return 1;
+}
+
+static void set_add_int(struct ValueSet *s, int v)
+{
+    if (!set_add(s, v))
+        return;
+    if (v < s->min)
+        s->min = v;
+    if (v > s->max)
+        s->max = v;
+}
+
+static void set_add_code(struct ValueSet *s, int code)
+{
+    s->str_count += set_add(s, SET_STR(code));
+}
+
+// 探测一行的值
+static int set_match(struct ValueSet *s, struct Value *v)
+{
+    if (s->truth >= 0)
+        return s->truth;
+    if (v->is_int)
+        return s->min <= s->max && set_contains(s, v->int_val);
+    return v->str_val && s->str_count && set_contains(s, SET_STR(v->code));
+}
+
+static void bitmap_matches_release();
+
+// 释放之前语句绑定的匹配结果和哈希集合；有打开的游标时游标的条件还在使用，推迟到游标关闭后
+static void bound_sets_release()
+{
+    if (cursor_pins)
+        return;
+    bitmap_matches_release();
+    while (like_sets)
+    {
+        struct LikeSet *ls = like_sets;
+        like_sets = ls->next;
+        free(ls->bits);
+        free(ls->classes);
+        free(ls);
+    }
+    while (value_sets)
+    {
+        struct ValueSet *vs = value_sets;
+        value_sets = vs->next;
+        free(vs->keys);
+        free(vs);
+    }
+}
+
+// ================== 近似去重计数（HyperLogLog） ==================
+// APPROX_COUNT_DISTINCT(col) 用 HyperLogLog 估计不同值的个数：值的64位哈希按高 HLL_BITS 位分到寄存器，
+// 寄存器记录其余位中第一个1的最大位置。每个草图固定 HLL_REGS 字节，标准误差约0.8%。
+// 字符串按列字典的等价类编号计数（与等值比较一致，忽略大小写），NULL不计数
+#define HLL_BITS 14
+#define HLL_REGS (1 << HLL_BITS)
+
+struct Sketch
+{
+    unsigned char reg[HLL_REGS];
+};
+
+static unsigned long long hll_hash(unsigned long long x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static void hll_add(struct Sketch *sk, const struct Value *v)
+{
+    if (!v || (!v->is_int && !v->str_val))
+        return;
+    unsigned long long h = hll_hash(v->is_int ? (unsigned int)v->int_val : (1ULL << 40) | (unsigned int)v->code);
+    int idx = (int)(h >> (64 - HLL_BITS));
+    unsigned long long w = h << HLL_BITS;
+    int rank = w ? __builtin_clzll(w) + 1 : 64 - HLL_BITS + 1;
+    if (rank > sk->reg[idx])
+        sk->reg[idx] = (unsigned char)rank;
+}
+
+// 估计不同值的个数，基数较小（有空寄存器）时改用线性计数
+static double hll_estimate(const struct Sketch *sk)
+{
+    double sum = 0, m = HLL_REGS;
+    int zeros = 0;
+    for (int i = 0; i < HLL_REGS; ++i)
+    {
+        sum += 1.0 / (double)(1ULL << sk->reg[i]);
+        zeros += sk->reg[i] == 0;
+    }
+    double e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (e <= 2.5 * m && zeros)
+        e = m * log(m / zeros);
+    return e;
+}
+
+// 丢弃表的所有草图：表换出、修改结构、VACUUM回收了行之后，下次查询时重建
+static void table_free_sketches(struct Table *t)
+{
+    if (!t->sketches)
+        return;
+    for (int i = 0; i < t->col_count; ++i)
+        free(t->sketches[i]);
+    free(t->sketches);
+    t->sketches = NULL;
+}
+
+// ================== 行块与区域映射 ==================
+// 行链表按顺序每 BLOCK_ROWS 行划为一块（块内的行在链表中连续，块链表与行链表同序，表头为最新的块），
+// 每块记录各列整数值的最小/最大值。扫描时先用条件与区域映射比较，跳过不可能有行满足条件的块；
+// 按递增键追加的时间序列表上，最近时间段的查询只会读到表头的几块。
+// 区域映射只扩大不缩小（删除、更新后可能偏宽），读入表数据时重建
+#define BLOCK_ROWS 2048
+
+struct Zone
+{
+    int min; // min > max 表示块内该列没有整数值
+    int max;
+};
+
+struct Block
+{
+    struct Row *first;  // 块内第一行
+    int count;          // 块内行数
+    int live;           // 未删除的行数，为0时整块跳过
+    int used;           // 已分配的行序号数：摘除的行留下空序号，只有最大的序号被摘除时收回
+    struct Row **slots; // 行序号 -> 行（空序号为NULL），表上有位图索引时才分配
+    struct BlockBitmap *bitmaps; // 每个位图索引一项：块内各键的行集合
+    struct Zone *zones; // 每列一项
+    unsigned char *bloom; // 每个文本索引 BLOOM_BYTES 字节：块内该列出现过的字符串等价类，没有文本索引时为NULL
+    struct Table *table;  // 所属的表（按行取值时查结构版本）
+    struct Block *next;
+};
+
+// 位图索引在行块上的维护（见"位图索引"）
+static void block_bitmaps_alloc(struct Table *t, struct Block *b);
+static void block_bitmaps_free(struct Block *b, int count);
+static long block_bitmaps_bytes(struct Block *b, int count);
+static void bitmap_set_row(struct BitmapIndex *ix, struct Row *r, struct Value *v);
+static void bitmap_unlink_row(struct Table *t, struct Row *r);
+
+static struct Block *block_create(struct Table *t)
+{
+    struct Block *b = (struct Block *)db_alloc(sizeof(struct Block));
+    b->table = t;
+    b->zones = (struct Zone *)malloc(sizeof(struct Zone) * (t->col_count ? t->col_count : 1));
+    for (int i = 0; i < t->col_count; ++i)
+    {
+        b->zones[i].min = INT_MAX;
+        b->zones[i].max = INT_MIN;
+    }
+    if (t->text_index_count)
+        b->bloom = (unsigned char *)calloc(t->text_index_count, BLOOM_BYTES);
+    if (t->bitmap_count)
+        block_bitmaps_alloc(t, b);
+    return b;
+}
+
+static void block_free(struct Block *b)
+{
+    block_bitmaps_free(b, b->table->bitmap_count);
+    free(b->zones);
+    free(b->bloom);
+    free(b);
+}
+
+static void block_free_list(struct Block *b)
+{
+    while (b)
+    {
+        struct Block *tmp = b;
+        b = b->next;
+        block_free(tmp);
+    }
+}
+
+// 区域映射占用的字节数
+static long table_block_bytes(struct Table *t)
+{
+    long n = 0;
+    for (struct Block *b = t->blocks; b; b = b->next)
+        n += sizeof(struct Block) + t->col_count * sizeof(struct Zone) + t->text_index_count * BLOOM_BYTES +
+             block_bitmaps_bytes(b, t->bitmap_count);
+    return n;
+}
+
+// 把一行的整数值并入所在块的区域映射、文本索引列的字符串并入布隆过滤器，
+// 各列的值并入已建立的去重计数草图，位图索引列按当前值登记（插入和更新后调用）
+static void block_widen(struct Table *t, struct Row *r)
+{
+    struct Zone *z = r->block->zones;
+    int cur = ROW_CURRENT(t, r);
+    struct Value *v = r->values;
+    for (int i = 0; i < t->col_count; ++i, ++z, v = cur && v ? v->next : NULL)
+    {
+        if (!cur)
+            v = row_value(t, r, i);
+        if (t->bitmap_count && t->bitmaps[i])
+            bitmap_set_row(t->bitmaps[i], r, v);
+        if (!v)
+            continue;
+        if (t->sketches && t->sketches[i])
+            hll_add(t->sketches[i], v);
+        if (!v->is_int)
+        {
+            if (v->str_val && t->text_index_count && t->text_indexes[i])
+                bloom_add(r->block->bloom + t->text_indexes[i]->slot * BLOOM_BYTES, v->code);
+            continue;
+        }
+        if (v->int_val < z->min)
+            z->min = v->int_val;
+        if (v->int_val > z->max)
+            z->max = v->int_val;
+    }
+}
+
+// 新行头插到行链表后调用：并入表头的块，表头的块已满时新建一块
+static void block_push_row(struct Table *t, struct Row *r)
+{
+    struct Block *b = t->blocks;
+    if (!b || b->used >= BLOCK_ROWS)
+    {
+        b = block_create(t);
+        b->next = t->blocks;
+        t->blocks = b;
+    }
+    b->first = r;
+    ++b->count;
+    ++b->live;
+    r->block = b;
+    r->slot = b->used++;
+    if (b->slots)
+        b->slots[r->slot] = r;
+    block_widen(t, r);
+}
+
+// 行从链表中摘除前调用：更新所在块的首行和行数，空块由 table_drop_empty_blocks 删除
+static void block_unlink_row(struct Row *r)
+{
+    struct Block *b = r->block;
+    if (b->first == r)
+        b->first = r->next;
+    --b->count;
+    if (!r->dead)
+        --b->live;
+    if (b->slots)
+        bitmap_unlink_row(b->table, r);
+    if (r->slot == b->used - 1)
+        --b->used;
+}
+
+static void table_drop_empty_blocks(struct Table *t)
+{
+    struct Block **p = &t->blocks;
+    while (*p)
+    {
+        struct Block *b = *p;
+        if (b->count > 0)
+        {
+            p = &b->next;
+            continue;
+        }
+        *p = b->next;
+        block_free(b);
+    }
+}
+
+// 按行链表重新划分所有块并重建区域映射和位图索引（读入表数据后）
+static void table_rebuild_blocks(struct Table *t)
+{
+    block_free_list(t->blocks);
+    t->blocks = NULL;
+    struct Block **tail = &t->blocks, *b = NULL;
+    for (struct Row *r = t->rows; r; r = r->next)
+    {
+        if (!b || b->count >= BLOCK_ROWS)
+        {
+            b = block_create(t);
+            b->first = r;
+            *tail = b;
+            tail = &b->next;
+        }
+        ++b->count;
+        b->live += !r->dead;
+        r->block = b;
+    }
+    // 链表中靠前的行较新，块内序号从后往前分配
+    for (b = t->blocks; b; b = b->next)
+    {
+        int slot = b->used = b->count;
+        for (struct Row *r = b->first; slot > 0; r = r->next)
+        {
+            r->slot = --slot;
+            if (b->slots)
+                b->slots[r->slot] = r;
+            block_widen(t, r);
+        }
+    }
+}
+
+// 根据区域映射判断块中是否可能有行满足条件（条件需先经 bind_condition 绑定）
+// 用整数比较和文本索引列上的LIKE剪枝；其他字符串比较无法判断，视为可能满足
+static int block_may_match(struct Block *b, struct Condition *cond)
+{
+    if (!cond)
+        return 1;
+    if (cond->op == 6)
+        return block_may_match(b, cond->left) && block_may_match(b, cond->right);
+    if (cond->op == 7)
+        return block_may_match(b, cond->left) || block_may_match(b, cond->right);
+    if (cond->op == NOT_OP)
+        return 1; // 区域映射只能判断子条件可能成立，不能判断它一定成立
+    if (cond->col_idx < 0)
+        return 0;
+    if (cond->op == LIKE_OP)
+    {
+        // 块内有整数值时逐行匹配
+        struct LikeSet *ls = cond->like;
+        if (!ls || ls->slot < 0 || b->zones[cond->col_idx].min <= b->zones[cond->col_idx].max ||
+            ls->count > LIKE_BLOOM_MAX)
+            return 1;
+        for (int i = 0; i < ls->count; ++i)
+            if (bloom_test(b->bloom + ls->slot * BLOOM_BYTES, ls->classes[i]))
+                return 1;
+        return 0;
+    }
+    if (cond->op == IN_OP || cond->op == EXISTS_OP)
+    {
+        // 集合中有字符串时无法判断；否则整数键的范围与块内的范围不相交时跳过
+        struct ValueSet *vs = cond->set;
+        if (!vs)
+            return 0;
+        if (vs->truth >= 0)
+            return vs->truth;
+        struct Zone *z = &b->zones[cond->col_idx];
+        return vs->str_count || (z->min <= z->max && vs->min <= z->max && z->min <= vs->max);
+    }
+    if (cond->op == REF_EQ)
+        return 1;
+    if (!cond->value->is_int)
+        return 1;
+    struct Zone *z = &b->zones[cond->col_idx];
+    int v = cond->value->int_val;
+    if (z->min > z->max)
+        return 0; // 块内该列没有整数值，整数比较不可能成立
+    switch (cond->op)
+    {
+    case EQ:
+        return z->min <= v && v <= z->max;
+    case NEQ_OP:
+        return z->min != v || z->max != v;
+    case GT:
+        return z->max > v;
+    case LT:
+        return z->min < v;
+    case GE:
+        return z->max >= v;
+    case LE:
+        return z->min <= v;
+    }
+    return 1;
+}
+
+// ================== 位图索引 ==================
+// CREATE BITMAP INDEX 在取值不多的列上为每个不同的值（键）记录取该值的行，按行块分成容器，
+// 块内用行序号（Row.slot）表示行：容器中的行不超过 BM_ARRAY_MAX 时是递增的序号数组，
+// 否则是 BLOCK_ROWS 位的位图（与Roaring位图的两种容器相同，取较小的一种）。
+// 键与等值比较一致：整数值以本身为键，字符串以列字典中的等价类编号为键，NULL和缺少的值各为一个键。
+// 条件中的比较对索引的每个键求值一次，得到满足比较的键；扫描一个块时比较取这些键的容器之并，
+// AND/OR/NOT 按位运算。条件全部由位图索引列上的比较组成时结果就是满足条件的行，不再逐行判断；
+// 否则AND中能用位图求值的部分先缩小候选行，再逐行判断整个条件
+#define BM_WORDS (BLOCK_ROWS / 64)     // 位图容器的字数
+#define BM_ARRAY_MAX (BLOCK_ROWS / 16) // 数组容器的行数上限（此时两种容器一样大）
+#define BM_MAX_KEYS 1024               // 建索引时列上不同值个数的上限
+#define BM_NULL ((long long)2 << 40)   // NULL的键
+#define BM_ABSENT ((long long)3 << 40) // 缺少的值的键（不满足任何比较）
+
+// 一个块内取同一个键的行
+struct Container
+{
+    int card;                 // 行数
+    int cap;                  // 数组容器的容量
+    unsigned short *arr;      // 数组容器：递增的行序号
+    unsigned long long *bits; // 位图容器，非NULL时不使用arr
+};
+
+// 一个块在一个位图索引上的容器
+struct BlockBitmap
+{
+    struct Container *keys; // 键编号 -> 容器
+    int nkeys;
+    int *ids;   // 行序号 -> 该行的键编号，-1表示没有登记
+    long bytes; // 容器占用的字节数
+};
+
+struct BitmapIndex
+{
+    char *name;
+    int slot;           // 在行块位图数组中的序号
+    long long *keys;    // 键编号 -> 键
+    struct Value *vals; // 键编号 -> 键的值（字符串引用列字典），对每个键求值比较时使用
+    int key_count;
+    int key_cap;
+    int *map;           // 开放寻址：键 -> 键编号+1，0表示空槽
+    int map_cap;
+};
+
+// 一个比较在位图索引上的结果。绑定条件时创建，与 like_sets 一样在下一条语句开始时释放
+struct BitmapMatch
+{
+    struct BitmapIndex *ix;
+    struct Condition *cond;
+    int *ids;  // 满足比较的键编号
+    int count;
+    int nkeys; // 已求值的键数，之后新增的键在扫描时补上
+    struct BitmapMatch *next;
+};
+
+static struct BitmapMatch *bitmap_matches = NULL;
+
+static long container_bytes(const struct Container *c)
+{
+    return c->bits ? BM_WORDS * sizeof(unsigned long long) : c->cap * sizeof(unsigned short);
+}
+
+// 登记一行（调用者保证序号不在容器中）
+static void container_add(struct Container *c, int slot)
+{
+    ++c->card;
+    if (c->bits)
+    {
+        c->bits[slot >> 6] |= 1ULL << (slot & 63);
+        return;
+    }
+    if (c->card > BM_ARRAY_MAX)
+    {
+        // 数组已满，转为位图容器
+        c->bits = (unsigned long long *)calloc(BM_WORDS, sizeof(unsigned long long));
+        for (int i = 0; i < c->card - 1; ++i)
+            c->bits[c->arr[i] >> 6] |= 1ULL << (c->arr[i] & 63);
+        c->bits[slot >> 6] |= 1ULL << (slot & 63);
+        free(c->arr);
+        c->arr = NULL;
+        c->cap = 0;
+        return;
+    }
+    if (c->card > c->cap)
+    {
+        c->cap = c->cap ? c->cap * 2 : 4;
+        if (c->cap > BM_ARRAY_MAX)
+            c->cap = BM_ARRAY_MAX;
+        c->arr = (unsigned short *)realloc(c->arr, c->cap * sizeof(unsigned short));
+    }
+    // 新行的序号通常最大，从尾部向前插入
+    int i = c->card - 1;
+    for (; i > 0 && c->arr[i - 1] > slot; --i)
+        c->arr[i] = c->arr[i - 1];
+    c->arr[i] = (unsigned short)slot;
+}
+
+// 移除一行（调用者保证序号在容器中），位图容器的行数降到上限的一半时转回数组
+static void container_remove(struct Container *c, int slot)
+{
+    --c->card;
+    if (!c->bits)
+    {
+        int lo = 0, hi = c->card;
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (c->arr[mid] < slot)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        memmove(c->arr + lo, c->arr + lo + 1, (c->card - lo) * sizeof(unsigned short));
+        return;
+    }
+    c->bits[slot >> 6] &= ~(1ULL << (slot & 63));
+    if (c->card > BM_ARRAY_MAX / 2)
+        return;
+    c->cap = BM_ARRAY_MAX / 2;
+    c->arr = (unsigned short *)malloc(c->cap * sizeof(unsigned short));
+    int n = 0;
+    for (int w = 0; w < BM_WORDS; ++w)
+        for (unsigned long long x = c->bits[w]; x; x &= x - 1)
+            c->arr[n++] = (unsigned short)(w * 64 + __builtin_ctzll(x));
+    free(c->bits);
+    c->bits = NULL;
+}
+
+static void container_or(const struct Container *c, unsigned long long *out)
+{
+    if (c->bits)
+        for (int w = 0; w < BM_WORDS; ++w)
+            out[w] |= c->bits[w];
+    else
+        for (int i = 0; i < c->card; ++i)
+            out[c->arr[i] >> 6] |= 1ULL << (c->arr[i] & 63);
+}
+
+static long long bitmap_key(const struct Value *v)
+{
+    if (!v)
+        return BM_ABSENT;
+    if (v->is_int)
+        return v->int_val;
+    return v->str_val ? SET_STR(v->code) : BM_NULL;
+}
+
+static unsigned int bitmap_map_slot(struct BitmapIndex *ix, long long key)
+{
+    unsigned int mask = ix->map_cap - 1;
+    unsigned int i = (unsigned int)(((unsigned long long)key * 0x9e3779b97f4a7c15ull) >> 32) & mask;
+    while (ix->map[i] && ix->keys[ix->map[i] - 1] != key)
+        i = (i + 1) & mask;
+    return i;
+}
+
+// 取值的键编号，新的键追加到键表
+static int bitmap_key_id(struct BitmapIndex *ix, const struct Value *v)
+{
+    long long key = bitmap_key(v);
+    if ((ix->key_count + 1) * 2 > ix->map_cap)
+    {
+        free(ix->map);
+        ix->map_cap = ix->map_cap ? ix->map_cap * 2 : 16;
+        ix->map = (int *)calloc(ix->map_cap, sizeof(int));
+        for (int k = 0; k < ix->key_count; ++k)
+            ix->map[bitmap_map_slot(ix, ix->keys[k])] = k + 1;
+    }
+    unsigned int i = bitmap_map_slot(ix, key);
+    if (ix->map[i])
+        return ix->map[i] - 1;
+    if (ix->key_count == ix->key_cap)
+    {
+        ix->key_cap = ix->key_cap ? ix->key_cap * 2 : 16;
+        ix->keys = (long long *)realloc(ix->keys, ix->key_cap * sizeof(long long));
+        ix->vals = (struct Value *)realloc(ix->vals, ix->key_cap * sizeof(struct Value));
+    }
+    int k = ix->key_count++;
+    ix->keys[k] = key;
+    memset(&ix->vals[k], 0, sizeof(struct Value));
+    if (v && key != BM_NULL)
+        ix->vals[k] = *v;
+    ix->vals[k].next = NULL;
+    ix->map[i] = k + 1;
+    return k;
+}
+
+static struct BitmapIndex *bitmap_index_create(const char *name)
+{
+    struct BitmapIndex *ix = (struct BitmapIndex *)calloc(1, sizeof(struct BitmapIndex));
+    ix->name = strdup(name);
+    return ix;
+}
+
+// 清空键表：字符串键是字典中的编号，字典被释放（表数据换出）时一起清空，读回时重新登记
+static void bitmap_index_reset(struct BitmapIndex *ix)
+{
+    if (!ix)
+        return;
+    free(ix->keys);
+    free(ix->vals);
+    free(ix->map);
+    ix->keys = NULL;
+    ix->vals = NULL;
+    ix->map = NULL;
+    ix->key_count = ix->key_cap = ix->map_cap = 0;
+}
+
+static void bitmap_index_free(struct BitmapIndex *ix)
+{
+    if (!ix)
+        return;
+    bitmap_index_reset(ix);
+    free(ix->name);
+    free(ix);
+}
+
+static long bitmap_index_bytes(struct BitmapIndex *ix)
+{
+    return sizeof(struct BitmapIndex) + ix->key_cap * (sizeof(long long) + sizeof(struct Value)) +
+           ix->map_cap * sizeof(int);
+}
+
+static void block_bitmap_init(struct BlockBitmap *bb)
+{
+    bb->keys = NULL;
+    bb->nkeys = 0;
+    bb->bytes = 0;
+    bb->ids = (int *)malloc(BLOCK_ROWS * sizeof(int));
+    memset(bb->ids, 0xff, BLOCK_ROWS * sizeof(int));
+}
+
+static void block_bitmap_release(struct BlockBitmap *bb)
+{
+    for (int k = 0; k < bb->nkeys; ++k)
+    {
+        free(bb->keys[k].arr);
+        free(bb->keys[k].bits);
+    }
+    free(bb->keys);
+    free(bb->ids);
+}
+
+// 新建的块（或第一次建位图索引时已有的块）分配行序号表和每个位图索引的容器
+static void block_bitmaps_alloc(struct Table *t, struct Block *b)
+{
+    if (!b->slots)
+        b->slots = (struct Row **)calloc(BLOCK_ROWS, sizeof(struct Row *));
+    b->bitmaps = (struct BlockBitmap *)realloc(b->bitmaps, sizeof(struct BlockBitmap) * t->bitmap_count);
+    for (int i = 0; i < t->bitmap_count; ++i)
+        block_bitmap_init(&b->bitmaps[i]);
+}
+
+static void block_bitmaps_free(struct Block *b, int count)
+{
+    for (int i = 0; i < count && b->bitmaps; ++i)
+        block_bitmap_release(&b->bitmaps[i]);
+    free(b->bitmaps);
+    free(b->slots);
+    b->bitmaps = NULL;
+    b->slots = NULL;
+}
+
+static long block_bitmaps_bytes(struct Block *b, int count)
+{
+    if (!b->slots)
+        return 0;
+    long n = BLOCK_ROWS * sizeof(struct Row *);
+    for (int i = 0; i < count; ++i)
+        n += sizeof(struct BlockBitmap) + BLOCK_ROWS * sizeof(int) + b->bitmaps[i].nkeys * sizeof(struct Container) +
+             b->bitmaps[i].bytes;
+    return n;
+}
+
+// 把序号为slot的行改登记到键k（-1表示取消登记）
+static void block_bitmap_move(struct BlockBitmap *bb, int slot, int k)
+{
+    int old = bb->ids[slot];
+    if (old == k)
+        return;
+    if (old >= 0)
+    {
+        struct Container *c = &bb->keys[old];
+        bb->bytes -= container_bytes(c);
+        container_remove(c, slot);
+        bb->bytes += container_bytes(c);
+    }
+    if (k >= 0)
+    {
+        if (k >= bb->nkeys)
+        {
+            int n = bb->nkeys ? bb->nkeys * 2 : 4;
+            while (n <= k)
+                n *= 2;
+            bb->keys = (struct Container *)realloc(bb->keys, n * sizeof(struct Container));
+            memset(bb->keys + bb->nkeys, 0, (n - bb->nkeys) * sizeof(struct Container));
+            bb->nkeys = n;
+        }
+        struct Container *c = &bb->keys[k];
+        bb->bytes -= container_bytes(c);
+        container_add(c, slot);
+        bb->bytes += container_bytes(c);
+    }
+    bb->ids[slot] = k;
+}
+
+// 按行的当前值登记（插入、更新、撤销更新后由 block_widen 调用），v为该行在索引列上的值
+static void bitmap_set_row(struct BitmapIndex *ix, struct Row *r, struct Value *v)
+{
+    block_bitmap_move(&r->block->bitmaps[ix->slot], r->slot, bitmap_key_id(ix, v));
+}
+
+// 行从块中摘除：取消所有位图索引上的登记，空出序号
+static void bitmap_unlink_row(struct Table *t, struct Row *r)
+{
+    struct Block *b = r->block;
+    for (int i = 0; i < t->col_count; ++i)
+        if (t->bitmaps[i])
+            block_bitmap_move(&b->bitmaps[t->bitmaps[i]->slot], r->slot, -1);
+    b->slots[r->slot] = NULL;
+}
+
+// 在表的第col列上加位图索引（键已经登记），为已有的块分配容器并登记每一行
+static void table_add_bitmap_index(struct Table *t, int col, struct BitmapIndex *ix)
+{
+    if (!t->bitmaps)
+        t->bitmaps = (struct BitmapIndex **)calloc(t->col_count ? t->col_count : 1, sizeof(struct BitmapIndex *));
+    ix->slot = t->bitmap_count++;
+    t->bitmaps[col] = ix;
+    for (struct Block *b = t->blocks; b; b = b->next)
+    {
+        if (!b->slots)
+            b->slots = (struct Row **)calloc(BLOCK_ROWS, sizeof(struct Row *));
+        b->bitmaps = (struct BlockBitmap *)realloc(b->bitmaps, sizeof(struct BlockBitmap) * t->bitmap_count);
+        block_bitmap_init(&b->bitmaps[ix->slot]);
+    }
+    for (struct Row *r = t->rows; r; r = r->next)
+    {
+        r->block->slots[r->slot] = r;
+        bitmap_set_row(ix, r, row_value(t, r, col));
+    }
+}
+
+// 释放之前语句的比较结果（由 bound_sets_release 调用）
+static void bitmap_matches_release()
+{
+    while (bitmap_matches)
+    {
+        struct BitmapMatch *m = bitmap_matches;
+        bitmap_matches = m->next;
+        free(m->ids);
+        free(m);
+    }
+}
+
+// 绑定条件时调用：比较所在的列上有位图索引，满足比较的键在扫描时求值
+static struct BitmapMatch *bitmap_bind(struct BitmapIndex *ix, struct Condition *cond)
+{
+    struct BitmapMatch *m = (struct BitmapMatch *)calloc(1, sizeof(struct BitmapMatch));
+    m->ix = ix;
+    m->cond = cond;
+    m->next = bitmap_matches;
+    bitmap_matches = m;
+    return m;
+}
+
+static int value_match(struct Value *v, struct Condition *cond);
+
+// 对尚未求值的键（绑定之后新增的键）求值比较
+static void bitmap_match_sync(struct BitmapMatch *m)
+{
+    struct BitmapIndex *ix = m->ix;
+    if (m->nkeys >= ix->key_count)
+        return;
+    m->ids = (int *)realloc(m->ids, ix->key_count * sizeof(int));
+    for (; m->nkeys < ix->key_count; ++m->nkeys)
+        if (ix->keys[m->nkeys] != BM_ABSENT && value_match(&ix->vals[m->nkeys], m->cond))
+            m->ids[m->count++] = m->nkeys;
+}
+
+// 条件能否用位图索引求值：2表示得到的就是满足条件的行，1表示得到包含它们的候选行，0表示不能
+static int bitmap_usable(struct Condition *c)
+{
+    if (!c)
+        return 0;
+    if (c->op == 6 || c->op == 7)
+    {
+        int l = bitmap_usable(c->left), r = bitmap_usable(c->right);
+        if (l == 2 && r == 2)
+            return 2;
+        return c->op == 6 ? (l || r) : (l && r);
+    }
+    if (c->op == NOT_OP)
+        return bitmap_usable(c->left) == 2 ? 2 : 0;
+    return c->bitmap ? 2 : 0;
+}
+
+// 计算条件在块上满足的行（bitmap_usable 非0），结果按行序号置位；AND中不能用位图求值的一侧视为所有行
+static void bitmap_eval(struct Block *b, struct Condition *c, unsigned long long *out)
+{
+    unsigned long long tmp[BM_WORDS];
+    if (c->op == 6 && !bitmap_usable(c->left))
+    {
+        bitmap_eval(b, c->right, out);
+        return;
+    }
+    if (c->op == 6 && !bitmap_usable(c->right))
+    {
+        bitmap_eval(b, c->left, out);
+        return;
+    }
+    if (c->op == 6 || c->op == 7)
+    {
+        bitmap_eval(b, c->left, out);
+        bitmap_eval(b, c->right, tmp);
+        for (int w = 0; w < BM_WORDS; ++w)
+            out[w] = c->op == 6 ? out[w] & tmp[w] : out[w] | tmp[w];
+        return;
+    }
+    if (c->op == NOT_OP)
+    {
+        // 取补集后去掉尚未分配的序号（空序号在取行时跳过）
+        bitmap_eval(b, c->left, out);
+        for (int w = 0; w < BM_WORDS; ++w)
+        {
+            int n = b->used - w * 64;
+            out[w] = n >= 64 ? ~out[w] : n > 0 ? ~out[w] & ((1ULL << n) - 1) : 0;
+        }
+        return;
+    }
+    struct BitmapMatch *m = c->bitmap;
+    struct BlockBitmap *bb = &b->bitmaps[m->ix->slot];
+    bitmap_match_sync(m);
+    memset(out, 0, BM_WORDS * sizeof(unsigned long long));
+    for (int i = 0; i < m->count; ++i)
+        if (m->ids[i] < bb->nkeys)
+            container_or(&bb->keys[m->ids[i]], out);
+}
+
+// 计算条件在块上满足的行，返回是否有行
+static int bitmap_block(struct Block *b, struct Condition *cond, unsigned long long *out)
+{
+    unsigned long long any = 0;
+    bitmap_eval(b, cond, out);
+    for (int w = 0; w < BM_WORDS; ++w)
+        any |= out[w];
+    return any != 0;
+}
+
+// 单表扫描游标：条件中有唯一索引列的等值比较时只取索引命中的一行，
+// 否则按块遍历，跳过没有未删除行或区域映射表明不可能满足条件的块
+struct Scan
+{
+    struct Condition *cond;
+    struct Condition *filter; // 取出的行仍需用 row_match 判断的条件，位图索引已给出满足条件的行时为NULL
+    struct Condition *ic; // 使用的索引等值比较，NULL表示按块扫描
+    struct Block *blk;    // 下一个块
+    struct Row *row;      // 下一行
+    int left;             // 当前块中剩余的行数
+    int sample;           // TABLESAMPLE SYSTEM 的百分比，0表示读所有块
+    int bitmap;           // 按块扫描时条件的 bitmap_usable，非0时按位图取行
+    struct Block *cur;    // 按位图取行的块，NULL表示没有
+    int word;             // 位图中下一个要读的字，从高往低读
+    unsigned long long bits[BM_WORDS]; // 当前块中（可能）满足条件的行序号
+    long blocks;          // 访问的块数
+    long skipped;         // 跳过的块数
+    long unsampled;       // 未被抽中的块数
+    long bitmap_empty;    // 位图求值后没有行的块数
+};
+
+// 按块扫描：条件能用位图索引求值时按位图取行
+static void scan_blocks(struct Scan *s, struct Table *t)
+{
+    s->blk = t->blocks;
+    s->bitmap = t->bitmap_count ? bitmap_usable(s->cond) : 0;
+    s->filter = s->bitmap == 2 ? NULL : s->cond;
+}
+
+// 开始扫描，条件需先经 bind_condition 绑定
+static void scan_begin(struct Scan *s, struct Table *t, struct Condition *cond)
+{
+    memset(s, 0, sizeof(*s));
+    s->cond = s->filter = cond;
+    s->ic = index_condition(t, cond);
+    if (s->ic)
+        s->row = index_probe(t, s->ic);
+    else
+        scan_blocks(s, t);
+}
+
+// TABLESAMPLE 的随机数（xorshift），第一次使用时按时间取种子
+static unsigned int sample_rand()
+{
+    static unsigned int state = 0;
+    if (!state)
+        state = (unsigned int)time(NULL) * 2654435761u | 1;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// 抽样扫描（在 scan_begin 之后调用）：每块以 percent% 的概率读取，不用唯一索引
+static void scan_sample(struct Scan *s, struct Table *t, int percent)
+{
+    s->ic = NULL;
+    s->row = NULL;
+    scan_blocks(s, t);
+    s->sample = percent;
+}
+
+// 返回下一个未删除的候选行（仍需用 row_match 判断 s->filter），扫描结束返回NULL
+static struct Row *scan_next(struct Scan *s)
+{
+    if (STMT_CHECK())
+        return NULL;
+    if (s->ic)
+    {
+        struct Row *r = s->row;
+        s->row = NULL;
+        return r && !r->dead ? r : NULL;
+    }
+    while (1)
+    {
+        while (s->left > 0)
+        {
+            struct Row *r = s->row;
+            s->row = r->next;
+            --s->left;
+            if (!r->dead)
+                return r;
+        }
+        // 按序号从大到小取位图中的行，与行链表的顺序一致
+        while (s->cur)
+        {
+            unsigned long long w = s->bits[s->word];
+            if (!w)
+            {
+                if (--s->word < 0)
+                    s->cur = NULL;
+                continue;
+            }
+            int bit = 63 - __builtin_clzll(w);
+            s->bits[s->word] = w & ~(1ULL << bit);
+            struct Row *r = s->cur->slots[s->word * 64 + bit];
+            if (r && !r->dead)
+                return r;
+        }
+        struct Block *b = s->blk;
+        if (!b)
+            return NULL;
+        s->blk = b->next;
+        ++s->blocks;
+        if (s->sample && sample_rand() % 100 >= (unsigned int)s->sample)
+        {
+            ++s->unsampled;
+            continue;
+        }
+        if (!b->live || !block_may_match(b, s->cond))
+        {
+            ++s->skipped;
+            continue;
+        }
+        if (s->bitmap)
+        {
+            if (bitmap_block(b, s->cond, s->bits))
+            {
+                s->cur = b;
+                s->word = BM_WORDS - 1;
+            }
+            else
+                ++s->bitmap_empty;
+            continue;
+        }
+        s->row = b->first;
+        s->left = b->count;
+    }
+}
+
+// 扫描阶段的名字：访问方式 + 表名 + 后续操作
+static void scan_stage_name(struct Scan *s, struct Table *t, const char *ops, char *buf, size_t size)
+{
+    snprintf(buf, size, "%s %s + %s",
+             s->ic ? "IndexLookup" : s->sample ? "SampleScan" : s->bitmap ? "BitmapScan" : "SeqScan", t->name, ops);
+}
+
+// EXPLAIN ANALYZE：每个LIKE条件一行（验证的字符串数/匹配的等价类数），
+// 每个子查询一行建哈希集合的统计（扫描的行数/集合中的键数）
+static void pred_report(struct Condition *cond)
+{
+    if (!cond)
+        return;
+    if (cond->op == 6 || cond->op == 7 || cond->op == NOT_OP)
+    {
+        pred_report(cond->left);
+        pred_report(cond->right);
+        return;
+    }
+    char name[64];
+    struct ExecStage *st;
+    if (cond->bitmap && cond->bitmap->nkeys)
+    {
+        // 按位图取行时：求值的键数/满足比较的键数
+        snprintf(name, sizeof(name), "  Bitmap %s (%s)", cond->col, cond->bitmap->ix->name);
+        st = stage_begin(name);
+        stage_end(st, cond->bitmap->nkeys, cond->bitmap->count);
+        st->time_us = 0;
+    }
+    if (cond->op == LIKE_OP && cond->like)
+    {
+        snprintf(name, sizeof(name), "  LIKE %s (%s)", cond->col, cond->like->method);
+        st = stage_begin(name);
+        stage_end(st, cond->like->candidates, cond->like->count);
+        st->time_us = 0;
+    }
+    else if (cond->sub && cond->set)
+    {
+        snprintf(name, sizeof(name), "  Hash build %s", cond->sub->table);
+        st = stage_begin(name);
+        stage_end(st, cond->set->build_rows, cond->set->count);
+        st->time_us = cond->set->build_us;
+    }
+}
+
+// EXPLAIN ANALYZE：按块扫描时追加块的访问统计（抽样时先是抽中的块数，再是区域映射读取/跳过的块数，
+// 按位图取行时最后是位图中有行的块数）
+static void scan_report(struct Scan *s)
+{
+    if (explain_mode != EXPLAIN_ANALYZE)
+        return;
+    pred_report(s->cond);
+    if (s->ic)
+        return;
+    struct ExecStage *st;
+    if (s->sample)
+    {
+        st = stage_begin("  TABLESAMPLE blocks");
+        stage_end(st, s->blocks, s->blocks - s->unsampled);
+        st->time_us = 0;
+    }
+    st = stage_begin("  Zone map blocks");
+    stage_end(st, s->blocks - s->unsampled, s->blocks - s->unsampled - s->skipped);
+    st->time_us = 0;
+    if (s->bitmap)
+    {
+        long read = s->blocks - s->unsampled - s->skipped;
+        st = stage_begin("  Bitmap blocks");
+        stage_end(st, read, read - s->bitmap_empty);
+        st->time_us = 0;
+    }
+}
+
+// 释放一行：字符串归字典所有，只释放值节点
+static void free_row(struct Row *r)
+{
+    struct Value *v = r->values;
+    while (v)
+    {
+        struct Value *tmp = v;
+        v = v->next;
+        free(tmp);
+    }
+    free(r);
+}
+
+// 释放表结构、所有行及字典
+static void free_table(struct Table *t)
+{
+    ++schema_epoch; // 缓存中引用该表的条目全部失效
+    if (t->disk_path)
+    {
+        if (t->disk_owned)
+            remove(t->disk_path);
+        free(t->disk_path);
+    }
+    free(t->name);
+    free_column_defs(t->columns);
+    struct Row *r = t->rows;
+    while (r)
+    {
+        struct Row *tr = r;
+        r = r->next;
+        free_row(tr);
+    }
+    for (int i = 0; i < t->col_count; ++i)
+    {
+        dict_free(t->dicts[i]);
+        index_free(t->indexes[i]);
+        if (t->text_indexes)
+            text_index_free(t->text_indexes[i]);
+        if (t->bitmaps)
+            bitmap_index_free(t->bitmaps[i]);
+    }
+    table_free_defaults(t);
+    table_free_sketches(t);
+    table_drop_layouts(t);
+    free(t->dicts);
+    free(t->indexes);
+    free(t->text_indexes);
+    free(t->bitmaps);
+    block_free_list(t->blocks);
+    free(t);
+}
+
+// ================== 查询结果缓存 ==================
+// 以"当前数据库名 + 规范化的语句文本"为键缓存SELECT的完整输出。
+// 每个表有一个版本号，插入/更新/删除/回滚时更新；删除表时推进全局结构版本，
+// 命中时逐一核对涉及的表版本，任一不一致即失效。缓存按LRU淘汰，总字节数不超过query_cache_size
+#define CACHE_BUCKETS 256
+
+struct CacheEntry
+{
+    char *key;                 // 数据库名 + '\n' + 语句文本
+    unsigned int hash;
+    char *out;                 // 缓存的输出
+    size_t out_len;
+    size_t bytes;              // 条目占用的字节数
+    long epoch;                // 缓存时的结构版本
+    int table_count;
+    struct Table *tables[8];   // 涉及的表
+    long versions[8];          // 缓存时各表的版本
+    struct CacheEntry *hnext;  // 哈希链
+    struct CacheEntry *prev;   // LRU链表，表头为最近使用
+    struct CacheEntry *next;
+};
+
+static struct CacheEntry *cache_buckets[CACHE_BUCKETS];
+static struct CacheEntry *lru_head = NULL, *lru_tail = NULL;
+static long cache_limit = 0; // 缓存字节上限，0表示关闭
+static long cache_bytes = 0;
+static long cache_entries = 0;
+static long cache_hits = 0, cache_misses = 0, cache_evictions = 0;
+
+// 输出捕获：缓存开启时SELECT的输出先写入缓冲区，语句结束后一次输出
+static struct
+{
+    char *data;
+    size_t len;
+    size_t cap;
+    int active;
+} capture;
+
+// SELECT结果输出：捕获中写入缓冲区，否则直接输出（QUIET_SILENT 下丢弃）
+static void out_printf(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    if (!capture.active)
+    {
+        if (quiet < QUIET_SILENT)
+            vprintf(fmt, ap);
+        va_end(ap);
+        return;
+    }
+    va_list ap2;
+    va_copy(ap2, ap);
+    int n = vsnprintf(capture.data + capture.len, capture.cap - capture.len, fmt, ap);
+    va_end(ap);
+    if (n >= 0 && capture.len + n >= capture.cap)
+    {
+        while (capture.len + n >= capture.cap)
+            capture.cap = capture.cap ? capture.cap * 2 : 4096;
+        capture.data = (char *)realloc(capture.data, capture.cap);
+        vsnprintf(capture.data + capture.len, capture.cap - capture.len, fmt, ap2);
+    }
+    va_end(ap2);
+    if (n > 0)
+        capture.len += n;
+    // 结果超过缓存上限，无法缓存：输出已捕获的部分，之后直接输出
+    if ((long)capture.len > cache_limit)
+    {
+        fwrite(capture.data, 1, capture.len, stdout);
+        capture.len = 0;
+        capture.active = 0;
+    }
+}
+
+static unsigned int cache_hash(const char *s)
+{
+    unsigned int h = 2166136261u;
+    for (; *s; ++s)
+        h = (h ^ (unsigned char)*s) * 16777619u;
+    return h;
+}
+
+static void lru_unlink(struct CacheEntry *e)
+{
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        lru_head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        lru_tail = e->prev;
+    e->prev = e->next = NULL;
+}
+
+static void lru_push_front(struct CacheEntry *e)
+{
+    e->prev = NULL;
+    e->next = lru_head;
+    if (lru_head)
+        lru_head->prev = e;
+    lru_head = e;
+    if (!lru_tail)
+        lru_tail = e;
+}
+
+// 从缓存中删除一个条目
+static void cache_remove(struct CacheEntry *e)
+{
+    struct CacheEntry **p = &cache_buckets[e->hash % CACHE_BUCKETS];
+    while (*p != e)
+        p = &(*p)->hnext;
+    *p = e->hnext;
+    lru_unlink(e);
+    cache_bytes -= (long)e->bytes;
+    --cache_entries;
+    free(e->key);
+    free(e->out);
+    free(e);
+}
+
+// 淘汰最久未使用的条目，直到总字节数不超过上限
+static void cache_evict()
+{
+    while (lru_tail && cache_bytes > cache_limit)
+    {
+        cache_remove(lru_tail);
+        ++cache_evictions;
+    }
+}
+
+// 生成缓存键
+static char *cache_key(const char *text)
+{
+    size_t a = strlen(current_db->name), b = strlen(text);
+    char *key = (char *)malloc(a + b + 2);
+    memcpy(key, current_db->name, a);
+    key[a] = '\n';
+    memcpy(key + a + 1, text, b + 1);
+    return key;
+}
+
+// 查找有效的缓存条目，过期的条目直接删除
+static struct CacheEntry *cache_lookup(const char *key, unsigned int hash)
+{
+    for (struct CacheEntry *e = cache_buckets[hash % CACHE_BUCKETS]; e; e = e->hnext)
+    {
+        if (e->hash != hash || strcmp(e->key, key) != 0)
+            continue;
+        // 结构版本不变时，表指针仍然有效
+        int valid = e->epoch == schema_epoch;
+        for (int i = 0; valid && i < e->table_count; ++i)
+            valid = e->tables[i]->version == e->versions[i];
+        if (!valid)
+        {
+            cache_remove(e);
+            return NULL;
+        }
+        return e;
+    }
+    return NULL;
+}
+
+// 将捕获的输出存入缓存，key的所有权转移给缓存
+static void cache_store(char *key, unsigned int hash, struct Table **tables, int n)
+{
+    struct CacheEntry *e = (struct CacheEntry *)calloc(1, sizeof(struct CacheEntry));
+    e->key = key;
+    e->hash = hash;
+    e->out = (char *)malloc(capture.len ? capture.len : 1);
+    memcpy(e->out, capture.data, capture.len);
+    e->out_len = capture.len;
+    e->bytes = sizeof(struct CacheEntry) + strlen(key) + 1 + capture.len;
+    e->epoch = schema_epoch;
+    e->table_count = n;
+    for (int i = 0; i < n; ++i)
+    {
+        e->tables[i] = tables[i];
+        e->versions[i] = tables[i]->version;
+    }
+    e->hnext = cache_buckets[hash % CACHE_BUCKETS];
+    cache_buckets[hash % CACHE_BUCKETS] = e;
+    lru_push_front(e);
+    cache_bytes += (long)e->bytes;
+    ++cache_entries;
+    cache_evict();
+}
+
+// 设置缓存上限（字节），0关闭缓存并清空
+static void cache_set_limit(long bytes)
+{
+    cache_limit = bytes > 0 ? bytes : 0;
+    cache_evict();
+}
+
+// SHOW STATUS 中的缓存统计
+static void cache_show_status()
+{
+    printf("  Query cache:  %ld hits, %ld misses, %ld evictions, %ld entries, %ld/%ld bytes\n", cache_hits,
+           cache_misses, cache_evictions, cache_entries, cache_bytes, cache_limit);
+}
+
+static void bind_subquery(struct Condition *cond, struct Table **tables, int n);
+static int bind_depth = 0; // 正在绑定的子查询层数
+
+// 查询前绑定条件：解析字段所属表和列下标，并将字符串常量翻译为字典编码
+// 每条语句只执行一次，避免逐行查找列名和比较字符串；IN 列表和子查询在这里建成哈希集合
+static void bind_condition(struct Condition *cond, struct Table **tables, int n)
+{
+    if (!cond)
+        return;
+    if (cond->op == 6 || cond->op == 7 || cond->op == NOT_OP)
+    {
+        bind_condition(cond->left, tables, n);
+        bind_condition(cond->right, tables, n);
+        return;
+    }
+    cond->tbl_idx = cond->col_idx = -1;
+    cond->code = -2;
+    cond->like = NULL;
+    cond->set = NULL;
+    cond->bitmap = NULL;
+    if (cond->op == EXISTS_OP)
+    {
+        bind_subquery(cond, tables, n);
+        return;
+    }
+    if (cond->op == REF_EQ && bind_depth == 0)
+    {
+        db_error("[DB] %s.%s can only be referenced in an EXISTS subquery\n", cond->ref_table, cond->ref_col);
+        return;
+    }
+    for (int i = 0; i < n; ++i)
+    {
+        int idx = col_index(tables[i]->columns, cond->col);
+        if (idx >= 0)
+        {
+            cond->tbl_idx = i;
+            cond->col_idx = idx;
+            if (cond->op == LIKE_OP)
+            {
+                char buf[16];
+                const char *pattern = cond->value->str_val;
+                if (cond->value->is_int)
+                {
+                    snprintf(buf, sizeof(buf), "%d", cond->value->int_val);
+                    pattern = buf;
+                }
+                cond->like = pattern ? like_bind(tables[i], idx, pattern) : NULL;
+            }
+            else if (cond->op == IN_OP && cond->sub)
+                bind_subquery(cond, tables, n);
+            else if (cond->op == IN_OP)
+            {
+                struct ValueSet *vs = cond->set = set_create();
+                for (struct Value *v = cond->value; v; v = v->next)
+                {
+                    if (v->is_int)
+                        set_add_int(vs, v->int_val);
+                    else if (v->str_val)
+                    {
+                        int code = dict_lookup_fold(tables[i]->dicts[idx], v->str_val);
+                        if (code >= 0)
+                            set_add_code(vs, code);
+                    }
+                }
+            }
+            else if (cond->op != REF_EQ && !cond->value->is_int)
+                cond->code = dict_lookup_fold(tables[i]->dicts[idx], cond->value->str_val);
+            // 单表扫描时可按位图索引求值
+            if (n == 1 && cond->op != REF_EQ && tables[i]->bitmap_count && tables[i]->bitmaps[idx])
+                cond->bitmap = bitmap_bind(tables[i]->bitmaps[idx], cond);
+            return;
+        }
+    }
+}
+
+// 单个比较条件判断：v为行中对应字段的值
+static int value_match(struct Value *v, struct Condition *cond)
+{
+    ++pred_evals;
+    if (cond->op == LIKE_OP)
+        return cond->value->is_int || cond->value->str_val ? like_value_match(v, cond) : 0;
+    if (cond->op == IN_OP || cond->op == EXISTS_OP)
+        return cond->set ? set_match(cond->set, v) : 0;
+    if (cond->op == REF_EQ)
+        return cond->code == 1; // 关联条件在建哈希集合时已处理，扫描子查询时视为满足
+    // 整型比较
+    if (cond->value->is_int && v->is_int)
+    {
+        int a = v->int_val, b = cond->value->int_val;
+        switch (cond->op)
+        {
+        case 0:
+            return a == b;
+        case 1:
+            return a != b;
+        case 2:
+            return a > b;
+        case 3:
+            return a < b;
+        case 4:
+            return a >= b;
+        case 5:
+            return a <= b;
+        }
+    }
+    // 字符串比较
+    else if (!cond->value->is_int && !v->is_int)
+    {
+        // 等值/不等比较直接比较字典编码
+        if (cond->op == 0)
+            return v->str_val && v->code == cond->code;
+        if (cond->op == 1)
+            return !v->str_val || v->code != cond->code;
+        if (!v->str_val)
+            return 0;
+        int cmp = strcasecmp_dbms(v->str_val, cond->value->str_val);
+        switch (cond->op)
+        {
+        case 2:
+            return cmp > 0;
+        case 3:
+            return cmp < 0;
+        case 4:
+            return cmp >= 0;
+        case 5:
+            return cmp <= 0;
+        }
+    }
+    return 0;
+}
+
+// 判断一行数据是否满足条件表达式（单表where），条件需先经 bind_condition 绑定
+// 返回1表示满足，0表示不满足
+int row_match(struct Row *row, struct Condition *cond)
+{
+    // 没有条件，直接返回满足
+    if (!cond)
+        return 1;
+    // 递归处理AND/OR条件
+    if (cond->op == 6)
+        return row_match(row, cond->left) && row_match(row, cond->right);
+    if (cond->op == 7)
+        return row_match(row, cond->left) || row_match(row, cond->right);
+    if (cond->op == NOT_OP)
+        return !row_match(row, cond->left);
+    if (cond->col_idx < 0)
+        return 0;
+    // 找到对应字段的值，没有修改过结构的表不必查行的结构版本
+    struct Value *v = row->values;
+    if (altered_tables)
+        v = row_value(row->block->table, row, cond->col_idx);
+    else
+        for (int i = 0; i < cond->col_idx && v; ++i)
+            v = v->next;
+    if (!v)
+        return 0;
+    return value_match(v, cond);
+}
+
+// 多表where条件判断：字段名取第一个包含该字段的表，条件需先经 bind_condition 绑定
+// 返回1表示满足，0表示不满足
+int row_match_multi(struct Row **rows, struct Condition *cond)
+{
+    // 没有条件，直接返回满足
+    if (!cond)
+        return 1;
+    switch (cond->op)
+    {
+    case 6: // AND
+        return row_match_multi(rows, cond->left) && row_match_multi(rows, cond->right);
+    case 7: // OR
+        return row_match_multi(rows, cond->left) || row_match_multi(rows, cond->right);
+    case NOT_OP:
+        return !row_match_multi(rows, cond->left);
+    default:
+        // 没有找到字段
+        if (cond->tbl_idx < 0)
+            return 0;
+        return row_match(rows[cond->tbl_idx], cond);
+    }
+}
+
+// ================== 子查询（哈希半连接） ==================
+// col IN (SELECT c FROM t WHERE ...) 在绑定条件时扫描一次子查询，把c的值建成哈希集合，
+// 外层每行只探测一次集合。EXISTS (SELECT ... FROM t WHERE c = 外层表.col AND ...) 的关联条件
+// 必须是AND链上的一个等值比较，改写为 col IN (SELECT c FROM t WHERE ...) 执行；
+// 没有关联条件的 EXISTS 只求值一次，结果作为常量。
+
+// 子查询的一个值并入集合：字符串换成外层列字典中的等价类编号（不在外层字典中的字符串不可能匹配），
+// memo按子查询列字典的等价类缓存换算结果
+static void set_add_value(struct ValueSet *vs, struct Value *v, struct Dict *outer, int *memo)
+{
+    if (v->is_int)
+    {
+        set_add_int(vs, v->int_val);
+        return;
+    }
+    if (!v->str_val)
+        return;
+    int code = memo ? memo[v->code] : -3;
+    if (code == -3)
+    {
+        code = dict_lookup_fold(outer, v->str_val);
+        if (memo)
+            memo[v->code] = code;
+    }
+    if (code >= 0)
+        set_add_code(vs, code);
+}
+
+// 取出子查询条件AND链上的关联条件并标记为已处理，返回个数
+static int ref_collect(struct Condition *c, struct Condition **ref)
+{
+    if (!c)
+        return 0;
+    if (c->op == 6)
+        return ref_collect(c->left, ref) + ref_collect(c->right, ref);
+    if (c->op != REF_EQ)
+        return 0;
+    c->code = 1;
+    *ref = c;
+    return 1;
+}
+
+// 条件中是否有未处理的关联条件（如在OR分支中）
+static int ref_pending(struct Condition *c)
+{
+    if (!c)
+        return 0;
+    if (c->op == 6 || c->op == 7 || c->op == NOT_OP)
+        return ref_pending(c->left) || ref_pending(c->right);
+    return c->op == REF_EQ && c->code != 1;
+}
+
+// 条件中是否有子查询（结果依赖其他表，不进查询缓存）
+static int cond_has_subquery(struct Condition *c)
+{
+    if (!c)
+        return 0;
+    if (c->op == 6 || c->op == 7 || c->op == NOT_OP)
+        return cond_has_subquery(c->left) || cond_has_subquery(c->right);
+    return c->sub != NULL;
+}
+
+// 执行子查询并建哈希集合（建表侧），IN 的列已由 bind_condition 绑定到外层的表
+static void bind_subquery(struct Condition *cond, struct Table **tables, int n)
+{
+    struct SubQuery *q = cond->sub;
+    struct ValueSet *vs = cond->set = set_create();
+    double t0 = db_now_us();
+    struct Table *st = find_table(q->table);
+    if (!st)
+    {
+        db_error("[DB] Table not found: %s\n", q->table);
+        return;
+    }
+    ++bind_depth;
+    bind_condition(q->cond, &st, 1);
+    --bind_depth;
+    struct Condition *ref = NULL;
+    int inner = -1; // 子查询中取值的列
+    if (cond->op == EXISTS_OP && ref_collect(q->cond, &ref) > 1)
+    {
+        db_error("[DB] EXISTS subquery supports only one correlated condition\n");
+        return;
+    }
+    if (ref_pending(q->cond))
+    {
+        db_error("[DB] Correlated condition must be joined to the subquery by AND\n");
+        return;
+    }
+    if (cond->op == IN_OP)
+    {
+        inner = col_index(st->columns, q->col);
+        if (inner < 0)
+        {
+            db_error("[DB] Column not found: %s\n", q->col);
+            return;
+        }
+    }
+    else if (ref)
+    {
+        // 关联条件指向的外层表和列即探测侧
+        for (int i = 0; i < n && cond->col_idx < 0; ++i)
+            if (strcasecmp_dbms(tables[i]->name, ref->ref_table) == 0)
+            {
+                cond->tbl_idx = i;
+                cond->col_idx = col_index(tables[i]->columns, ref->ref_col);
+            }
+        if (cond->col_idx < 0 || ref->col_idx < 0)
+        {
+            db_error("[DB] Column not found: %s\n", cond->col_idx < 0 ? ref->ref_col : ref->col);
+            cond->col_idx = -1;
+            return;
+        }
+        inner = ref->col_idx;
+    }
+    else
+    {
+        // 不相关：任取外层第一列判断，结果与行无关
+        cond->tbl_idx = cond->col_idx = 0;
+        vs->truth = 0;
+    }
+    struct Dict *outer = inner >= 0 ? tables[cond->tbl_idx]->dicts[cond->col_idx] : NULL;
+    struct Dict *d = inner >= 0 ? st->dicts[inner] : NULL;
+    int *memo = NULL;
+    if (d)
+    {
+        memo = (int *)malloc(sizeof(int) * (d->fold_count ? d->fold_count : 1));
+        for (int i = 0; i < d->fold_count; ++i)
+            memo[i] = -3; // 尚未换算
+    }
+    struct Scan scan;
+    scan_begin(&scan, st, q->cond);
+    struct Row *r;
+    while ((r = scan_next(&scan)))
+    {
+        ++vs->build_rows;
+        if (!row_match(r, scan.filter))
+            continue;
+        if (inner < 0)
+        {
+            vs->truth = 1;
+            break;
+        }
+        struct Value *v = row_value(st, r, inner);
+        if (v)
+            set_add_value(vs, v, outer, memo);
+    }
+    free(memo);
+    vs->build_us = db_now_us() - t0;
+}
+
+// 输出单个字段值
+static void print_value(struct Value *v)
+{
+    if (v)
+    {
+        if (v->is_int)
+            out_printf("%12d", v->int_val);
+        else
+            out_printf("%12s", v->str_val ? v->str_val : "NULL");
+    }
+    else
+    {
+        out_printf("%12s", "NULL");
+    }
+}
+
+// 多表select * 输出所有表所有字段
+// 递归枚举所有表的行组合并输出
+void print_rows_multi(int idx, struct Row **rows, int n, struct Table **table_arr, struct Condition *cond)
+{
+    // 递归出口：所有表的行都已选定
+    if (idx == n)
+    {
+        ++join_combos;
+        // 判断当前行组合是否满足where条件
+        if (!row_match_multi(rows, cond))
+            return;
+        ++join_matched;
+        double t0 = explain_mode == EXPLAIN_ANALYZE ? db_now_us() : 0;
+        // 依次输出每个表的所有字段
+        for (int i = 0; i < n; ++i)
+        {
+            for (int j = 0; j < table_arr[i]->col_count; ++j)
+                print_value(row_value(table_arr[i], rows[i], j));
+        }
+        out_printf("\n");
+        if (explain_mode == EXPLAIN_ANALYZE)
+            output_us += db_now_us() - t0;
+        return;
+    }
+    // 递归：枚举当前表的每一行，语句被取消时停止枚举
+    for (struct Row *r = table_arr[idx]->rows; r; r = r->next)
+    {
+        if (r->dead)
+            continue;
+        if (STMT_CHECK())
+            return;
+        ++join_scanned[idx];
+        rows[idx] = r;                                       // 记录当前表选中的行
+        print_rows_multi(idx + 1, rows, n, table_arr, cond); // 递归处理下一个表
+    }
+}
+
+// 递归枚举所有表的行组合，只输出指定字段
+static void print_rows_multi_sel(int idx, struct Row **rows, int n, struct Table **table_arr, struct Condition *cond, struct FieldRef *fields, int field_count)
+{
+    // 递归出口：所有表的行都已选定
+    if (idx == n)
+    {
+        ++join_combos;
+        // 判断当前行组合是否满足where条件
+        if (!row_match_multi(rows, cond))
+            return;
+        ++join_matched;
+        double t0 = explain_mode == EXPLAIN_ANALYZE ? db_now_us() : 0;
+        // 只输出指定字段
+        for (int i = 0; i < field_count; ++i)
+        {
+            int t_idx = fields[i].table_idx;
+            int c_idx = fields[i].col_idx;
+            print_value(row_value(table_arr[t_idx], rows[t_idx], c_idx));
+        }
+        out_printf("\n");
+        if (explain_mode == EXPLAIN_ANALYZE)
+            output_us += db_now_us() - t0;
+        return;
+    }
+    // 递归：枚举当前表的每一行，语句被取消时停止枚举
+    for (struct Row *r = table_arr[idx]->rows; r; r = r->next)
+    {
+        if (r->dead)
+            continue;
+        if (STMT_CHECK())
+            return;
+        ++join_scanned[idx];
+        rows[idx] = r;                                                                // 记录当前表选中的行
+        print_rows_multi_sel(idx + 1, rows, n, table_arr, cond, fields, field_count); // 递归处理下一个表
+    }
+}
+
+// 将条件表达式格式化为文本，追加到buf中
+static void format_condition(struct Condition *cond, char *buf, size_t size)
+{
+    static const char *op_names[] = {"=", "<>", ">", "<", ">=", "<=", "AND", "OR", "LIKE"};
+    size_t len = strlen(buf);
+    if (!cond || len + 1 >= size)
+        return;
+    if (cond->op == NOT_OP)
+    {
+        snprintf(buf + len, size - len, "NOT (");
+        format_condition(cond->left, buf, size);
+        len = strlen(buf);
+        snprintf(buf + len, size - len, ")");
+        return;
+    }
+    if (cond->op == 6 || cond->op == 7)
+    {
+        snprintf(buf + len, size - len, "(");
+        format_condition(cond->left, buf, size);
+        len = strlen(buf);
+        snprintf(buf + len, size - len, cond->op == 6 ? " AND " : " OR ");
+        format_condition(cond->right, buf, size);
+        len = strlen(buf);
+        snprintf(buf + len, size - len, ")");
+        return;
+    }
+    if (cond->op == REF_EQ)
+    {
+        snprintf(buf + len, size - len, "%s = %s.%s", cond->col, cond->ref_table, cond->ref_col);
+        return;
+    }
+    if (cond->op == IN_OP || cond->op == EXISTS_OP)
+    {
+        if (cond->op == IN_OP)
+            snprintf(buf + len, size - len, "%s IN (", cond->col);
+        else
+            snprintf(buf + len, size - len, "EXISTS (");
+        if (cond->sub)
+        {
+            len = strlen(buf);
+            snprintf(buf + len, size - len, "SELECT %s FROM %s", cond->sub->col ? cond->sub->col : "*",
+                     cond->sub->table);
+            if (cond->sub->cond)
+            {
+                len = strlen(buf);
+                snprintf(buf + len, size - len, " WHERE ");
+                format_condition(cond->sub->cond, buf, size);
+            }
+        }
+        for (struct Value *v = cond->value; v && strlen(buf) + 1 < size; v = v->next)
+        {
+            len = strlen(buf);
+            if (v->is_int)
+                snprintf(buf + len, size - len, "%s%d", v == cond->value ? "" : ", ", v->int_val);
+            else
+                snprintf(buf + len, size - len, "%s'%s'", v == cond->value ? "" : ", ", v->str_val ? v->str_val : "NULL");
+        }
+        len = strlen(buf);
+        snprintf(buf + len, size - len, ")");
+        return;
+    }
+    if (cond->value->is_int)
+        snprintf(buf + len, size - len, "%s %s %d", cond->col, op_names[cond->op], cond->value->int_val);
+    else
+        snprintf(buf + len, size - len, "%s %s '%s'", cond->col, op_names[cond->op], cond->value->str_val);
+}
+
+// 统计表的行数
+static long table_row_count(struct Table *t)
+{
+    long n = 0;
+    for (struct Row *r = t->rows; r; r = r->next)
+        ++n;
+    return n - t->dead_count;
+}
+
+// 第idx列的列名
+static const char *column_name(struct Table *t, int idx)
+{
+    struct ColumnDef *c = t->columns;
+    for (int i = 0; i < idx && c; ++i)
+        c = c->next;
+    return c ? c->name : "?";
+}
+
+// 输出LIKE条件的候选来源（字典扫描、文本索引的前缀范围或三元组，及验证的字符串数），
+// 以及IN/EXISTS的哈希集合（子查询在绑定时已执行）
+static void explain_predicates(struct Table *t, struct Condition *cond, const char *indent)
+{
+    if (!cond)
+        return;
+    if (cond->op == 6 || cond->op == 7 || cond->op == NOT_OP)
+    {
+        explain_predicates(t, cond->left, indent);
+        explain_predicates(t, cond->right, indent);
+        return;
+    }
+    struct ValueSet *vs = cond->set;
+    if (vs && !cond->sub)
+        printf("%s   -> HashSet: %s IN list (keys=%d)\n", indent, cond->col, vs->count);
+    else if (vs && vs->truth >= 0)
+        printf("%s   -> Exists: %s evaluated once (%s, rows scanned=%ld)\n", indent, cond->sub->table,
+               vs->truth ? "true" : "false", vs->build_rows);
+    else if (vs && cond->col_idx >= 0)
+        printf("%s   -> HashSemiJoin: %s.%s probes %s%s%s (build rows=%ld, keys=%d)\n", indent, t->name,
+               column_name(t, cond->col_idx), cond->sub->table, cond->sub->col ? "." : "",
+               cond->sub->col ? cond->sub->col : " via EXISTS", vs->build_rows, vs->count);
+    if (cond->op != LIKE_OP || !cond->like)
+        return;
+    struct LikeSet *ls = cond->like;
+    if (ls->slot >= 0)
+        printf("%s   -> Like: %s via %s on index %s (strings checked=%ld, matched=%d)\n", indent, cond->col, ls->method,
+               t->text_indexes[cond->col_idx]->name, ls->candidates, ls->count);
+    else
+        printf("%s   -> Like: %s via %s (strings checked=%ld, matched=%d)\n", indent, cond->col, ls->method,
+               ls->candidates, ls->count);
+}
+
+// 按位图取行时每个位图索引列上的比较一行：满足比较的键数
+static void explain_bitmaps(struct Condition *cond, const char *indent)
+{
+    if (!cond)
+        return;
+    if (cond->op == 6 || cond->op == 7 || cond->op == NOT_OP)
+    {
+        explain_bitmaps(cond->left, indent);
+        explain_bitmaps(cond->right, indent);
+        return;
+    }
+    if (!cond->bitmap)
+        return;
+    bitmap_match_sync(cond->bitmap);
+    printf("%s   -> Bitmap: %s on index %s (keys matched=%d of %d)\n", indent, cond->col, cond->bitmap->ix->name,
+           cond->bitmap->count, cond->bitmap->ix->key_count);
+}
+
+// 输出访问路径：全表扫描（及区域映射可跳过的块数）、位图索引或唯一索引查找，及过滤条件
+static void explain_scan(struct Table *t, struct Condition *cond, const char *indent)
+{
+    char buf[512] = "";
+    format_condition(cond, buf, sizeof(buf));
+    if (cond)
+        printf("%s-> Filter: %s\n%s   ", indent, buf, indent);
+    else
+        printf("%s", indent);
+    bind_condition(cond, &t, 1);
+    struct Condition *ic = index_condition(t, cond);
+    if (!ic)
+    {
+        long blocks = 0, pruned = 0, empty = 0;
+        int bitmap = t->bitmap_count ? bitmap_usable(cond) : 0;
+        unsigned long long bits[BM_WORDS];
+        for (struct Block *b = t->blocks; b; b = b->next, ++blocks)
+        {
+            if (!b->live || !block_may_match(b, cond))
+                ++pruned;
+            else if (bitmap && !bitmap_block(b, cond, bits))
+                ++empty;
+        }
+        if (bitmap)
+            printf("-> BitmapScan: %s (rows=%ld, blocks=%ld, %ld skipped by zone map, %ld without matching rows, %s)\n",
+                   t->name, table_row_count(t), blocks, pruned, empty,
+                   bitmap == 2 ? "no row recheck" : "rows rechecked");
+        else
+            printf("-> SeqScan: %s (rows=%ld, blocks=%ld, %ld skipped by zone map)\n", t->name, table_row_count(t),
+                   blocks, pruned);
+        if (bitmap)
+            explain_bitmaps(cond, indent);
+        explain_predicates(t, cond, indent);
+        return;
+    }
+    buf[0] = '\0';
+    format_condition(ic, buf, sizeof(buf));
+    printf("-> IndexLookup: %s using %s index on %s (%s)\n", t->name,
+           t->indexes[ic->col_idx]->primary ? "PRIMARY KEY" : "UNIQUE", ic->col, buf);
+    explain_predicates(t, cond, indent);
+}
+
+// 字段中是否有聚合函数
+static int sel_has_agg(struct SelectList *sel)
+{
+    for (; sel; sel = sel->next)
+        if (sel->agg != AGG_NONE)
+            return 1;
+    return 0;
+}
+
+// EXPLAIN SELECT：输出访问路径和连接策略，不执行查询
+static void explain_select(struct Table **table_arr, int n, struct SelectList *sel, struct Condition *cond, int sample)
+{
+    printf("[EXPLAIN] SELECT\n");
+    printf("  -> Project: ");
+    if (!sel)
+        printf("*");
+    for (struct SelectList *s = sel; s; s = s->next)
+        printf(s->agg ? "APPROX_COUNT_DISTINCT(%s)%s" : "%s%s", s->name, s->next ? ", " : "");
+    printf("\n");
+    if (n == 1 && sel_has_agg(sel))
+    {
+        if (!cond && !sample)
+        {
+            printf("     -> HyperLogLog: maintained sketch per column (%d registers), no scan\n", HLL_REGS);
+            return;
+        }
+        printf("     -> HyperLogLog: sketch built from the scanned rows\n");
+    }
+    if (n == 1 && sample)
+    {
+        long blocks = 0;
+        for (struct Block *b = table_arr[0]->blocks; b; b = b->next)
+            ++blocks;
+        printf("     -> TABLESAMPLE SYSTEM (%d%%): about %ld of %ld blocks read\n", sample, blocks * sample / 100, blocks);
+    }
+    if (n == 1)
+    {
+        explain_scan(table_arr[0], cond, "     ");
+        return;
+    }
+    // 多表：嵌套循环枚举笛卡尔积，在最内层判断where条件
+    double combos = 1;
+    for (int i = 0; i < n; ++i)
+        combos *= (double)table_row_count(table_arr[i]);
+    char buf[512] = "";
+    format_condition(cond, buf, sizeof(buf));
+    printf("     -> NestedLoopJoin: %d tables, cartesian product (combinations=%.0f)\n", n, combos);
+    if (cond)
+        printf("        Join filter: %s\n", buf);
+    for (int i = 0; i < n; ++i)
+        printf("        -> SeqScan: %s (rows=%ld, loop level %d)\n", table_arr[i]->name, table_row_count(table_arr[i]), i);
+}
+
+// ================== 事务与撤销日志 ==================
+enum
+{
+    UNDO_INSERT = 0,
+    UNDO_UPDATE = 1,
+    UNDO_DELETE = 2
+};
+
+// 撤销日志记录：事务中每修改一行就记录一条，回滚时按逆序恢复
+struct UndoRec
+{
+    int type;             // UNDO_INSERT / UNDO_UPDATE / UNDO_DELETE
+    struct Table *table;  // 所属表
+    struct Row *row;      // 插入/更新/删除的行
+    struct Value *old;    // 更新：修改前的值链表
+    struct UndoRec *next; // 头插法，链表顺序即逆序
+};
+
+static int txn_active = 0;
+static struct UndoRec *undo_log = NULL;
+static long undo_count = 0;
+static int stmt_wrote = 0; // 当前语句是否修改了数据（决定是否写入提交日志）
+static int stmt_use = 0;   // 当前语句是否切换了数据库
+
+static void journal_commit(int wrap);
+static void journal_discard();
+
+// 记录一行的前像，必须在修改之前调用
+static void undo_push(int type, struct Table *t, struct Row *row)
+{
+    struct UndoRec *u = (struct UndoRec *)malloc(sizeof(struct UndoRec));
+    u->type = type;
+    u->table = t;
+    u->row = row;
+    u->old = NULL;
+    if (type == UNDO_UPDATE)
+    {
+        // 拷贝值节点；字符串由字典持有，直接共享指针
+        struct Value **tail = &u->old;
+        for (struct Value *v = row->values; v; v = v->next)
+        {
+            struct Value *nv = (struct Value *)malloc(sizeof(struct Value));
+            *nv = *v;
+            nv->next = NULL;
+            *tail = nv;
+            tail = &nv->next;
+        }
+    }
+    u->next = undo_log;
+    undo_log = u;
+    ++undo_count;
+}
+
+// 释放值节点链表（字符串归字典所有）
+static void free_value_nodes(struct Value *v)
+{
+    while (v)
+    {
+        struct Value *tmp = v;
+        v = v->next;
+        free(tmp);
+    }
+}
+
+// 丢弃撤销日志中savepoint之后的记录，savepoint为NULL表示整个日志
+// 删除的行仍留在表中（带墓碑标记），由VACUUM回收
+static void undo_discard(struct UndoRec *savepoint)
+{
+    while (undo_log != savepoint)
+    {
+        struct UndoRec *u = undo_log;
+        undo_log = u->next;
+        free_value_nodes(u->old);
+        free(u);
+        --undo_count;
+    }
+}
+
+// 按逆序应用撤销日志，恢复到savepoint时的状态（NULL表示事务开始时）
+static void undo_apply(struct UndoRec *savepoint)
+{
+    while (undo_log != savepoint)
+    {
+        struct UndoRec *u = undo_log;
+        undo_log = u->next;
+        struct Table *t = u->table;
+        TABLE_CHANGED(t);
+        if (u->type == UNDO_INSERT && cursor_pins)
+        {
+            // 有打开的游标时不释放行，按删除处理，留给之后的VACUUM回收
+            table_unindex_row(t, u->row);
+            u->row->dead = 1;
+            ++t->dead_count;
+            --u->row->block->live;
+        }
+        else if (u->type == UNDO_INSERT)
+        {
+            // 逆序回滚时被插入的行通常位于表头
+            struct Row **p = &t->rows;
+            while (*p && *p != u->row)
+                p = &(*p)->next;
+            if (*p)
+            {
+                block_unlink_row(u->row);
+                table_drop_empty_blocks(t);
+                *p = u->row->next;
+            }
+            table_unindex_row(t, u->row);
+            free_row(u->row);
+            t->row_bytes -= ROW_BYTES(t);
+        }
+        else if (u->type == UNDO_DELETE)
+        {
+            // 删除只打了墓碑标记，清除标记即可恢复
+            u->row->dead = 0;
+            --t->dead_count;
+            ++u->row->block->live;
+            table_index_row(t, u->row);
+        }
+        else
+        {
+            // 按当前值移除索引登记（语句中途出错时可能尚未登记），恢复前像后重新登记
+            // 逆序恢复的中间状态可能有重复键，全部恢复后即与修改前一致
+            table_unindex_row(t, u->row);
+            struct Value *cur = u->row->values;
+            u->row->values = u->old;
+            u->old = cur;
+            table_index_row(t, u->row);
+            block_widen(t, u->row);
+        }
+        free_value_nodes(u->old);
+        free(u);
+        --undo_count;
+    }
+}
+
+// 开始事务
+void db_begin()
+{
+    if (txn_active)
+    {
+        db_error("[DB] Transaction already active\n");
+        return;
+    }
+    txn_active = 1;
+    DB_INFO("[DB] Begin transaction\n");
+}
+
+// 提交事务：丢弃撤销日志，事务内的修改一次写入提交日志
+void db_commit()
+{
+    if (!txn_active)
+    {
+        db_error("[DB] No active transaction\n");
+        return;
+    }
+    long n = undo_count;
+    undo_discard(NULL);
+    txn_active = 0;
+    journal_commit(1);
+    DB_INFO("[DB] Commit (%ld row changes)\n", n);
+}
+
+// 回滚事务：按逆序恢复所有修改过的行
+void db_rollback()
+{
+    if (!txn_active)
+    {
+        db_error("[DB] No active transaction\n");
+        return;
+    }
+    long n = undo_count;
+    undo_apply(NULL);
+    txn_active = 0;
+    journal_discard();
+    DB_INFO("[DB] Rollback (%ld row changes)\n", n);
+}
+
+// DDL无法撤销，执行前隐式提交当前事务
+static void txn_implicit_commit()
+{
+    if (!txn_active)
+        return;
+    DB_INFO("[DB] Implicit commit before DDL\n");
+    db_commit();
+}
+
+// 显示所有数据库名
+void db_show_databases()
+{
+    printf("[DB] Databases:\n");
+    for (struct Database *db = db_list; db; db = db->next)
+        printf("%12s\n", db->name);
+}
+
+// 创建数据库
+void db_create_database(const char *name)
+{
+    if (find_db(name))
+    {
+        db_error("[DB] Database exists: %s\n", name);
+        return;
+    }
+    txn_implicit_commit();
+    // 分配新数据库结构体
+    struct Database *db = (struct Database *)malloc(sizeof(struct Database));
+    db->name = strdup(name); // 拷贝数据库名
+    db->tables = NULL;
+    db->mem_limit = 0;
+    // 头插法插入数据库链表
+    db->next = db_list;
+    db_list = db;
+    stmt_wrote = 1;
+    DB_INFO("[DB] Create database: %s\n", name);
+}
+
+// 切换当前数据库
+void db_use_database(const char *name)
+{
+    struct Database *db = find_db(name);
+    if (!db)
+    {
+        db_error("[DB] Database not found: %s\n", name);
+        return;
+    }
+    // 切换当前数据库指针
+    current_db = db;
+    stmt_use = 1;
+    DB_INFO("[DB] Use database: %s\n", name);
+}
+
+// 删除数据库及其所有表
+void db_drop_database(const char *name)
+{
+    if (cursor_pins)
+    {
+        db_error("[DB] Cannot DROP while a cursor is open\n");
+        return;
+    }
+    txn_implicit_commit();
+    struct Database **p = &db_list;
+    while (*p)
+    {
+        if (strcasecmp_dbms((*p)->name, name) == 0)
+        {
+            struct Database *del = *p;
+            *p = del->next; // 从链表中移除
+            // 释放所有表及其数据
+            struct Table *t = del->tables;
+            while (t)
+            {
+                struct Table *tmp = t;
+                t = t->next;
+                free_table(tmp);
+            }
+            free(del->name);
+            free(del);
+            if (current_db == del)
+                current_db = NULL;
+            stmt_wrote = 1;
+            DB_INFO("[DB] Drop database: %s\n", name);
+            return;
+        }
+        p = &(*p)->next;
+    }
+    db_error("[DB] Database not found: %s\n", name);
+}
+
+// 显示当前数据库所有表名
+void db_show_tables()
+{
+    if (!current_db)
+    {
+        db_error("[DB] No database selected\n");
+        return;
+    }
+    printf("[DB] Tables in %s:\n", current_db->name);
+    for (struct Table *t = current_db->tables; t; t = t->next)
+        printf("%12s\n", t->name);
+}
+
+// 列约束的文本形式（带前导空格），没有约束时为空串
+// 快照目录中列定义按空白分隔，PRIMARY KEY 写作 PRIMARY_KEY
+static const char *constraint_suffix(int constraint, int catalogue)
+{
+    if (constraint == CONSTRAINT_UNIQUE)
+        return " UNIQUE";
+    if (constraint == CONSTRAINT_PRIMARY_KEY)
+        return catalogue ? " PRIMARY_KEY" : " PRIMARY KEY";
+    return "";
+}
+
+// DEFAULT 的类型与列类型不符
+static int column_default_mismatch(struct ColumnDef *c)
+{
+    return c->def && c->def->is_int == (strncmp(c->type, "CHAR", 4) == 0);
+}
+
+// 创建表，深拷贝列定义
+void db_create_table(const char *name, struct ColumnDef *cols)
+{
+    if (!current_db)
+    {
+        db_error("[DB] No database selected\n");
+        return;
+    }
+    if (find_table(name))
+    {
+        db_error("[DB] Table exists: %s\n", name);
+        return;
+    }
+    int primary_count = 0;
+    for (struct ColumnDef *c = cols; c; c = c->next)
+        primary_count += c->constraint == CONSTRAINT_PRIMARY_KEY;
+    if (primary_count > 1)
+    {
+        db_error("[DB] Multiple PRIMARY KEY columns in table %s\n", name);
+        return;
+    }
+    for (struct ColumnDef *c = cols; c; c = c->next)
+        if (column_default_mismatch(c))
+        {
+            db_error("[DB] Type mismatch for column %s\n", c->name);
+            return;
+        }
+    txn_implicit_commit();
+    // 分配新表结构体
+    struct Table *t = (struct Table *)malloc(sizeof(struct Table));
+    t->name = strdup(name); // 拷贝表名
+    // 深拷贝列定义，防止外部free影响
+    struct ColumnDef *src = cols, *dst_head = NULL, **dst_tail = &dst_head;
+    t->col_count = 0;
+    while (src)
+    {
+        ++t->col_count;
+        struct ColumnDef *c = (struct ColumnDef *)malloc(sizeof(struct ColumnDef));
+        c->name = strdup(src->name);
+        c->type = strdup(src->type);
+        c->constraint = src->constraint;
+        c->def = copy_value(src->def);
+        c->next = NULL;
+        *dst_tail = c;
+        dst_tail = &c->next;
+        src = src->next;
+    }
+    t->columns = dst_head;
+    t->rows = NULL;
+    t->blocks = NULL;
+    t->dead_count = 0;
+    t->row_bytes = 0;
+    t->last_access = ++access_clock;
+    t->disk_path = NULL;
+    t->disk_offset = t->disk_len = t->disk_rows = 0;
+    t->disk_owned = t->disk_binary = 0;
+    t->disk_fp = NULL;
+    TABLE_CHANGED(t);
+    t->dicts = (struct Dict **)calloc(t->col_count ? t->col_count : 1, sizeof(struct Dict *));
+    // 带约束的列各建一个唯一索引
+    t->indexes = (struct HashIndex **)calloc(t->col_count ? t->col_count : 1, sizeof(struct HashIndex *));
+    t->index_count = 0;
+    t->text_indexes = NULL;
+    t->text_index_count = 0;
+    t->bitmaps = NULL;
+    t->bitmap_count = 0;
+    t->schema_version = 0;
+    t->layouts = NULL;
+    t->defaults = NULL;
+    t->sketches = NULL;
+    int idx = 0;
+    for (struct ColumnDef *c = t->columns; c; c = c->next, ++idx)
+    {
+        if (c->constraint == CONSTRAINT_NONE)
+            continue;
+        t->indexes[idx] = index_create(c->name, c->constraint == CONSTRAINT_PRIMARY_KEY);
+        ++t->index_count;
+    }
+    // 头插法插入表链表
+    t->next = current_db->tables;
+    current_db->tables = t;
+    stmt_wrote = 1;
+    DB_INFO("[DB] Create table: %s\n", name);
+    for (struct ColumnDef *c = t->columns; c; c = c->next)
+        DB_INFO("  Column: %s %s%s\n", c->name, c->type, constraint_suffix(c->constraint, 0));
+}
+
+// 在表的第col列上加文本索引：扩大已有行块的布隆过滤器并登记块内的字符串
+static void table_add_text_index(struct Table *t, int col, const char *name, int trigram)
+{
+    if (!t->text_indexes)
+        t->text_indexes = (struct TextIndex **)calloc(t->col_count ? t->col_count : 1, sizeof(struct TextIndex *));
+    struct TextIndex *tx = (struct TextIndex *)calloc(1, sizeof(struct TextIndex));
+    tx->name = strdup(name);
+    tx->trigram = trigram;
+    tx->slot = t->text_index_count++;
+    t->text_indexes[col] = tx;
+    for (struct Block *b = t->blocks; b; b = b->next)
+    {
+        b->bloom = (unsigned char *)realloc(b->bloom, t->text_index_count * BLOOM_BYTES);
+        memset(b->bloom + tx->slot * BLOOM_BYTES, 0, BLOOM_BYTES);
+    }
+    for (struct Row *r = t->rows; r; r = r->next)
+    {
+        struct Value *v = row_value(t, r, col);
+        if (v && !v->is_int && v->str_val)
+            bloom_add(r->block->bloom + tx->slot * BLOOM_BYTES, v->code);
+    }
+}
+
+// 在当前数据库中按名字查找文本索引
+static struct TextIndex *find_text_index(const char *name)
+{
+    for (struct Table *t = current_db->tables; t; t = t->next)
+        for (int i = 0; i < t->col_count && t->text_index_count; ++i)
+            if (t->text_indexes[i] && strcasecmp_dbms(t->text_indexes[i]->name, name) == 0)
+                return t->text_indexes[i];
+    return NULL;
+}
+
+// 在当前数据库中按名字查找位图索引
+static struct BitmapIndex *find_bitmap_index(const char *name)
+{
+    for (struct Table *t = current_db->tables; t; t = t->next)
+        for (int i = 0; i < t->col_count && t->bitmap_count; ++i)
+            if (t->bitmaps[i] && strcasecmp_dbms(t->bitmaps[i]->name, name) == 0)
+                return t->bitmaps[i];
+    return NULL;
+}
+
+// CREATE BITMAP INDEX：先登记所有行的键，列上不同的值太多时不建索引
+static void create_bitmap_index(struct Table *t, int idx, struct ColumnDef *c, const char *name)
+{
+    if (t->bitmaps && t->bitmaps[idx])
+    {
+        db_error("[DB] Column %s already has bitmap index %s\n", c->name, t->bitmaps[idx]->name);
+        return;
+    }
+    struct BitmapIndex *ix = bitmap_index_create(name);
+    for (struct Row *r = t->rows; r && ix->key_count <= BM_MAX_KEYS; r = r->next)
+        bitmap_key_id(ix, row_value(t, r, idx));
+    if (ix->key_count > BM_MAX_KEYS)
+    {
+        db_error("[DB] Too many distinct values for a bitmap index on %s (more than %d)\n", c->name, BM_MAX_KEYS);
+        bitmap_index_free(ix);
+        return;
+    }
+    txn_implicit_commit();
+    table_add_bitmap_index(t, idx, ix);
+    stmt_wrote = 1;
+    DB_INFO("[DB] Create bitmap index: %s on %s (%s), %d distinct values\n", name, t->name, c->name, ix->key_count);
+}
+
+// 创建索引：CREATE INDEX name ON table (col) [USING trigram] 建文本索引，
+// CREATE BITMAP INDEX name ON table (col)（即 USING bitmap）建位图索引
+void db_create_index(const char *name, const char *table, const char *col, const char *method)
+{
+    if (!current_db)
+    {
+        db_error("[DB] No database selected\n");
+        return;
+    }
+    struct Table *t = find_table(table);
+    if (!t)
+    {
+        db_error("[DB] Table not found: %s\n", table);
+        return;
+    }
+    int idx = col_index(t->columns, col);
+    if (idx < 0)
+    {
+        db_error("[DB] Column not found: %s\n", col);
+        return;
+    }
+    struct ColumnDef *c = t->columns;
+    for (int i = 0; i < idx; ++i)
+        c = c->next;
+    int bitmap = method && strcasecmp_dbms(method, "bitmap") == 0;
+    if (!bitmap && strncmp(c->type, "CHAR", 4) != 0)
+    {
+        db_error("[DB] Index requires a CHAR column: %s\n", col);
+        return;
+    }
+    if (method && !bitmap && strcasecmp_dbms(method, "trigram") != 0)
+    {
+        db_error("[DB] Unknown index method: %s\n", method);
+        return;
+    }
+    if (find_text_index(name) || find_bitmap_index(name))
+    {
+        db_error("[DB] Index exists: %s\n", name);
+        return;
+    }
+    if (bitmap)
+    {
+        create_bitmap_index(t, idx, c, name);
+        return;
+    }
+    if (t->text_indexes && t->text_indexes[idx])
+    {
+        db_error("[DB] Column %s already has index %s\n", col, t->text_indexes[idx]->name);
+        return;
+    }
+    txn_implicit_commit();
+    table_add_text_index(t, idx, name, method != NULL);
+    text_index_refresh(t->text_indexes[idx], t->dicts[idx]);
+    stmt_wrote = 1;
+    DB_INFO("[DB] Create index: %s on %s (%s)%s\n", name, t->name, c->name, method ? " using trigram" : "");
+}
+
+// ALTER TABLE 的公共检查，通过时返回表
+static struct Table *alter_find_table(const char *table)
+{
+    if (!current_db)
+    {
+        db_error("[DB] No database selected\n");
+        return NULL;
+    }
+    if (cursor_pins)
+    {
+        db_error("[DB] Cannot ALTER while a cursor is open\n");
+        return NULL;
+    }
+    struct Table *t = find_table(table);
+    if (!t)
+        db_error("[DB] Table not found: %s\n", table);
+    return t;
+}
+
+// 开始一个新的结构版本：当前版本的行按 map 取值（当前列下标 -> 行中位置），调用者已相应修改旧版本的映射
+static void table_push_layout(struct Table *t, int *map)
+{
+    altered_tables += t->schema_version == 0;
+    t->layouts = (int **)realloc(t->layouts, sizeof(int *) * (t->schema_version + 1));
+    t->layouts[t->schema_version++] = map;
+}
+
+// ALTER TABLE t ADD [COLUMN] col type [DEFAULT v]：已有的行不改写，读取时新列取默认值
+void db_alter_add_column(const char *table, struct ColumnDef *col)
+{
+    struct Table *t = alter_find_table(table);
+    if (!t)
+        return;
+    if (col_index(t->columns, col->name) >= 0)
+    {
+        db_error("[DB] Column exists: %s\n", col->name);
+        return;
+    }
+    if (col->constraint != CONSTRAINT_NONE)
+    {
+        // 已有的行在新列上都是默认值，无法满足唯一约束
+        db_error("[DB] Cannot add a %s column to an existing table\n", constraint_suffix(col->constraint, 0) + 1);
+        return;
+    }
+    if (column_default_mismatch(col))
+    {
+        db_error("[DB] Type mismatch for column %s\n", col->name);
+        return;
+    }
+    txn_implicit_commit();
+    long rows = t->row_bytes / ROW_BYTES(t);
+    int n = t->col_count;
+    // 旧版本的行都没有新列
+    for (int v = 0; v < t->schema_version; ++v)
+    {
+        t->layouts[v] = (int *)realloc(t->layouts[v], sizeof(int) * (n + 1));
+        t->layouts[v][n] = -1;
+    }
+    int *map = (int *)malloc(sizeof(int) * (n + 1));
+    for (int i = 0; i < n; ++i)
+        map[i] = i;
+    map[n] = -1;
+    table_push_layout(t, map);
+    struct ColumnDef **tail = &t->columns;
+    while (*tail)
+        tail = &(*tail)->next;
+    struct ColumnDef *c = (struct ColumnDef *)malloc(sizeof(struct ColumnDef));
+    c->name = strdup(col->name);
+    c->type = strdup(col->type);
+    c->constraint = CONSTRAINT_NONE;
+    c->def = copy_value(col->def);
+    c->next = NULL;
+    *tail = c;
+    table_free_defaults(t);
+    table_free_sketches(t);
+    t->col_count = n + 1;
+    t->dicts = (struct Dict **)realloc(t->dicts, sizeof(struct Dict *) * (n + 1));
+    t->dicts[n] = NULL;
+    t->indexes = (struct HashIndex **)realloc(t->indexes, sizeof(struct HashIndex *) * (n + 1));
+    t->indexes[n] = NULL;
+    if (t->text_indexes)
+    {
+        t->text_indexes = (struct TextIndex **)realloc(t->text_indexes, sizeof(struct TextIndex *) * (n + 1));
+        t->text_indexes[n] = NULL;
+    }
+    if (t->bitmaps)
+    {
+        t->bitmaps = (struct BitmapIndex **)realloc(t->bitmaps, sizeof(struct BitmapIndex *) * (n + 1));
+        t->bitmaps[n] = NULL;
+    }
+    // 已有的块中新列都是默认值
+    struct Value *d = table_default(t, n);
+    for (struct Block *b = t->blocks; b; b = b->next)
+    {
+        b->zones = (struct Zone *)realloc(b->zones, sizeof(struct Zone) * (n + 1));
+        b->zones[n].min = d->is_int ? d->int_val : INT_MAX;
+        b->zones[n].max = d->is_int ? d->int_val : INT_MIN;
+    }
+    t->row_bytes = rows * ROW_BYTES(t);
+    TABLE_CHANGED(t);
+    stmt_wrote = 1;
+    DB_INFO("[DB] Alter table %s: add column %s %s (schema version %d)\n", t->name, c->name, c->type, t->schema_version);
+}
+
+// ALTER TABLE t DROP [COLUMN] col：已有的行不改写，读取时跳过被删除的列
+void db_alter_drop_column(const char *table, const char *col)
+{
+    struct Table *t = alter_find_table(table);
+    if (!t)
+        return;
+    int j = col_index(t->columns, col);
+    if (j < 0)
+    {
+        db_error("[DB] Column not found: %s\n", col);
+        return;
+    }
+    if (t->col_count == 1)
+    {
+        db_error("[DB] Cannot drop the only column of table %s\n", t->name);
+        return;
+    }
+    txn_implicit_commit();
+    long rows = t->row_bytes / ROW_BYTES(t);
+    int n = t->col_count - 1;
+    for (int v = 0; v < t->schema_version; ++v)
+        memmove(t->layouts[v] + j, t->layouts[v] + j + 1, sizeof(int) * (n - j));
+    int *map = (int *)malloc(sizeof(int) * n);
+    for (int i = 0; i < n; ++i)
+        map[i] = i < j ? i : i + 1;
+    table_push_layout(t, map);
+    struct ColumnDef **p = &t->columns;
+    for (int i = 0; i < j; ++i)
+        p = &(*p)->next;
+    struct ColumnDef *c = *p;
+    *p = c->next;
+    c->next = NULL;
+    table_free_defaults(t);
+    table_free_sketches(t);
+    // 旧版本的行中被删除列的值不再读取，字符串随列字典一起释放
+    dict_free(t->dicts[j]);
+    if (t->indexes[j])
+    {
+        index_free(t->indexes[j]);
+        --t->index_count;
+    }
+    struct TextIndex *tx = t->text_indexes ? t->text_indexes[j] : NULL;
+    if (tx)
+    {
+        // 后面的文本索引的布隆过滤器前移一格
+        int slot = tx->slot;
+        text_index_free(tx);
+        t->text_indexes[j] = NULL;
+        --t->text_index_count;
+        for (int i = 0; i <= n; ++i)
+            if (t->text_indexes[i] && t->text_indexes[i]->slot > slot)
+                --t->text_indexes[i]->slot;
+        for (struct Block *b = t->blocks; b; b = b->next)
+            memmove(b->bloom + slot * BLOOM_BYTES, b->bloom + (slot + 1) * BLOOM_BYTES,
+                    (t->text_index_count - slot) * BLOOM_BYTES);
+    }
+    struct BitmapIndex *bx = t->bitmaps ? t->bitmaps[j] : NULL;
+    if (bx)
+    {
+        // 后面的位图索引在行块中的容器前移一格，没有位图索引后释放行序号表
+        int slot = bx->slot;
+        for (struct Block *b = t->blocks; b; b = b->next)
+        {
+            block_bitmap_release(&b->bitmaps[slot]);
+            memmove(b->bitmaps + slot, b->bitmaps + slot + 1, (t->bitmap_count - 1 - slot) * sizeof(struct BlockBitmap));
+            if (t->bitmap_count == 1)
+                block_bitmaps_free(b, 0);
+        }
+        bitmap_index_free(bx);
+        t->bitmaps[j] = NULL;
+        --t->bitmap_count;
+        for (int i = 0; i <= n; ++i)
+            if (t->bitmaps[i] && t->bitmaps[i]->slot > slot)
+                --t->bitmaps[i]->slot;
+    }
+    memmove(t->dicts + j, t->dicts + j + 1, sizeof(struct Dict *) * (n - j));
+    memmove(t->indexes + j, t->indexes + j + 1, sizeof(struct HashIndex *) * (n - j));
+    if (t->text_indexes)
+        memmove(t->text_indexes + j, t->text_indexes + j + 1, sizeof(struct TextIndex *) * (n - j));
+    if (t->bitmaps)
+        memmove(t->bitmaps + j, t->bitmaps + j + 1, sizeof(struct BitmapIndex *) * (n - j));
+    for (struct Block *b = t->blocks; b; b = b->next)
+        memmove(b->zones + j, b->zones + j + 1, sizeof(struct Zone) * (n - j));
+    t->col_count = n;
+    t->row_bytes = rows * ROW_BYTES(t);
+    TABLE_CHANGED(t);
+    stmt_wrote = 1;
+    DB_INFO("[DB] Alter table %s: drop column %s (schema version %d)\n", t->name, c->name, t->schema_version);
+    free_column_defs(c);
+}
+
+// 删除表及其所有数据
+void db_drop_table(const char *name)
+{
+    if (!current_db)
+    {
+        db_error("[DB] No database selected\n");
+        return;
+    }
+    if (cursor_pins)
+    {
+        db_error("[DB] Cannot DROP while a cursor is open\n");
+        return;
+    }
+    struct Table **p = &current_db->tables;
+    while (*p)
+    {
+        if (strcasecmp_dbms((*p)->name, name) == 0)
+        {
+            txn_implicit_commit();
+            struct Table *del = *p;
+            *p = del->next; // 从链表中移除
+            free_table(del);
+            stmt_wrote = 1;
+            DB_INFO("[DB] Drop table: %s\n", name);
+            return;
+        }
+        p = &((*p)->next);
+    }
+    db_error("[DB] Table not found: %s\n", name);
+}
+
+// 按表定义顺序拷贝一行的值，不足的列补默认值，返回新的值链表
+static struct Value *table_row_values(struct Table *t, struct Value *vt)
+{
+    struct Value *newvals = NULL, **tail = &newvals;
+    struct Value *v = vt;
+    int idx = 0;
+    for (struct ColumnDef *c = t->columns; c; c = c->next, ++idx)
+    {
+        struct Value *nv;
+        if (v)
+        {
+            nv = table_copy_value(t, idx, v); // 拷贝值，字符串存入列字典
+            v = v->next;
+        }
+        else
+        {
+            // 不足的列补默认值
+            nv = (struct Value *)db_alloc(sizeof(struct Value));
+            *nv = *table_default(t, idx);
+        }
+        nv->next = NULL;
+        *tail = nv;
+        tail = &nv->next;
+    }
+    return newvals;
+}
+
+// 向指定表插入一行数据，违反唯一约束时报错
+// table: 表名
+// cols: 指定插入的列名链表（可为NULL，表示所有列顺序插入）
+// values: 插入的值链表
+void db_insert(const char *table, struct ColumnList *cols, struct Value *values)
+{
+    db_upsert(table, cols, values, CONFLICT_ERROR, NULL);
+}
+
+// ================== 近似聚合 ==================
+// 第idx列维护的草图：第一次使用时扫描全表建立，之后由插入和更新增量维护（block_widen）。
+// 删除不从草图中减去，估计值可能偏大，直到 VACUUM 回收了行后重建
+static struct Sketch *table_sketch(struct Table *t, int idx)
+{
+    if (!t->sketches)
+        t->sketches = (struct Sketch **)calloc(t->col_count ? t->col_count : 1, sizeof(struct Sketch *));
+    if (!t->sketches[idx])
+    {
+        struct Sketch *sk = (struct Sketch *)calloc(1, sizeof(struct Sketch));
+        for (struct Row *r = t->rows; r; r = r->next)
+            if (!r->dead)
+                hll_add(sk, row_value(t, r, idx));
+        t->sketches[idx] = sk;
+    }
+    return t->sketches[idx];
+}
+
+// SELECT APPROX_COUNT_DISTINCT(c), ... FROM t [TABLESAMPLE SYSTEM (p)] [WHERE ...]：输出一行估计值
+// 没有WHERE和抽样时直接读各列维护的草图，耗时与表的行数无关；
+// 否则扫描（抽中的块中）满足条件的行，临时建草图，抽样时估计的是样本中不同值的个数
+static int select_approx(struct Table *t, int table_count, struct SelectList *sel, struct Condition *cond, int sample)
+{
+    int n = 0, cols[64];
+    for (struct SelectList *s = sel; s; s = s->next)
+    {
+        const char *err = NULL;
+        if (table_count > 1)
+            err = "APPROX_COUNT_DISTINCT requires a single table";
+        else if (s->agg == AGG_NONE)
+            err = "cannot mix APPROX_COUNT_DISTINCT with plain columns";
+        else if (n == 64)
+            err = "too many columns";
+        else if ((cols[n++] = col_index(t->columns, s->name)) < 0)
+            err = "column not found";
+        if (err)
+        {
+            db_error("[DB] Select failed: %s (%s)\n", err, s->name);
+            stage_count = 0;
+            return -1;
+        }
+    }
+    struct Sketch *sk[64];
+    int maintained = !cond && !sample;
+    long scanned = 0, matched = 0;
+    struct ExecStage *st;
+    if (maintained)
+    {
+        st = stage_begin("HyperLogLog sketches");
+        for (int i = 0; i < n; ++i)
+            sk[i] = table_sketch(t, cols[i]);
+        stage_end(st, n, n);
+    }
+    else
+    {
+        st = stage_begin("Bind condition");
+        bind_condition(cond, &t, 1);
+        stage_end(st, 0, 0);
+        for (int i = 0; i < n; ++i)
+            sk[i] = (struct Sketch *)calloc(1, sizeof(struct Sketch));
+        struct Scan scan;
+        scan_begin(&scan, t, cond);
+        if (sample)
+            scan_sample(&scan, t, sample);
+        char name[64];
+        scan_stage_name(&scan, t, "HyperLogLog", name, sizeof(name));
+        st = stage_begin(name);
+        for (struct Row *r; (r = scan_next(&scan));)
+        {
+            ++scanned;
+            if (!row_match(r, scan.filter))
+                continue;
+            ++matched;
+            for (int i = 0; i < n; ++i)
+                hll_add(sk[i], row_value(t, r, cols[i]));
+        }
+        stage_end(st, scanned, matched);
+        scan_report(&scan);
+        stats_add_rows_read(scanned);
+        if (stmt_cancel_reason)
+        {
+            for (int i = 0; i < n; ++i)
+                free(sk[i]);
+            stmt_cancel_report("Select", matched, 0);
+            stage_count = 0;
+            return -1;
+        }
+    }
+    // 列名比默认列宽长，按列名加宽，列之间留一个空格
+    char head[96];
+    int width[64], i = 0;
+    for (struct SelectList *s = sel; s; s = s->next, ++i)
+    {
+        snprintf(head, sizeof(head), "APPROX_COUNT_DISTINCT(%s)", s->name);
+        width[i] = (int)strlen(head) + 1 > 12 ? (int)strlen(head) + 1 : 12;
+        out_printf("%*s", width[i], head);
+    }
+    out_printf("\n");
+    for (i = 0; i < n; ++i)
+    {
+        out_printf("%*ld", width[i], (long)(hll_estimate(sk[i]) + 0.5));
+        if (!maintained)
+            free(sk[i]);
+    }
+    out_printf("\n");
+    if (explain_mode == EXPLAIN_ANALYZE)
+        print_stages("SELECT");
+    stage_count = 0;
+    return 0;
+}
+
+// 执行已解析出表指针的select语句，结果通过out_printf输出
+// 返回0表示成功，-1表示出错（出错时的结果不缓存）
+static int select_exec(struct Table **table_arr, int table_count, struct SelectList *sel, struct Condition *cond,
+                       int sample)
+{
+    if (explain_mode == EXPLAIN_PLAN)
+    {
+        explain_select(table_arr, table_count, sel, cond, sample);
+        return 0;
+    }
+    if (sel_has_agg(sel))
+        return select_approx(table_arr[0], table_count, sel, cond, sample);
+    struct Row *rows[8]; // 存放每个表当前枚举到的行
+    struct ExecStage *st = stage_begin("Bind condition");
+    bind_condition(cond, table_arr, table_count);
+    stage_end(st, 0, 0);
+    output_us = 0;
+    if (table_count > 1)
+    {
+        struct FieldRef field_refs[64]; // 存放多表多字段选择的字段映射
+        int field_count = 0;
+        join_combos = join_matched = 0;
+        memset(join_scanned, 0, sizeof(join_scanned));
+        st = stage_begin("NestedLoopJoin");
+        if (sel)
+        {
+            // 构建字段映射：确定每个字段属于哪个表及其列索引
+            for (struct SelectList *s = sel; s; s = s->next)
+            {
+                int found = 0;
+                for (int i = 0; i < table_count; ++i)
+                {
+                    int idx = col_index(table_arr[i]->columns, s->name);
+                    if (idx >= 0)
+                    {
+                        field_refs[field_count].table_idx = i;
+                        field_refs[field_count].col_idx = idx;
+                        field_refs[field_count].name = s->name;
+                        ++field_count;
+                        found = 1;
+                        break;
+                    }
+                }
+                if (!found)
+                {
+                    db_error("Field not found: %s\n", s->name);
+                    stage_count = 0;
+                    return -1;
+                }
+            }
+            // 打印表头
+            for (int i = 0; i < field_count; ++i)
+                out_printf("%12s", field_refs[i].name);
+            out_printf("\n");
+            // 递归枚举所有表的行组合并输出指定字段
+            print_rows_multi_sel(0, rows, table_count, table_arr, cond, field_refs, field_count);
+        }
+        else
+        {
+            // select *，输出所有表所有字段
+            for (int i = 0; i < table_count; ++i)
+                for (struct ColumnDef *c = table_arr[i]->columns; c; c = c->next)
+                    out_printf("%12s", c->name);
+            out_printf("\n");
+            // 递归枚举所有表的行组合并输出
+            print_rows_multi(0, rows, table_count, table_arr, cond);
+        }
+        for (int i = 0; i < table_count; ++i)
+            stats_add_rows_read(join_scanned[i]);
+        if (stmt_cancel_reason)
+        {
+            stmt_cancel_report("Select", join_matched, 0);
+            stage_count = 0;
+            return -1;
+        }
+        if (explain_mode == EXPLAIN_ANALYZE)
+        {
+            stage_end(st, join_combos, join_matched);
+            st->time_us -= output_us;
+            // 各层扫描只统计行数，耗时计入连接阶段
+            for (int i = 0; i < table_count; ++i)
+            {
+                char name[64];
+                snprintf(name, sizeof(name), "  SeqScan %s (level %d)", table_arr[i]->name, i);
+                struct ExecStage *scan = stage_begin(name);
+                stage_end(scan, join_scanned[i], join_scanned[i]);
+                scan->time_us = 0;
+            }
+            struct ExecStage *out = stage_begin("Output");
+            stage_end(out, join_matched, join_matched);
+            out->time_us = output_us;
+            print_stages("SELECT");
+        }
+        stage_count = 0;
+        return 0;
+    }
+    // 单表，支持字段和where
+    struct Table *t = table_arr[0];
+    long scanned = 0, matched = 0;
+    // 打印表头
+    if (!sel)
+    {
+        for (struct ColumnDef *c = t->columns; c; c = c->next)
+            out_printf("%12s", c->name);
+    }
+    else
+    {
+        for (struct SelectList *s = sel; s; s = s->next)
+            out_printf("%12s", s->name);
+    }
+    out_printf("\n");
+    // 条件中有唯一索引列的等值比较时只需检查索引命中的一行，否则跳过区域映射排除的块
+    struct Scan scan;
+    scan_begin(&scan, t, cond);
+    if (sample)
+        scan_sample(&scan, t, sample);
+    char name[64];
+    scan_stage_name(&scan, t, "Filter", name, sizeof(name));
+    st = stage_begin(name);
+    // 打印数据
+    for (struct Row *r; (r = scan_next(&scan));)
+    {
+        ++scanned;
+        if (!row_match(r, scan.filter))
+            continue;
+        ++matched;
+        double t0 = explain_mode == EXPLAIN_ANALYZE ? db_now_us() : 0;
+        if (!sel)
+        {
+            // 输出所有字段
+            if (ROW_CURRENT(t, r))
+                for (struct Value *v = r->values; v; v = v->next)
+                    print_value(v);
+            else
+                for (int i = 0; i < t->col_count; ++i)
+                    print_value(row_value(t, r, i));
+        }
+        else
+        {
+            // 只输出指定字段
+            for (struct SelectList *s = sel; s; s = s->next)
+            {
+                int idx = col_index(t->columns, s->name);
+                print_value(idx >= 0 ? row_value(t, r, idx) : NULL);
+            }
+        }
+        out_printf("\n");
+        if (explain_mode == EXPLAIN_ANALYZE)
+            output_us += db_now_us() - t0;
+    }
+    stats_add_rows_read(scanned);
+    if (stmt_cancel_reason)
+    {
+        stmt_cancel_report("Select", matched, 0);
+        stage_count = 0;
+        return -1;
+    }
+    if (explain_mode == EXPLAIN_ANALYZE)
+    {
+        stage_end(st, scanned, matched);
+        st->time_us -= output_us;
+        scan_report(&scan);
+        struct ExecStage *out = stage_begin("Output");
+        stage_end(out, matched, matched);
+        out->time_us = output_us;
+        print_stages("SELECT");
+    }
+    stage_count = 0;
+    return 0;
+}
+
+// 执行select语句，支持单表/多表、字段选择、where条件
+// tables: 表名链表
+// sel: 字段名链表（为NULL表示select *）
+// cond: where条件表达式
+// 开启查询缓存时，相同数据库下相同文本的查询在涉及的表未被修改时直接输出缓存结果
+void db_select(struct ColumnList *tables, struct SelectList *sel, struct Condition *cond)
+{
+    int table_count = 0;
+    struct Table *table_arr[8];
+    struct ColumnList *tl = tables;
+    // 解析表名链表，查找所有表指针
+    while (tl && table_count < 8)
+    {
+        struct Table *t = find_table(tl->name);
+        if (!t)
+        {
+            db_error("[DB] Table not found: %s\n", tl->name);
+            return;
+        }
+        table_arr[table_count++] = t;
+        if (tl->sample && tables->next)
+        {
+            db_error("[DB] TABLESAMPLE is only supported on a single table\n");
+            return;
+        }
+        tl = tl->next;
+    }
+    if (table_count == 0)
+    {
+        db_error("[DB] No table specified\n");
+        return;
+    }
+    // 抽样的结果每次不同，不进查询缓存
+    int sample = tables->sample;
+    if (cache_limit == 0 || !stmt_text || explain_mode != EXPLAIN_NONE || quiet == QUIET_SILENT ||
+        cond_has_subquery(cond) || sample)
+    {
+        select_exec(table_arr, table_count, sel, cond, sample);
+        return;
+    }
+    char *key = cache_key(stmt_text);
+    unsigned int hash = cache_hash(key);
+    struct CacheEntry *e = cache_lookup(key, hash);
+    if (e)
+    {
+        ++cache_hits;
+        lru_unlink(e);
+        lru_push_front(e);
+        fwrite(e->out, 1, e->out_len, stdout);
+        free(key);
+        return;
+    }
+    ++cache_misses;
+    capture.len = 0;
+    capture.active = 1;
+    int rc = select_exec(table_arr, table_count, sel, cond, 0);
+    if (capture.active)
+    {
+        capture.active = 0;
+        fwrite(capture.data, 1, capture.len, stdout);
+        if (rc == 0)
+        {
+            cache_store(key, hash, table_arr, table_count);
+            key = NULL;
+        }
+    }
+    free(key);
+}
+
+// SET项的执行计划：目标列下标和已解析的右侧表达式
+struct SetPlan
+{
+    int idx;           // 目标列下标
+    struct Expr *expr; // 右侧表达式（列引用已绑定）
+    int is_int;        // 表达式结果类型
+    char *str;         // 字符串常量：已存入目标列字典的字符串
+    int code;          // 字符串常量的等价类编号
+};
+
+// 列类型是否为字符串（忽略大小写）
+static int type_is_char(const char *type)
+{
+    const char *kw = "char";
+    for (int i = 0; i < 4; ++i)
+    {
+        char c = type[i];
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if (c != kw[i])
+            return 0;
+    }
+    return 1;
+}
+
+// 第idx列的类型是否为字符串
+static int column_is_char(struct Table *t, int idx)
+{
+    struct ColumnDef *c = t->columns;
+    for (int i = 0; i < idx && c; ++i)
+        c = c->next;
+    return c && type_is_char(c->type);
+}
+
+// 绑定表达式中的列引用并推导结果类型：1为整数，0为字符串，-1为错误
+// 字符串只能作为整个表达式出现（常量或列引用），不能参与运算
+// excluded非0时允许 EXCLUDED.col，绑定到求值数组中表的列之后的第col_count+列下标项
+static int bind_expr(struct Table *t, struct Expr *e, int excluded, int *fallible)
+{
+    if (e->kind == EXPR_CONST)
+        return e->value->is_int;
+    if (e->kind == EXPR_COL || e->kind == EXPR_EXCLUDED)
+    {
+        if (e->kind == EXPR_EXCLUDED && !excluded)
+        {
+            db_error("[DB] EXCLUDED.%s is only allowed in ON CONFLICT DO UPDATE\n", e->col);
+            return -1;
+        }
+        int idx = col_index(t->columns, e->col);
+        if (idx < 0)
+        {
+            db_error("[DB] Column not found: %s\n", e->col);
+            return -1;
+        }
+        e->col_idx = e->kind == EXPR_EXCLUDED ? t->col_count + idx : idx;
+        return !column_is_char(t, idx);
+    }
+    int l = bind_expr(t, e->left, excluded, fallible);
+    int r = l < 0 ? -1 : bind_expr(t, e->right, excluded, fallible);
+    if (l < 0 || r < 0)
+        return -1;
+    if (!l || !r)
+    {
+        db_error("[DB] Arithmetic '%c' on CHAR value\n", e->op);
+        return -1;
+    }
+    if (e->op == '/' || e->op == '%')
+        *fallible = 1;
+    return 1;
+}
+
+// 解析一个SET项：目标列、表达式类型检查、字符串常量一次存入列字典
+static int bind_set_item(struct Table *t, struct SetItem *s, struct SetPlan *p, int excluded, int *fallible)
+{
+    p->idx = col_index(t->columns, s->col);
+    if (p->idx < 0)
+    {
+        db_error("[DB] Column not found: %s\n", s->col);
+        return -1;
+    }
+    p->expr = s->expr;
+    p->is_int = bind_expr(t, s->expr, excluded, fallible);
+    if (p->is_int < 0)
+        return -1;
+    if (p->is_int == column_is_char(t, p->idx))
+    {
+        db_error("[DB] Type mismatch for column %s\n", s->col);
+        return -1;
+    }
+    p->str = NULL;
+    p->code = -1;
+    if (s->expr->kind == EXPR_CONST && !p->is_int)
+    {
+        struct Value tmp;
+        table_set_str(t, p->idx, &tmp, s->expr->value->str_val);
+        p->str = tmp.str_val;
+        p->code = tmp.code;
+    }
+    return 0;
+}
+
+// 计算整数表达式，出错时返回错误信息
+// 整数列中以字符串形式插入的值按atoi转换
+static const char *eval_int_expr(struct Expr *e, struct Value **vals, int *out)
+{
+    if (e->kind == EXPR_CONST)
+    {
+        *out = e->value->int_val;
+        return NULL;
+    }
+    if (e->kind == EXPR_COL || e->kind == EXPR_EXCLUDED)
+    {
+        struct Value *v = vals[e->col_idx];
+        *out = !v ? 0 : v->is_int ? v->int_val : (v->str_val ? atoi(v->str_val) : 0);
+        return NULL;
+    }
+    int l, r;
+    const char *err = eval_int_expr(e->left, vals, &l);
+    if (!err)
+        err = eval_int_expr(e->right, vals, &r);
+    if (err)
+        return err;
+    // 按无符号运算，溢出时回绕而不是未定义行为
+    switch (e->op)
+    {
+    case '+':
+        *out = (int)((unsigned)l + (unsigned)r);
+        break;
+    case '-':
+        *out = (int)((unsigned)l - (unsigned)r);
+        break;
+    case '*':
+        *out = (int)((unsigned)l * (unsigned)r);
+        break;
+    default:
+        if (r == 0)
+            return "division by zero";
+        if (r == -1)
+            *out = e->op == '/' ? (int)(0u - (unsigned)l) : 0;
+        else
+            *out = e->op == '/' ? l / r : l % r;
+        break;
+    }
+    return NULL;
+}
+
+// 按一行的旧值计算SET项的新值
+static const char *eval_set_item(struct Table *t, struct SetPlan *p, struct Value **vals, struct Value *out)
+{
+    out->is_int = p->is_int;
+    if (p->is_int)
+        return eval_int_expr(p->expr, vals, &out->int_val);
+    if (p->expr->kind == EXPR_CONST)
+    {
+        out->str_val = p->str;
+        out->code = p->code;
+        return NULL;
+    }
+    // 列拷贝：同一列直接共享字典字符串，不同列需存入目标列字典
+    struct Value *src = vals[p->expr->col_idx];
+    if (!src || src->is_int)
+    {
+        out->str_val = NULL;
+        out->code = -1;
+    }
+    else if (p->expr->col_idx == p->idx)
+    {
+        out->str_val = src->str_val;
+        out->code = src->code;
+    }
+    else
+        table_set_str(t, p->idx, out, src->str_val);
+    return NULL;
+}
+
+// 解析所有SET项，返回执行计划（由调用者free），出错返回NULL
+// *reindex 返回SET是否涉及唯一索引列
+static struct SetPlan *bind_set_plan(struct Table *t, struct SetItem *set, int excluded, int *set_count, int *fallible,
+                                     int *reindex)
+{
+    *set_count = 0;
+    for (struct SetItem *s = set; s; s = s->next)
+        ++*set_count;
+    struct SetPlan *plan = (struct SetPlan *)malloc(sizeof(struct SetPlan) * (*set_count ? *set_count : 1));
+    *fallible = *reindex = 0;
+    int i = 0;
+    for (struct SetItem *s = set; s; s = s->next, ++i)
+    {
+        if (bind_set_item(t, s, &plan[i], excluded, fallible) < 0)
+        {
+            free(plan);
+            return NULL;
+        }
+        if (t->index_count && t->indexes[plan[i].idx])
+            *reindex = 1;
+    }
+    return plan;
+}
+
+// 把计算好的SET结果写入一行（vals为该行各列的值）
+static void apply_set(struct SetPlan *plan, int set_count, struct Value **vals, struct Value *res)
+{
+    for (int i = 0; i < set_count; ++i)
+    {
+        struct Value *v = vals[plan[i].idx];
+        if (!v || v->is_int != res[i].is_int)
+            continue; // 与原值类型不同的字段保持不变
+        // 原地修改：整数直接赋值，字符串只替换字典中的指针和等价类编号
+        if (v->is_int)
+            v->int_val = res[i].int_val;
+        else
+        {
+            v->str_val = res[i].str_val;
+            v->code = res[i].code;
+        }
+    }
+}
+
+// 修改了唯一索引列的行在修改前已从索引中移除，全部修改完后逐行检查并重新登记
+// 因此 SET id = id + 1 这类整体平移不会与尚未修改的行冲突；有冲突时返回错误信息
+static const char *reindex_rows(struct Table *t, struct Row **rows, long n, struct Value **vals)
+{
+    for (long k = 0; k < n; ++k)
+    {
+        struct Row *conflict;
+        row_value_array(rows[k]->values, vals, t->col_count);
+        const char *err = table_index_check(t, vals, rows[k], &conflict);
+        if (err)
+            return err;
+        table_index_row(t, rows[k]);
+    }
+    return NULL;
+}
+
+// 执行update语句，按条件批量更新
+// table: 表名
+// set: 要更新的字段及新值链表
+// cond: where条件表达式
+void db_update(const char *table, struct SetItem *set, struct Condition *cond)
+{
+    struct Table *t = find_table(table);
+    if (!t)
+    {
+        db_error("[DB] Table not found: %s\n", table);
+        return;
+    }
+    if (explain_mode == EXPLAIN_PLAN)
+    {
+        printf("[EXPLAIN] UPDATE\n  -> Update: %s (", t->name);
+        for (struct SetItem *s = set; s; s = s->next)
+            printf("%s%s", s->col, s->next ? ", " : ")\n");
+        explain_scan(t, cond, "     ");
+        return;
+    }
+    if (mem_check_write(t) < 0)
+        return;
+    long scanned = 0, matched = 0;
+    struct ExecStage *st = stage_begin("Bind condition");
+    bind_condition(cond, &t, 1);
+    // SET项的列下标、表达式中的列引用和字符串常量在语句开始时一次解析
+    int set_count, fallible, reindex, i;
+    struct SetPlan *plan = bind_set_plan(t, set, 0, &set_count, &fallible, &reindex);
+    if (!plan)
+    {
+        stage_count = 0;
+        return;
+    }
+    stage_end(st, 0, 0);
+    // 除法/取模可能在中途出错，修改唯一索引列可能违反约束，语句可能被取消，
+    // 此时即使不在事务中也记录前像，出错后整条语句回滚
+    struct UndoRec *savepoint = undo_log;
+    int keep_undo = txn_active || fallible || reindex || stmt_checking;
+    struct Value **vals = (struct Value **)malloc(sizeof(struct Value *) * t->col_count);
+    struct Value *res = (struct Value *)malloc(sizeof(struct Value) * set_count);
+    struct Row **moved = NULL; // 从索引中移除、待重新登记的行
+    long moved_cap = 0;
+    const char *err = NULL;
+    struct Scan scan;
+    scan_begin(&scan, t, cond);
+    char name[64];
+    scan_stage_name(&scan, t, "Filter + Update", name, sizeof(name));
+    st = stage_begin(name);
+    // 遍历候选行，判断是否满足条件
+    for (struct Row *r; (r = scan_next(&scan));)
+    {
+        ++scanned;
+        if (!row_match(r, scan.filter))
+            continue;
+        // 旧结构版本的行先改写为当前结构，再一次遍历取出本行所有字段
+        row_upgrade(t, r);
+        row_value_array(r->values, vals, t->col_count);
+        // 先按旧值计算所有右侧表达式，再统一赋值（SET a = b, b = a 交换两列）
+        for (i = 0; i < set_count && !err; ++i)
+            err = eval_set_item(t, &plan[i], vals, &res[i]);
+        if (err)
+            break;
+        if (keep_undo)
+            undo_push(UNDO_UPDATE, t, r);
+        if (reindex)
+        {
+            if (matched == moved_cap)
+            {
+                moved_cap = moved_cap ? moved_cap * 2 : 16;
+                moved = (struct Row **)realloc(moved, sizeof(struct Row *) * moved_cap);
+            }
+            moved[matched] = r;
+            table_unindex_row(t, r);
+        }
+        ++matched;
+        apply_set(plan, set_count, vals, res);
+        block_widen(t, r);
+    }
+    if (!err && reindex && !stmt_cancel_reason)
+        err = reindex_rows(t, moved, matched, vals);
+    free(moved);
+    free(vals);
+    free(res);
+    free(plan);
+    if (!err && stmt_cancel_reason)
+    {
+        stage_count = 0;
+        undo_apply(savepoint);
+        stats_add_rows_read(scanned);
+        stmt_cancel_report("Update", matched, 1);
+        return;
+    }
+    if (err)
+    {
+        stage_end(st, scanned, matched);
+        stage_count = 0;
+        undo_apply(savepoint);
+        db_error("[DB] Update failed: %s, no rows changed\n", err);
+        return;
+    }
+    if (!txn_active)
+        undo_discard(savepoint);
+    stage_end(st, scanned, matched);
+    scan_report(&scan);
+    stats_add_rows_read(scanned);
+    stats_add_rows_written(matched);
+    if (matched)
+    {
+        stmt_wrote = 1;
+        TABLE_CHANGED(t);
+    }
+    DB_INFO("[DB] Update %s\n", table);
+    if (explain_mode == EXPLAIN_ANALYZE)
+        print_stages("UPDATE");
+    stage_count = 0;
+}
+
+// ON CONFLICT DO UPDATE：对冲突的已有行执行SET，返回0表示成功
+// vals有2*col_count项，后半部分为因冲突未插入的值（EXCLUDED.col），前半部分在这里填入已有行的值
+static int upsert_update(struct Table *t, struct Row *r, struct SetItem *set, struct Value **vals)
+{
+    int set_count, fallible, reindex;
+    struct SetPlan *plan = bind_set_plan(t, set, 1, &set_count, &fallible, &reindex);
+    if (!plan)
+        return -1;
+    row_upgrade(t, r);
+    row_value_array(r->values, vals, t->col_count);
+    struct Value *res = (struct Value *)malloc(sizeof(struct Value) * (set_count ? set_count : 1));
+    const char *err = NULL;
+    for (int i = 0; i < set_count && !err; ++i)
+        err = eval_set_item(t, &plan[i], vals, &res[i]);
+    if (!err)
+    {
+        // 只修改一行，总是记录前像：修改唯一索引列违反约束时据此恢复
+        struct UndoRec *savepoint = undo_log;
+        undo_push(UNDO_UPDATE, t, r);
+        if (reindex)
+            table_unindex_row(t, r);
+        apply_set(plan, set_count, vals, res);
+        block_widen(t, r);
+        if (reindex)
+            err = reindex_rows(t, &r, 1, vals);
+        if (err)
+            undo_apply(savepoint);
+        else if (!txn_active)
+            undo_discard(savepoint);
+    }
+    free(res);
+    free(plan);
+    if (err)
+    {
+        db_error("[DB] Insert into %s failed: %s\n", t->name, err);
+        return -1;
+    }
+    TABLE_CHANGED(t);
+    stmt_wrote = 1;
+    if (!loading)
+        stats_add_rows_written(1);
+    return 0;
+}
+
+// 把已拷贝到表中的值链表作为新行插入，调用者已检查过唯一约束
+static struct Row *table_add_row(struct Table *t, struct Value *newvals)
+{
+    // 创建新行结构体
+    struct Row *row = (struct Row *)db_alloc(sizeof(struct Row));
+    row->values = newvals;
+    row->schema = t->schema_version;
+    // 头插法插入行链表
+    row->next = t->rows;
+    t->rows = row;
+    block_push_row(t, row);
+    t->row_bytes += ROW_BYTES(t);
+    table_index_row(t, row);
+    TABLE_CHANGED(t);
+    if (txn_active)
+        undo_push(UNDO_INSERT, t, row);
+    if (!loading)
+        stats_add_rows_written(1);
+    return row;
+}
+
+// 插入一行，违反 PRIMARY KEY / UNIQUE 约束时按action处理
+// action: CONFLICT_ERROR 报错；CONFLICT_NOTHING 跳过；CONFLICT_UPDATE 对已有的行执行set
+// set: CONFLICT_UPDATE 的SET项，可用 EXCLUDED.col 引用本次要插入的值
+void db_upsert(const char *table, struct ColumnList *cols, struct Value *values, int action, struct SetItem *set)
+{
+    // 查找目标表
+    struct Table *t = find_table(table);
+    if (!t)
+    {
+        db_error("[DB] Table not found: %s\n", table);
+        return;
+    }
+    if (mem_check_write(t) < 0)
+        return;
+    struct Value *vt = values;
+    if (vt)
+    {
+        struct Value *newvals = NULL, **tail = &newvals;
+        if (!cols)
+            newvals = table_row_values(t, vt); // 未指定列名，按表定义顺序插入
+        else
+        {
+            // 指定列名插入，未指定的列补默认值
+            int idx = 0;
+            for (struct ColumnDef *c = t->columns; c; c = c->next, ++idx)
+            {
+                struct Value *v = NULL;
+                int col_idx = 0, match_idx = -1;
+                // 查找当前列在插入列名链表中的索引
+                for (struct ColumnList *cl = cols; cl; cl = cl->next, ++col_idx)
+                {
+                    if (strcasecmp_dbms(cl->name, c->name) == 0)
+                    {
+                        match_idx = col_idx;
+                        break;
+                    }
+                }
+                if (match_idx >= 0)
+                {
+                    v = vt;
+                    for (int i = 0; i < match_idx && v; ++i)
+                        v = v->next;
+                    if (v)
+                    {
+                        struct Value *nv = table_copy_value(t, idx, v);
+                        *tail = nv;
+                        tail = &nv->next;
+                        continue;
+                    }
+                }
+                // 未指定的列补默认值
+                struct Value *nv = (struct Value *)db_alloc(sizeof(struct Value));
+                *nv = *table_default(t, idx);
+                nv->next = NULL;
+                *tail = nv;
+                tail = &nv->next;
+            }
+        }
+        // 先检查唯一约束，冲突时不插入
+        if (t->index_count)
+        {
+            struct Value **vals = (struct Value **)malloc(sizeof(struct Value *) * 2 * t->col_count);
+            row_value_array(newvals, vals + t->col_count, t->col_count);
+            struct Row *conflict;
+            const char *err = table_index_check(t, vals + t->col_count, NULL, &conflict);
+            if (err)
+            {
+                if (conflict && action == CONFLICT_NOTHING)
+                    DB_INFO("[DB] Insert into %s skipped: %s\n", table, err);
+                else if (conflict && action == CONFLICT_UPDATE)
+                {
+                    if (upsert_update(t, conflict, set, vals) == 0)
+                        DB_INFO("[DB] Insert into %s: conflict, updated existing row\n", table);
+                }
+                else
+                    db_error("[DB] Insert into %s failed: %s\n", table, err);
+                free(vals);
+                free_value_nodes(newvals);
+                return;
+            }
+            free(vals);
+        }
+        table_add_row(t, newvals);
+        stmt_wrote = 1;
+    }
+    DB_INFO("[DB] Insert into %s\n", table);
+}
+
+
+// 执行delete语句，按条件批量删除
+// table: 表名
+// cond: where条件表达式
+void db_delete(const char *table, struct Condition *cond)
+{
+    struct Table *t = find_table(table);
+    if (!t)
+    {
+        db_error("[DB] Table not found: %s\n", table);
+        return;
+    }
+    if (explain_mode == EXPLAIN_PLAN)
+    {
+        printf("[EXPLAIN] DELETE\n  -> Delete: %s\n", t->name);
+        explain_scan(t, cond, "     ");
+        return;
+    }
+    long scanned = 0, matched = 0;
+    struct ExecStage *st = stage_begin("Bind condition");
+    bind_condition(cond, &t, 1);
+    stage_end(st, 0, 0);
+    // 语句可能被取消时即使不在事务中也记录前像，取消后整条语句回滚
+    struct UndoRec *savepoint = undo_log;
+    int keep_undo = txn_active || stmt_checking;
+    struct Scan scan;
+    scan_begin(&scan, t, cond);
+    char name[64];
+    scan_stage_name(&scan, t, "Filter + Delete", name, sizeof(name));
+    st = stage_begin(name);
+    // 遍历候选行，满足条件的行只打墓碑标记，不在语句中逐行释放
+    for (struct Row *r; (r = scan_next(&scan));)
+    {
+        ++scanned;
+        if (!row_match(r, scan.filter))
+            continue;
+        if (keep_undo)
+            undo_push(UNDO_DELETE, t, r);
+        r->dead = 1;
+        --r->block->live;
+        table_unindex_row(t, r);
+        ++matched;
+    }
+    t->dead_count += matched;
+    if (stmt_cancel_reason)
+    {
+        stage_count = 0;
+        undo_apply(savepoint);
+        stats_add_rows_read(scanned);
+        stmt_cancel_report("Delete", matched, 1);
+        return;
+    }
+    if (!txn_active)
+        undo_discard(savepoint);
+    stage_end(st, scanned, matched);
+    scan_report(&scan);
+    stats_add_rows_read(scanned);
+    stats_add_rows_written(matched);
+    if (matched)
+    {
+        stmt_wrote = 1;
+        TABLE_CHANGED(t);
+    }
+    DB_INFO("[DB] Delete from %s\n", table);
+    if (explain_mode == EXPLAIN_ANALYZE)
+        print_stages("DELETE");
+    stage_count = 0;
+}
+
+// ================== 墓碑回收（VACUUM） ==================
+// DELETE只给行打墓碑标记，读取时跳过；VACUUM把带标记的行从链表中摘除后统一释放。
+// 后台线程按 vacuum_interval 定期回收：持锁时只做指针摘除，释放内存在锁外进行，
+// 大量删除产生的free不会阻塞前台语句
+#ifdef _WIN32
+static SRWLOCK db_mutex = SRWLOCK_INIT;
+#define DB_LOCK() AcquireSRWLockExclusive(&db_mutex)
+#define DB_UNLOCK() ReleaseSRWLockExclusive(&db_mutex)
+#else
+static pthread_mutex_t db_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define DB_LOCK() pthread_mutex_lock(&db_mutex)
+#define DB_UNLOCK() pthread_mutex_unlock(&db_mutex)
+#endif
+static volatile int vacuum_interval = 0; // 后台回收间隔（秒），0表示关闭
+static int vacuum_thread_started = 0;
+
+// 语句开始：持有数据库锁，与后台回收线程互斥；顺带回收已结束的检查点
+void db_stmt_begin(const char *text)
+{
+    DB_LOCK();
+    checkpoint_poll();
+    bound_sets_release();
+    stmt_wrote = stmt_use = 0;
+    stmt_text = text;
+    stmt_checks_begin();
+}
+
+// 语句结束：按需开始定期检查点，释放数据库锁
+void db_stmt_end()
+{
+    checkpoint_tick();
+    stmt_text = NULL;
+    stmt_checks_end();
+    DB_UNLOCK();
+}
+
+// 从表中摘除所有带墓碑标记的行，返回摘下的行链表，由调用者释放；
+// 草图中仍有摘除的行的值，一并丢弃，下次查询时重建
+static struct Row *table_unlink_dead(struct Table *t, long *n)
+{
+    struct Row *dead = NULL, **p = &t->rows;
+    *n = 0;
+    if (t->dead_count == 0)
+        return NULL;
+    while (*p)
+    {
+        struct Row *r = *p;
+        if (r->dead)
+        {
+            block_unlink_row(r);
+            *p = r->next;
+            r->next = dead;
+            dead = r;
+            ++*n;
+        }
+        else
+            p = &r->next;
+    }
+    table_drop_empty_blocks(t);
+    t->dead_count = 0;
+    t->row_bytes -= *n * ROW_BYTES(t);
+    table_free_sketches(t);
+    return dead;
+}
+
+// 释放摘下的行链表
+static void free_row_list(struct Row *r)
+{
+    while (r)
+    {
+        struct Row *tmp = r;
+        r = r->next;
+        free_row(tmp);
+    }
+}
+
+// VACUUM [table]：回收当前数据库中（或指定表的）已删除行
+// 事务中删除的行被撤销日志引用，事务进行中不回收
+void db_vacuum(const char *table)
+{
+    if (txn_active)
+    {
+        db_error("[DB] Cannot VACUUM inside a transaction\n");
+        return;
+    }
+    if (cursor_pins)
+    {
+        db_error("[DB] Cannot VACUUM while a cursor is open\n");
+        return;
+    }
+    if (!current_db)
+    {
+        db_error("[DB] No database selected\n");
+        return;
+    }
+    struct Table *only = NULL;
+    if (table && !(only = find_table(table)))
+    {
+        db_error("[DB] Table not found: %s\n", table);
+        return;
+    }
+    long total = 0, rewritten = 0;
+    for (struct Table *t = current_db->tables; t; t = t->next)
+    {
+        if (only && t != only)
+            continue;
+        long n;
+        free_row_list(table_unlink_dead(t, &n));
+        total += n;
+        rewritten += table_upgrade_rows(t);
+    }
+    DB_INFO("[DB] Vacuum: %ld dead rows removed\n", total);
+    if (rewritten)
+        DB_INFO("[DB] Vacuum: %ld rows rewritten to the current schema\n", rewritten);
+}
+
+// 后台回收线程：每轮在锁内摘除所有表的已删除行，锁外释放
+#ifdef _WIN32
+static DWORD WINAPI vacuum_thread(LPVOID arg)
+#else
+static void *vacuum_thread(void *arg)
+#endif
+{
+    (void)arg;
+    int waited_ms = 0;
+    while (1)
+    {
+#ifdef _WIN32
+        Sleep(100);
+#else
+        usleep(100 * 1000);
+#endif
+        waited_ms += 100;
+        if (vacuum_interval <= 0 || waited_ms < vacuum_interval * 1000)
+            continue;
+        waited_ms = 0;
+        struct Row *garbage = NULL;
+        DB_LOCK();
+        if (!txn_active && !cursor_pins)
+        {
+            for (struct Database *db = db_list; db; db = db->next)
+                for (struct Table *t = db->tables; t; t = t->next)
+                {
+                    long n;
+                    struct Row *dead = table_unlink_dead(t, &n);
+                    // 拼接到待释放链表
+                    while (dead)
+                    {
+                        struct Row *r = dead;
+                        dead = r->next;
+                        r->next = garbage;
+                        garbage = r;
+                    }
+                }
+        }
+        DB_UNLOCK();
+        free_row_list(garbage);
+    }
+    return 0;
+}
+
+// 设置后台回收间隔，首次开启时启动线程
+static void vacuum_set_interval(int seconds)
+{
+    vacuum_interval = seconds;
+    if (seconds <= 0 || vacuum_thread_started)
+        return;
+#ifdef _WIN32
+    HANDLE h = CreateThread(NULL, 0, vacuum_thread, NULL, 0, NULL);
+    if (!h)
+    {
+        db_error("[DB] Cannot start vacuum thread\n");
+        return;
+    }
+    CloseHandle(h);
+#else
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, vacuum_thread, NULL) != 0)
+    {
+        db_error("[DB] Cannot start vacuum thread\n");
+        return;
+    }
+    pthread_detach(tid);
+#endif
+    vacuum_thread_started = 1;
+}
+
+// ================== 游标（库接口） ==================
+// 游标按需逐行产生SELECT的结果，不格式化输出：单表沿用 Scan（索引查找或按块扫描），
+// 多表按嵌套循环的顺序逐层推进。两次取行之间不持有数据库锁，调用者可以执行其他语句；
+// 取完之前 cursor_pins 保证游标引用的行和表不被释放
+struct Cursor
+{
+    struct Table *tables[8];
+    int table_count;
+    struct Condition *cond;
+    struct FieldRef *fields; // 输出列
+    int field_count;
+    struct Scan scan;     // 单表扫描
+    struct Row *rows[8];  // 当前行（多表时为各层当前的行）
+    int started;          // 多表：是否已取出第一组行
+    int pinned;           // 是否计入 cursor_pins（取完后不再需要）
+    struct Value **vals;  // 当前行各输出列的值，数据版本变化后重新取
+    long vals_version;    // 取 vals 时的 data_version，-1表示未取
+    long scanned, matched;
+    double t0;            // 语句开始时刻（语句计时和慢查询日志）
+    char *text;           // 语句文本
+};
+
+static struct Row *live_row(struct Row *r)
+{
+    while (r && r->dead)
+        r = r->next;
+    return r;
+}
+
+// 打开游标：解析表名、绑定条件、确定输出列，出错返回NULL（错误信息见 db_last_error）
+// 输出列的规则与 db_select 相同：单表中不存在的列输出NULL，多表中不存在的列报错
+struct Cursor *db_cursor_open(struct ColumnList *tables, struct SelectList *sel, struct Condition *cond, const char *text)
+{
+    struct Cursor *c = (struct Cursor *)calloc(1, sizeof(struct Cursor));
+    for (struct ColumnList *tl = tables; tl && c->table_count < 8; tl = tl->next)
+    {
+        struct Table *t = find_table(tl->name);
+        if (!t)
+        {
+            db_error("[DB] Table not found: %s\n", tl->name);
+            free(c);
+            return NULL;
+        }
+        c->tables[c->table_count++] = t;
+    }
+    if (c->table_count == 0)
+    {
+        db_error("[DB] No table specified\n");
+        free(c);
+        return NULL;
+    }
+    // 游标逐行取值，不支持聚合；抽样只支持单表
+    if (sel_has_agg(sel))
+    {
+        db_error("[DB] APPROX_COUNT_DISTINCT is not supported by cursors\n");
+        free(c);
+        return NULL;
+    }
+    if (tables->sample && c->table_count > 1)
+    {
+        db_error("[DB] TABLESAMPLE is only supported on a single table\n");
+        free(c);
+        return NULL;
+    }
+    int cap = 0;
+    if (sel)
+        for (struct SelectList *s = sel; s; s = s->next)
+            ++cap;
+    else
+        for (int i = 0; i < c->table_count; ++i)
+            cap += c->tables[i]->col_count;
+    c->fields = (struct FieldRef *)malloc(sizeof(struct FieldRef) * (cap ? cap : 1));
+    if (!sel)
+    {
+        for (int i = 0; i < c->table_count; ++i)
+        {
+            int idx = 0;
+            for (struct ColumnDef *col = c->tables[i]->columns; col; col = col->next, ++idx)
+            {
+                struct FieldRef *f = &c->fields[c->field_count++];
+                f->table_idx = i;
+                f->col_idx = idx;
+                f->name = col->name;
+            }
+        }
+    }
+    for (struct SelectList *s = sel; s; s = s->next)
+    {
+        struct FieldRef *f = &c->fields[c->field_count++];
+        f->table_idx = 0;
+        f->col_idx = -1;
+        f->name = s->name;
+        for (int i = 0; i < c->table_count && f->col_idx < 0; ++i)
+            if ((f->col_idx = col_index(c->tables[i]->columns, s->name)) >= 0)
+                f->table_idx = i;
+        if (f->col_idx < 0 && c->table_count > 1)
+        {
+            db_error("Field not found: %s\n", s->name);
+            free(c->fields);
+            free(c);
+            return NULL;
+        }
+    }
+    c->cond = cond;
+    bind_condition(cond, c->tables, c->table_count);
+    if (stmt_cancel_reason)
+    {
+        // 子查询建集合时被取消
+        stmt_cancel_report("Select", 0, 0);
+        free(c->fields);
+        free(c);
+        return NULL;
+    }
+    if (c->table_count == 1)
+        scan_begin(&c->scan, c->tables[0], cond);
+    if (c->table_count == 1 && tables->sample)
+        scan_sample(&c->scan, c->tables[0], tables->sample);
+    c->vals = (struct Value **)calloc(c->field_count ? c->field_count : 1, sizeof(struct Value *));
+    c->vals_version = -1;
+    c->t0 = stats_stmt_begin();
+    c->text = strdup(text ? text : "");
+    c->pinned = 1;
+    ++cursor_pins;
+    return c;
+}
+
+// 多表：按嵌套循环的顺序推进到下一组行，最内层先动；全部枚举完返回0
+static int cursor_advance(struct Cursor *c)
+{
+    for (int i = c->table_count - 1; i >= 0; --i)
+    {
+        if ((c->rows[i] = live_row(c->rows[i]->next)))
+            return 1;
+        // 本层已到表尾：回到表头，推进外一层
+        if (!(c->rows[i] = live_row(c->tables[i]->rows)))
+            return 0;
+    }
+    return 0;
+}
+
+static int cursor_next_row(struct Cursor *c)
+{
+    if (c->table_count == 1)
+    {
+        for (struct Row *r; (r = scan_next(&c->scan));)
+        {
+            ++c->scanned;
+            if (row_match(r, c->scan.filter))
+            {
+                c->rows[0] = r;
+                return 1;
+            }
+        }
+        return 0;
+    }
+    if (!c->started)
+    {
+        c->started = 1;
+        for (int i = 0; i < c->table_count; ++i)
+            if (!(c->rows[i] = live_row(c->tables[i]->rows)))
+                return 0;
+    }
+    else if (!cursor_advance(c))
+        return 0;
+    do
+    {
+        ++c->scanned;
+        if (row_match_multi(c->rows, c->cond))
+            return 1;
+    } while (cursor_advance(c));
+    return 0;
+}
+
+// 取完：记录语句耗时和读取的行数，不再引用行
+static void cursor_finish(struct Cursor *c)
+{
+    stats_add_rows_read(c->scanned);
+    stats_stmt_end(STMT_SELECT, c->t0, c->text);
+    c->pinned = 0;
+    --cursor_pins;
+}
+
+// 取下一行：返回1表示取到，0表示已取完
+int db_cursor_next(struct Cursor *c)
+{
+    if (!c->pinned)
+        return 0;
+    DB_LOCK();
+    int found = cursor_next_row(c);
+    if (found)
+    {
+        ++c->matched;
+        c->vals_version = -1;
+    }
+    else
+        cursor_finish(c);
+    DB_UNLOCK();
+    return found;
+}
+
+int db_cursor_column_count(struct Cursor *c)
+{
+    return c->field_count;
+}
+
+const char *db_cursor_column_name(struct Cursor *c, int i)
+{
+    return i >= 0 && i < c->field_count ? c->fields[i].name : NULL;
+}
+
+// 当前行第i个输出列的值，NULL表示空值；返回的值在下一次取行或执行其他语句之前有效
+struct Value *db_cursor_value(struct Cursor *c, int i)
+{
+    if (!c->pinned || !c->matched || i < 0 || i >= c->field_count)
+        return NULL;
+    // 其他语句可能修改了当前行（UPDATE会替换值链表），数据版本变化后重新取
+    if (c->vals_version != data_version)
+    {
+        for (int k = 0; k < c->field_count; ++k)
+        {
+            struct FieldRef *f = &c->fields[k];
+            struct Value *v = NULL;
+            struct Table *t = c->tables[f->table_idx];
+            struct Row *r = c->rows[f->table_idx];
+            // SELECT * 的相邻输出列在行中也相邻，沿链表前进一步即可（旧结构版本的行除外）
+            if (k > 0 && f->table_idx == f[-1].table_idx && f->col_idx == f[-1].col_idx + 1 && c->vals[k - 1] &&
+                ROW_CURRENT(t, r))
+                v = c->vals[k - 1]->next;
+            else if (f->col_idx >= 0)
+                v = row_value(t, r, f->col_idx);
+            c->vals[k] = v;
+        }
+        c->vals_version = data_version;
+    }
+    return c->vals[i];
+}
+
+// 关闭游标，未取完的视为语句结束
+void db_cursor_close(struct Cursor *c)
+{
+    if (!c)
+        return;
+    DB_LOCK();
+    if (c->pinned)
+        cursor_finish(c);
+    DB_UNLOCK();
+    free(c->fields);
+    free(c->vals);
+    free(c->text);
+    free(c);
+}
+
+// ================== 内存统计与限制 ==================
+// 每个表统计行（Row + Value节点）和列字典占用的字节数，数据库的用量为其所有表之和。
+// 设置了 memory_limit 的数据库超过限制后拒绝INSERT/UPDATE；开启 memory_evict 时
+// 先把最久未访问的表写到溢出文件并释放内存，下次访问该表时再读回
+static int memory_evict = 0; // 超过限制时是否换出冷表
+static int snapshot_compress = 1; // 快照和溢出文件中的表数据是否再做LZ压缩
+
+static long write_table_data(FILE *fp, struct Table *t);
+
+// 表占用的字节数
+static long table_mem_bytes(struct Table *t)
+{
+    long n = t->row_bytes + table_index_bytes(t) + table_block_bytes(t);
+    for (int i = 0; i < t->col_count; ++i)
+        n += dict_bytes(t->dicts[i]);
+    return n;
+}
+
+// 数据库占用的字节数
+static long db_mem_bytes(struct Database *db)
+{
+    long n = 0;
+    for (struct Table *t = db->tables; t; t = t->next)
+        n += table_mem_bytes(t);
+    return n;
+}
+
+// 换出一个表：有效行写入溢出文件，释放所有行和字典
+static int table_evict(struct Database *db, struct Table *t)
+{
+    char path[400];
+    snprintf(path, sizeof(path), "%s.%s.%s.spill", db_dump_file, db->name, t->name);
+    FILE *fp = fopen(path, "wb");
+    if (!fp)
+        return -1;
+    long rows = write_table_data(fp, t);
+    long len = ftell(fp);
+    if (fclose(fp) != 0)
+    {
+        remove(path);
+        return -1;
+    }
+    free_row_list(t->rows);
+    t->rows = NULL;
+    block_free_list(t->blocks);
+    t->blocks = NULL;
+    t->row_bytes = 0;
+    t->dead_count = 0;
+    table_drop_layouts(t); // 行按当前结构写出，读回后都是当前版本
+    table_free_defaults(t);
+    table_free_sketches(t);
+    for (int i = 0; i < t->col_count; ++i)
+    {
+        dict_free(t->dicts[i]);
+        t->dicts[i] = NULL;
+        if (t->indexes[i])
+            index_clear(t->indexes[i]);
+        if (t->text_indexes)
+            text_index_reset(t->text_indexes[i]);
+        if (t->bitmaps)
+            bitmap_index_reset(t->bitmaps[i]);
+    }
+    t->disk_path = strdup(path);
+    t->disk_offset = 0;
+    t->disk_len = len;
+    t->disk_rows = rows;
+    t->disk_owned = 1;
+    t->disk_binary = 1;
+    return 0;
+}
+
+// 检查数据库内存用量，必要时换出冷表（keep除外）；返回-1表示仍超过限制
+// 事务进行中撤销日志引用着表中的行，有打开的游标时游标引用着行，都不换出
+static int mem_enforce(struct Database *db, struct Table *keep)
+{
+    if (!db || db->mem_limit <= 0 || loading)
+        return 0;
+    long used = db_mem_bytes(db);
+    while (used > db->mem_limit && memory_evict && !txn_active && !cursor_pins)
+    {
+        struct Table *coldest = NULL;
+        for (struct Table *t = db->tables; t; t = t->next)
+            if (t != keep && !t->disk_path && table_mem_bytes(t) > 0 &&
+                (!coldest || t->last_access < coldest->last_access))
+                coldest = t;
+        if (!coldest || table_evict(db, coldest) < 0)
+            break;
+        DB_INFO("[DB] Evicted table %s.%s to disk\n", db->name, coldest->name);
+        used = db_mem_bytes(db);
+    }
+    return used > db->mem_limit ? -1 : 0;
+}
+
+// 写入前检查内存限制，超过限制时拒绝
+static int mem_check_write(struct Table *t)
+{
+    if (mem_enforce(current_db, t) == 0)
+        return 0;
+    db_error("[DB] Memory limit exceeded for database %s (%ld / %ld bytes), write rejected\n", current_db->name,
+           db_mem_bytes(current_db), current_db->mem_limit);
+    return -1;
+}
+
+// SHOW MEMORY：按数据库和表输出内存用量
+static void db_show_memory()
+{
+    printf("[DB] Memory:\n");
+    printf("  %-24s %10s %10s %12s %12s %12s\n", "Table", "Rows", "Dead", "Row bytes", "Dict+index", "Total");
+    for (struct Database *db = db_list; db; db = db->next)
+    {
+        long total = 0;
+        for (struct Table *t = db->tables; t; t = t->next)
+        {
+            char name[300];
+            snprintf(name, sizeof(name), "%s.%s", db->name, t->name);
+            long rows = 0;
+            for (struct Row *r = t->rows; r; r = r->next)
+                ++rows;
+            long bytes = table_mem_bytes(t);
+            total += bytes;
+            if (t->disk_path)
+                printf("  %-24s %10ld %10s %12s %12s %12s\n", name, t->disk_rows, "-", "-", "-", "on disk");
+            else
+                printf("  %-24s %10ld %10ld %12ld %12ld %12ld\n", name, rows - t->dead_count, t->dead_count,
+                       t->row_bytes, bytes - t->row_bytes, bytes);
+        }
+        if (db->mem_limit > 0)
+            printf("  %-24s %10s %10s %12s %12s %12ld / %ld limit\n", db->name, "", "", "", "", total, db->mem_limit);
+        else
+            printf("  %-24s %10s %10s %12s %12s %12ld\n", db->name, "", "", "", "", total);
+    }
+}
+
+// ================== 提交日志 ==================
+// 修改数据的语句以文本形式追加到日志文件，启动时在快照之上重放，save_db 后清空。
+// 事务内的语句先缓存在内存中，提交时一次写入并刷盘，刷盘代价按事务而非按语句支付
+static char journal_path[300];
+static FILE *journal_fp = NULL;
+static char *journal_buf = NULL; // 尚未写入文件的语句
+static size_t journal_len = 0, journal_cap = 0;
+static int journal_stmts = 0;             // 缓存中的语句数
+static char journal_db[128] = "";         // 日志中当前生效的数据库（含未提交部分）
+static char journal_db_written[128] = ""; // 已写入文件部分的当前数据库
+static int journal_replaying = 0;         // 正在重放日志，不再写入
+static int journal_sync = 1;              // 提交时是否fsync
+
+static const char *journal_file()
+{
+    snprintf(journal_path, sizeof(journal_path), "%s.journal", db_dump_file);
+    return journal_path;
+}
+
+static void journal_append(const char *text)
+{
+    size_t n = strlen(text);
+    if (journal_len + n + 2 > journal_cap)
+    {
+        while (journal_len + n + 2 > journal_cap)
+            journal_cap = journal_cap ? journal_cap * 2 : 4096;
+        journal_buf = (char *)realloc(journal_buf, journal_cap);
+    }
+    memcpy(journal_buf + journal_len, text, n);
+    journal_len += n;
+    journal_buf[journal_len++] = '\n';
+    journal_buf[journal_len] = '\0';
+}
+
+// 将缓存的语句一次写入日志文件并刷盘；显式事务的多条语句用BEGIN/COMMIT包住，
+// 重放时若文件末尾的事务不完整（写入中途崩溃）则整体回滚
+static void journal_commit(int wrap)
+{
+    if (journal_len == 0)
+        return;
+    if (!journal_fp)
+        journal_fp = fopen(journal_file(), "a");
+    if (journal_fp)
+    {
+        wrap = wrap && journal_stmts > 1;
+        if (wrap)
+            fputs("BEGIN;\n", journal_fp);
+        fwrite(journal_buf, 1, journal_len, journal_fp);
+        if (wrap)
+            fputs("COMMIT;\n", journal_fp);
+        fflush(journal_fp);
+        if (journal_sync)
+        {
+#ifdef _WIN32
+            _commit(_fileno(journal_fp));
+#else
+            fsync(fileno(journal_fp));
+#endif
+        }
+    }
+    journal_len = 0;
+    journal_stmts = 0;
+    strcpy(journal_db_written, journal_db);
+}
+
+// 丢弃未提交的语句
+static void journal_discard()
+{
+    journal_len = 0;
+    journal_stmts = 0;
+    strcpy(journal_db, journal_db_written);
+}
+
+// 语句执行完毕后由语法分析器调用：修改了数据的语句写入提交日志
+void db_journal_statement(const char *text)
+{
+    int wrote = stmt_wrote, use = stmt_use;
+    stmt_wrote = stmt_use = 0;
+    if (journal_replaying || !text)
+        return;
+    // 事务中的USE影响后续语句的上下文，需要一并记录
+    if (!wrote && !(use && txn_active && journal_len > 0))
+        return;
+    // EXPLAIN ANALYZE 只记录实际执行的语句（语句文本中词法单元之间只有一个空格）
+    if (strncasecmp_dbms(text, "EXPLAIN ", 8) == 0)
+        text += 8;
+    if (strncasecmp_dbms(text, "ANALYZE ", 8) == 0)
+        text += 8;
+    if (use)
+        snprintf(journal_db, sizeof(journal_db), "%s", current_db->name);
+    else if (current_db && strcmp(journal_db, current_db->name) != 0)
+    {
+        // 日志中的上下文与语句执行时的当前数据库不一致，先补一条USE
+        char use_stmt[160];
+        snprintf(use_stmt, sizeof(use_stmt), "USE %s;", current_db->name);
+        journal_append(use_stmt);
+        ++journal_stmts;
+        snprintf(journal_db, sizeof(journal_db), "%s", current_db->name);
+    }
+    journal_append(text);
+    ++journal_stmts;
+    if (!txn_active)
+        journal_commit(0);
+}
+
+// 提交日志文件路径（供启动时重放）
+const char *db_journal_path()
+{
+    return journal_file();
+}
+
+// 重放一个日志文件：语句由run解析执行，期间不再写入日志；结束时回滚末尾不完整的事务
+static void journal_replay_file(const char *path, void (*run)(const char *sql, size_t len))
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return;
+    char *data = NULL, chunk[65536];
+    size_t len = 0, n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+    {
+        data = (char *)realloc(data, len + n);
+        memcpy(data + len, chunk, n);
+        len += n;
+    }
+    fclose(fp);
+    if (len > 0)
+    {
+        journal_replaying = 1;
+        run(data, len);
+        journal_replaying = 0;
+        if (txn_active)
+        {
+            printf("[DB] Discarding incomplete transaction at end of journal\n");
+            db_rollback();
+        }
+        db_use_database("default");
+    }
+    free(data);
+}
+
+// 在快照之上重放上次保存后提交的修改：先是未完成的检查点轮换出的日志，再是当前日志。
+// 数据库层不依赖语法分析器，语句文本交给调用者的run解析执行；重放期间不输出执行成功信息
+void db_replay_journals(void (*run)(const char *sql, size_t len))
+{
+    int saved = quiet;
+    if (quiet < QUIET_INFO)
+        quiet = QUIET_INFO;
+    journal_replay_file(db_journal_old_path(), run);
+    journal_replay_file(journal_file(), run);
+    quiet = saved;
+}
+
+// 快照已包含全部数据，清空提交日志
+static void journal_truncate()
+{
+    if (journal_fp)
+    {
+        fclose(journal_fp);
+        journal_fp = NULL;
+    }
+    remove(journal_file());
+    remove(db_journal_old_path());
+    journal_db[0] = journal_db_written[0] = '\0';
+}
+
+// 设置系统变量：SET name = value
+void db_set_variable(const char *name, struct Value *value)
+{
+    if (strcasecmp_dbms(name, "slow_query_threshold") == 0 && value->is_int)
+        stats_set_slow_threshold(value->int_val);
+    else if (strcasecmp_dbms(name, "slow_query_log") == 0 && !value->is_int)
+        stats_set_slow_log(value->str_val);
+    else if (strcasecmp_dbms(name, "sync_commit") == 0 && value->is_int)
+        journal_sync = value->int_val != 0;
+    else if (strcasecmp_dbms(name, "vacuum_interval") == 0 && value->is_int)
+        vacuum_set_interval(value->int_val);
+    else if (strcasecmp_dbms(name, "query_cache_size") == 0 && value->is_int)
+        cache_set_limit(value->int_val);
+    else if (strcasecmp_dbms(name, "memory_limit") == 0 && value->is_int && current_db)
+        current_db->mem_limit = value->int_val > 0 ? value->int_val : 0;
+    else if (strcasecmp_dbms(name, "statement_timeout") == 0 && value->is_int)
+        statement_timeout = value->int_val > 0 ? value->int_val : 0;
+    else if (strcasecmp_dbms(name, "statement_row_limit") == 0 && value->is_int)
+        statement_row_limit = value->int_val > 0 ? value->int_val : 0;
+    else if (strcasecmp_dbms(name, "memory_evict") == 0 && value->is_int)
+        memory_evict = value->int_val != 0;
+    else if (strcasecmp_dbms(name, "snapshot_compress") == 0 && value->is_int)
+        snapshot_compress = value->int_val != 0;
+    else if (strcasecmp_dbms(name, "checkpoint_interval") == 0 && value->is_int)
+        checkpoint_set_interval(value->int_val);
+    else
+    {
+        db_error("[DB] Unknown variable or wrong value type: %s\n", name);
+        return;
+    }
+    if (value->is_int)
+        DB_INFO("[DB] Set %s = %d\n", name, value->int_val);
+    else
+        DB_INFO("[DB] Set %s = '%s'\n", name, value->str_val);
+}
+
+// SHOW <name>：STATUS 等不作为保留字，避免与同名的列名冲突
+void db_show(const char *name)
+{
+    if (strcasecmp_dbms(name, "status") == 0)
+    {
+        stats_show_status();
+        cache_show_status();
+    }
+    else if (strcasecmp_dbms(name, "memory") == 0)
+        db_show_memory();
+    else if (strcasecmp_dbms(name, "checkpoint") == 0)
+        checkpoint_show();
+    else if (strcasecmp_dbms(name, "ingest") == 0)
+        ingest_show();
+    else
+        db_error("[DB] Unknown SHOW target: %s\n", name);
+}
+
+// 关闭数据库：回滚未提交的事务，保存数据并释放所有内存（库接口关闭时调用，不退出进程）
+void db_close()
+{
+    DB_LOCK(); // 与后台回收线程互斥
+    // 未提交的事务在退出时回滚
+    if (txn_active)
+    {
+        if (quiet < QUIET_SILENT)
+            printf("[DB] Rolling back uncommitted transaction\n");
+        db_rollback();
+    }
+    ingest_close_all();
+    bound_sets_release();
+    save_db(); // 退出时自动保存数据库
+    // 释放所有内存
+    while (db_list)
+    {
+        struct Database *db = db_list;
+        db_list = db->next;
+        while (db->tables)
+        {
+            struct Table *t = db->tables;
+            db->tables = t->next;
+            free_table(t);
+        }
+        free(db->name);
+        free(db);
+    }
+    current_db = NULL;
+    DB_UNLOCK();
+}
+
+// 退出数据库系统，保存数据并释放所有内存
+void db_exit()
+{
+    db_close();
+    DB_LOCK(); // 进程退出前后台回收线程不再运行
+    DB_INFO("[DB] Exit\n");
+    exit(0);
+}
+
+// ================== 并发写入队列（INGEST） ==================
+// 多个线程向同一个表写入时不经过语句执行：每个队列是一个有界环形缓冲区（多生产者单消费者），
+// 生产者用一次CAS占得槽位，放入拷贝好的值链表后发布槽位序号，全程不取数据库锁；
+// 唯一的写入线程在锁内按批取出各队列的行插入表中，一批行作为一个事务写入提交日志，只刷盘一次。
+// 事务进行中写入线程不取行（撤销日志和日志缓存属于前台事务），队列满时生产者让出CPU等待
+#define INGEST_BATCH 1024 // 写入线程每次从一个队列取出的最多行数
+
+struct IngestSlot
+{
+    atomic_size_t seq;    // 槽位序号：等于入队位置时可写，等于入队位置+1时可读
+    struct Value *values; // 生产者拷贝的值链表（malloc分配）
+};
+
+struct Ingest
+{
+    char *db_name; // 所属数据库和表，每批按名字查找（表被DROP后队列中的行被拒绝）
+    char *table;
+    struct IngestSlot *slots;
+    size_t mask;       // 槽数-1，槽数为2的幂
+    char pad0[64];     // 生产者竞争的入队位置单独占一个缓存行
+    atomic_size_t head; // 下一个入队位置，也是累计入队的行数
+    char pad1[64];
+    size_t tail;       // 下一个出队位置，只由持锁的写入方访问
+    atomic_long done;  // 已处理（插入或拒绝）的行数，flush 据此等待
+    long applied;      // 以下只在持锁时访问
+    long rejected;
+    long batches;
+    atomic_int closed;
+    char *text; // 拼接INSERT语句的缓冲区
+    size_t text_cap;
+    struct Ingest *next;
+};
+
+static struct Ingest *ingest_list = NULL; // 持锁访问
+static int ingest_thread_started = 0;
+
+static void ingest_yield()
+{
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
 }
 
-// 显示当前数据库所有表名
-void db_show_tables()
+// 插入一行：与INSERT相同，不足的列补默认值，违反内存限制或唯一约束时拒绝
+static int ingest_insert(struct Database *db, struct Table *t, struct Value *values)
 {
-    if (!current_db)
+    if (mem_enforce(db, t) < 0)
+        return -1;
+    struct Value *newvals = table_row_values(t, values);
+    if (t->index_count)
     {
-        printf("[DB] No database selected\n");
-        return;
+        struct Value **vals = (struct Value **)malloc(sizeof(struct Value *) * t->col_count);
+        row_value_array(newvals, vals, t->col_count);
+        struct Row *conflict;
+        const char *err = table_index_check(t, vals, NULL, &conflict);
+        free(vals);
+        if (err)
+        {
+            free_value_nodes(newvals);
+            return -1;
+        }
     }
-    printf("[DB] Tables in %s:\n", current_db->name);
-    for (struct Table *t = current_db->tables; t; t = t->next)
-        printf("%12s\n", t->name);
+    table_add_row(t, newvals);
+    return 0;
 }
 
-// 创建表，深拷贝列定义
-void db_create_table(const char *name, struct ColumnDef *cols)
+// 把插入的行拼成INSERT语句追加到日志缓存，日志中的当前数据库不一致时先补一条USE
+static void ingest_journal_row(struct Ingest *q, struct Database *db, struct Value *values)
 {
-    if (!current_db)
-    {
-        printf("[DB] No database selected\n");
+    if (journal_replaying)
         return;
+    size_t need = strlen(q->table) + 32;
+    for (struct Value *v = values; v; v = v->next)
+        need += v->is_int ? 16 : strlen(v->str_val) + 4;
+    if (need > q->text_cap)
+    {
+        q->text_cap = need * 2;
+        q->text = (char *)realloc(q->text, q->text_cap);
     }
-    if (find_table(name))
+    int n = sprintf(q->text, "INSERT INTO %s VALUES (", q->table);
+    for (struct Value *v = values; v; v = v->next)
     {
-        printf("[DB] Table exists: %s\n", name);
-        return;
+        if (v->is_int)
+            n += sprintf(q->text + n, "%s%d", v == values ? "" : ", ", v->int_val);
+        else
+            n += sprintf(q->text + n, "%s'%s'", v == values ? "" : ", ", v->str_val);
     }
-    // 分配新表结构体
-    struct Table *t = (struct Table *)malloc(sizeof(struct Table));
-    t->name = strdup(name); // 拷贝表名
-    // 深拷贝列定义，防止外部free影响
-    struct ColumnDef *src = cols, *dst_head = NULL, **dst_tail = &dst_head;
-    while (src)
+    strcpy(q->text + n, ");");
+    if (strcmp(journal_db, db->name) != 0)
     {
-        struct ColumnDef *c = (struct ColumnDef *)malloc(sizeof(struct ColumnDef));
-        c->name = strdup(src->name);
-        c->type = strdup(src->type);
-        c->next = NULL;
-        *dst_tail = c;
-        dst_tail = &c->next;
-        src = src->next;
+        char use_stmt[160];
+        snprintf(use_stmt, sizeof(use_stmt), "USE %s;", db->name);
+        journal_append(use_stmt);
+        ++journal_stmts;
+        snprintf(journal_db, sizeof(journal_db), "%s", db->name);
     }
-    t->columns = dst_head;
-    t->rows = NULL;
-    // 头插法插入表链表
-    t->next = current_db->tables;
-    current_db->tables = t;
-    printf("[DB] Create table: %s\n", name);
-    for (struct ColumnDef *c = t->columns; c; c = c->next)
-        printf("  Column: %s %s\n", c->name, c->type);
+    journal_append(q->text);
+    ++journal_stmts;
 }
 
-// 删除表及其所有数据
-void db_drop_table(const char *name)
+// 从队列取出至多 INGEST_BATCH 行插入表中，整批提交到日志，返回取出的行数（持锁调用）
+static int ingest_drain(struct Ingest *q)
 {
-    if (!current_db)
+    struct Database *db = find_db(q->db_name);
+    struct Table *t = NULL;
+    if (db)
     {
-        printf("[DB] No database selected\n");
-        return;
+        struct Database *saved = current_db;
+        current_db = db;
+        t = find_table(q->table);
+        current_db = saved;
     }
-    struct Table **p = &current_db->tables;
-    while (*p)
+    int n = 0;
+    long applied = 0;
+    while (n < INGEST_BATCH)
     {
-        if (strcasecmp_dbms((*p)->name, name) == 0)
+        struct IngestSlot *s = &q->slots[q->tail & q->mask];
+        if (atomic_load_explicit(&s->seq, memory_order_acquire) != q->tail + 1)
+            break; // 队列空，或生产者占得槽位后还未放入
+        struct Value *values = s->values;
+        // 槽位交还给下一轮的生产者
+        atomic_store_explicit(&s->seq, q->tail + q->mask + 1, memory_order_release);
+        ++q->tail;
+        ++n;
+        if (t && ingest_insert(db, t, values) == 0)
         {
-            struct Table *del = *p;
-            *p = del->next; // 从链表中移除
-            free(del->name);
-            free_column_defs(del->columns);
-            struct Row *r = del->rows;
-            while (r)
-            {
-                struct Row *tr = r;
-                r = r->next;
-                free_value_list(tr->values);
-                free(tr);
-            }
-            free(del);
-            printf("[DB] Drop table: %s\n", name);
-            return;
+            ingest_journal_row(q, db, values);
+            ++applied;
         }
-        p = &((*p)->next);
+        else
+            ++q->rejected;
+        free_value_list(values);
+    }
+    if (applied)
+    {
+        journal_commit(1);
+        q->applied += applied;
+        ++q->batches;
     }
-    printf("[DB] Table not found: %s\n", name);
+    if (n)
+        atomic_fetch_add_explicit(&q->done, n, memory_order_release);
+    return n;
 }
 
-// 向指定表插入一行数据
-// table: 表名
-// cols: 指定插入的列名链表（可为NULL，表示所有列顺序插入）
-// values: 插入的值链表
-void db_insert(const char *table, struct ColumnList *cols, struct Value *values)
+// 写入线程：轮流排空各队列，没有可取的行时休眠1毫秒
+#ifdef _WIN32
+static DWORD WINAPI ingest_thread(LPVOID arg)
+#else
+static void *ingest_thread(void *arg)
+#endif
 {
-    // 查找目标表
+    (void)arg;
+    while (1)
+    {
+        int n = 0;
+        DB_LOCK();
+        if (!txn_active)
+            for (struct Ingest *q = ingest_list; q; q = q->next)
+                n += ingest_drain(q);
+        DB_UNLOCK();
+        if (n == 0)
+        {
+#ifdef _WIN32
+            Sleep(1);
+#else
+            usleep(1000);
+#endif
+        }
+    }
+    return 0;
+}
+
+static void ingest_free(struct Ingest *q)
+{
+    free(q->db_name);
+    free(q->table);
+    free(q->slots);
+    free(q->text);
+    free(q);
+}
+
+// 为当前数据库中的表创建写入队列，capacity 为槽数（向上取整为2的幂），首次调用时启动写入线程
+// 在语句之外调用（内部取数据库锁）
+struct Ingest *db_ingest_open(const char *table, int capacity)
+{
+    DB_LOCK();
     struct Table *t = find_table(table);
     if (!t)
     {
-        printf("[DB] Table not found: %s\n", table);
-        return;
+        db_error("[DB] Table not found: %s\n", table);
+        DB_UNLOCK();
+        return NULL;
     }
-    struct Value *vt = values;
-    if (vt)
+    if (!ingest_thread_started)
     {
-        // 创建新行结构体
-        struct Row *row = (struct Row *)malloc(sizeof(struct Row));
-        struct Value *newvals = NULL, **tail = &newvals;
-        if (!cols)
+#ifdef _WIN32
+        HANDLE h = CreateThread(NULL, 0, ingest_thread, NULL, 0, NULL);
+        if (h)
+            CloseHandle(h);
+        ingest_thread_started = h != NULL;
+#else
+        pthread_t tid;
+        ingest_thread_started = pthread_create(&tid, NULL, ingest_thread, NULL) == 0;
+        if (ingest_thread_started)
+            pthread_detach(tid);
+#endif
+        if (!ingest_thread_started)
+        {
+            db_error("[DB] Cannot start ingest thread\n");
+            DB_UNLOCK();
+            return NULL;
+        }
+    }
+    size_t cap = 64;
+    while (cap < (size_t)capacity)
+        cap <<= 1;
+    struct Ingest *q = (struct Ingest *)calloc(1, sizeof(struct Ingest));
+    q->db_name = strdup(current_db->name);
+    q->table = strdup(t->name);
+    q->slots = (struct IngestSlot *)malloc(sizeof(struct IngestSlot) * cap);
+    for (size_t i = 0; i < cap; ++i)
+    {
+        atomic_init(&q->slots[i].seq, i);
+        q->slots[i].values = NULL;
+    }
+    q->mask = cap - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->done, 0);
+    atomic_init(&q->closed, 0);
+    q->next = ingest_list;
+    ingest_list = q;
+    DB_INFO("[DB] Ingest queue opened for %s (%ld slots)\n", t->name, (long)cap);
+    DB_UNLOCK();
+    return q;
+}
+
+// 生产者入队一行，可在任意线程调用，不取锁：值链表被拷贝，字符串不能为NULL或包含单引号（提交日志是SQL文本）
+// 队列满时等待写入线程腾出槽位；返回0成功，-1表示队列已关闭或值不合法
+int db_ingest_push(struct Ingest *q, const struct Value *values)
+{
+    if (!values || atomic_load_explicit(&q->closed, memory_order_relaxed))
+        return -1;
+    for (const struct Value *v = values; v; v = v->next)
+        if (!v->is_int && (!v->str_val || strchr(v->str_val, '\'')))
+            return -1;
+    struct Value *copy = copy_value(values);
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+    for (;;)
+    {
+        struct IngestSlot *s = &q->slots[pos & q->mask];
+        size_t seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        ptrdiff_t diff = (ptrdiff_t)(seq - pos);
+        if (diff == 0)
         {
-            // 未指定列名，按表定义顺序插入
-            struct Value *v = vt;
-            for (struct ColumnDef *c = t->columns; c; c = c->next)
+            // 槽位空闲，占得后放入值链表再发布；CAS失败时pos被更新为最新的入队位置
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1, memory_order_relaxed,
+                                                      memory_order_relaxed))
             {
-                struct Value *nv;
-                if (v)
-                {
-                    nv = copy_value(v); // 拷贝值
-                    v = v->next;
-                }
-                else
-                {
-                    // 不足的列补默认值
-                    nv = (struct Value *)calloc(1, sizeof(struct Value));
-                    if (strncmp(c->type, "CHAR", 4) == 0)
-                    {
-                        nv->is_int = 0;
-                        nv->str_val = NULL;
-                    }
-                    else
-                    {
-                        nv->is_int = 1;
-                        nv->int_val = 0;
-                    }
-                }
-                nv->next = NULL;
-                *tail = nv;
-                tail = &nv->next;
+                s->values = copy;
+                atomic_store_explicit(&s->seq, pos + 1, memory_order_release);
+                return 0;
             }
         }
         else
         {
-            // 指定列名插入，未指定的列补默认值
-            for (struct ColumnDef *c = t->columns; c; c = c->next)
-            {
-                struct Value *v = NULL;
-                int col_idx = 0, match_idx = -1;
-                // 查找当前列在插入列名链表中的索引
-                for (struct ColumnList *cl = cols; cl; cl = cl->next, ++col_idx)
-                {
-                    if (strcasecmp_dbms(cl->name, c->name) == 0)
-                    {
-                        match_idx = col_idx;
-                        break;
-                    }
-                }
-                if (match_idx >= 0)
-                {
-                    v = vt;
-                    for (int i = 0; i < match_idx && v; ++i)
-                        v = v->next;
-                    if (v)
-                    {
-                        struct Value *nv = copy_value(v);
-                        *tail = nv;
-                        tail = &nv->next;
-                        continue;
-                    }
-                }
-                // 未指定的列补默认值
-                struct Value *nv = (struct Value *)calloc(1, sizeof(struct Value));
-                if (strncmp(c->type, "CHAR", 4) == 0)
-                {
-                    nv->is_int = 0;
-                    nv->str_val = NULL;
-                }
-                else
-                {
-                    nv->is_int = 1;
-                    nv->int_val = 0;
-                }
-                nv->next = NULL;
-                *tail = nv;
-                tail = &nv->next;
-            }
+            if (diff < 0)
+                ingest_yield(); // 队列满：该槽位上一轮的行还未被取走
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
         }
-        row->values = newvals;
-        // 头插法插入行链表
-        row->next = t->rows;
-        t->rows = row;
     }
-    printf("[DB] Insert into %s\n", table);
 }
 
-// 执行select语句，支持单表/多表、字段选择、where条件
-// tables: 表名链表
-// sel: 字段名链表（为NULL表示select *）
-// cond: where条件表达式
-void db_select(struct ColumnList *tables, struct SelectList *sel, struct Condition *cond)
+// 等待调用前已入队的行全部处理完。写入线程在事务进行中不取行，持有未提交事务的线程不能调用
+void db_ingest_flush(struct Ingest *q)
 {
-    int table_count = 0;
-    struct Table *table_arr[8];
-    struct ColumnList *tl = tables;
-    // 解析表名链表，查找所有表指针
-    while (tl && table_count < 8)
+    long target = (long)atomic_load_explicit(&q->head, memory_order_acquire);
+    while (atomic_load_explicit(&q->done, memory_order_acquire) < target)
     {
-        struct Table *t = find_table(tl->name);
-        if (!t)
+#ifdef _WIN32
+        Sleep(1);
+#else
+        usleep(1000);
+#endif
+    }
+}
+
+// 关闭队列：不再接受新行，等待已入队的行处理完后释放。调用前生产者应已停止入队
+void db_ingest_close(struct Ingest *q)
+{
+    atomic_store(&q->closed, 1);
+    db_ingest_flush(q);
+    DB_LOCK();
+    for (struct Ingest **p = &ingest_list; *p; p = &(*p)->next)
+        if (*p == q)
         {
-            printf("[DB] Table not found: %s\n", tl->name);
-            return;
+            *p = q->next;
+            break;
         }
-        table_arr[table_count++] = t;
-        tl = tl->next;
+    DB_UNLOCK();
+    ingest_free(q);
+}
+
+// 关闭数据库时排空并释放仍打开的队列（持锁调用，事务已回滚）
+static void ingest_close_all()
+{
+    while (ingest_list)
+    {
+        struct Ingest *q = ingest_list;
+        ingest_list = q->next;
+        atomic_store(&q->closed, 1);
+        while (ingest_drain(q) > 0)
+            ;
+        ingest_free(q);
     }
-    if (table_count == 0)
+}
+
+// SHOW INGEST：各队列的积压和处理情况
+static void ingest_show()
+{
+    if (!ingest_list)
     {
-        printf("[DB] No table specified\n");
+        printf("[DB] No ingest queues\n");
         return;
     }
-    struct Row *rows[8]; // 存放每个表当前枚举到的行
-    if (table_count > 1)
+    printf("[DB] Ingest queues:\n");
+    printf("  %-24s %10s %10s %12s %10s %10s\n", "Table", "Slots", "Pending", "Applied", "Rejected", "Batches");
+    for (struct Ingest *q = ingest_list; q; q = q->next)
     {
-        struct FieldRef field_refs[64]; // 存放多表多字段选择的字段映射
-        int field_count = 0;
-        if (sel)
+        char name[300];
+        snprintf(name, sizeof(name), "%s.%s", q->db_name, q->table);
+        long pending = (long)atomic_load(&q->head) - atomic_load(&q->done);
+        printf("  %-24s %10ld %10ld %12ld %10ld %10ld\n", name, (long)q->mask + 1, pending, q->applied, q->rejected,
+               q->batches);
+    }
+}
+
+// ================== 持久化存储 ==================
+
+// 设置数据文件路径（基准测试等场景下避免覆盖 data.db）
+void db_set_dump_file(const char *path)
+{
+    db_dump_file = path ? path : DB_DUMP_FILE;
+}
+
+// 表数据的二进制列格式：
+//   u8 压缩方式(0不压缩/1 LZ) | u32 原始长度 | u32 存储长度 | 内容
+// 原始内容为 varint 行数、varint 列数，之后每列一个类型字节和编码后的数据：
+//   COL_INT 全部为整数；COL_STR 全部为字符串或NULL；COL_MIXED 先是每行的整数标记，再是整数和字符串两组
+enum
+{
+    COL_INT = 0,
+    COL_STR = 1,
+    COL_MIXED = 2
+};
+
+#define LZ_MIN_SECTION 256 // 小于该长度的数据不尝试压缩
+
+// 写入表的有效行，返回行数
+static long write_table_data(FILE *fp, struct Table *t)
+{
+    long n = 0;
+    for (struct Row *r = t->rows; r; r = r->next)
+        n += !r->dead;
+    struct Value **cur = (struct Value **)malloc(sizeof(struct Value *) * (n ? n : 1));
+    struct Row **old = (struct Row **)malloc(sizeof(struct Row *) * (n ? n : 1)); // 旧结构版本的行，经列映射取值
+    int *ints = (int *)malloc(sizeof(int) * (n ? n : 1));
+    int *tags = (int *)malloc(sizeof(int) * (n ? n : 1));
+    char **strs = (char **)malloc(sizeof(char *) * (n ? n : 1));
+    long j = 0;
+    for (struct Row *r = t->rows; r; r = r->next)
+        if (!r->dead)
         {
-            // 构建字段映射：确定每个字段属于哪个表及其列索引
-            for (struct SelectList *s = sel; s; s = s->next)
-            {
-                int found = 0;
-                for (int i = 0; i < table_count; ++i)
-                {
-                    int idx = col_index(table_arr[i]->columns, s->name);
-                    if (idx >= 0)
-                    {
-                        field_refs[field_count].table_idx = i;
-                        field_refs[field_count].col_idx = idx;
-                        field_refs[field_count].name = s->name;
-                        ++field_count;
-                        found = 1;
-                        break;
-                    }
-                }
-                if (!found)
-                {
-                    printf("Field not found: %s\n", s->name);
-                    return;
-                }
-            }
-            // 打印表头
-            for (int i = 0; i < field_count; ++i)
-                printf("%12s", field_refs[i].name);
-            printf("\n");
-            // 递归枚举所有表的行组合并输出指定字段
-            print_rows_multi_sel(0, rows, table_count, table_arr, cond, field_refs, field_count);
+            old[j] = ROW_CURRENT(t, r) ? NULL : r;
+            cur[j++] = r->values;
+        }
+    struct ByteBuf raw = {0};
+    bb_put_varint(&raw, (unsigned long long)n);
+    bb_put_varint(&raw, (unsigned long long)t->col_count);
+    for (int i = 0; i < t->col_count; ++i)
+    {
+        int has_int = 0, has_str = 0;
+        for (j = 0; j < n; ++j)
+        {
+            struct Value *v = old[j] ? row_value(t, old[j], i) : cur[j];
+            // 缺少的值按整数0保存
+            int is_int = !v || v->is_int;
+            tags[j] = is_int;
+            ints[j] = v && v->is_int ? v->int_val : 0;
+            strs[j] = v && !v->is_int ? v->str_val : NULL;
+            has_int |= is_int;
+            has_str |= !is_int;
+            cur[j] = v ? v->next : NULL;
+        }
+        if (has_int && has_str)
+        {
+            bb_put_u8(&raw, COL_MIXED);
+            enc_ints(&raw, tags, (int)n);
+            enc_ints(&raw, ints, (int)n);
+            enc_strs(&raw, strs, (int)n);
+        }
+        else if (has_str)
+        {
+            bb_put_u8(&raw, COL_STR);
+            enc_strs(&raw, strs, (int)n);
         }
         else
         {
-            // select *，输出所有表所有字段
-            for (int i = 0; i < table_count; ++i)
-                for (struct ColumnDef *c = table_arr[i]->columns; c; c = c->next)
-                    printf("%12s", c->name);
-            printf("\n");
-            // 递归枚举所有表的行组合并输出
-            print_rows_multi(0, rows, table_count, table_arr, cond);
+            bb_put_u8(&raw, COL_INT);
+            enc_ints(&raw, ints, (int)n);
         }
-        return;
     }
-    // 单表，支持字段和where
-    struct Table *t = table_arr[0];
-    // 打印表头
-    if (!sel)
+    free(cur);
+    free(old);
+    free(ints);
+    free(tags);
+    free(strs);
+    // 压缩后更小才使用压缩结果
+    unsigned char *packed = NULL;
+    size_t packed_len = 0;
+    if (snapshot_compress && raw.len >= LZ_MIN_SECTION)
     {
-        for (struct ColumnDef *c = t->columns; c; c = c->next)
-            printf("%12s", c->name);
+        packed = (unsigned char *)malloc(lz_bound(raw.len));
+        packed_len = lz_compress(raw.data, raw.len, packed);
     }
-    else
+    unsigned char head[9];
+    int lz = packed && packed_len < raw.len;
+    size_t stored = lz ? packed_len : raw.len;
+    head[0] = (unsigned char)lz;
+    for (int b = 0; b < 4; ++b)
     {
-        for (struct SelectList *s = sel; s; s = s->next)
-            printf("%12s", s->name);
+        head[1 + b] = (unsigned char)(raw.len >> (8 * b));
+        head[5 + b] = (unsigned char)(stored >> (8 * b));
     }
-    printf("\n");
-    // 打印数据
-    for (struct Row *r = t->rows; r; r = r->next)
+    fwrite(head, 1, sizeof(head), fp);
+    fwrite(lz ? packed : raw.data, 1, stored, fp);
+    free(packed);
+    bb_free(&raw);
+    return n;
+}
+
+// 把表在磁盘上的数据原样拷贝到快照；检查点子进程使用预先打开的文件
+static int copy_disk_rows(FILE *out, struct Table *t)
+{
+    FILE *fp = t->disk_fp ? t->disk_fp : fopen(t->disk_path, "rb");
+    if (!fp)
+        return -1;
+    fseek(fp, t->disk_offset, SEEK_SET);
+    char chunk[65536];
+    long left = t->disk_len;
+    while (left > 0)
     {
-        if (!row_match(r, t->columns, cond))
-            continue;
-        struct Value *v = r->values;
-        if (!sel)
+        size_t n = fread(chunk, 1, left < (long)sizeof(chunk) ? (size_t)left : sizeof(chunk), fp);
+        if (n == 0)
+            break;
+        fwrite(chunk, 1, n, out);
+        left -= (long)n;
+    }
+    if (!t->disk_fp)
+        fclose(fp);
+    return left == 0 ? 0 : -1;
+}
+
+// 快照中每个表的目录项位置，保存完数据后回填偏移和长度
+struct SaveSlot
+{
+    struct Table *t;
+    long pos;    // 目录项中偏移字段的位置
+    long offset; // 数据的起始位置
+    long len;    // 数据的字节数
+};
+
+// 快照写入进度（检查点子进程每写完一个表通过管道报告一次）
+struct SnapshotProgress
+{
+    int tables_done;
+    int tables_total;
+    long rows;
+    long bytes;
+    double ms; // 写入耗时
+};
+
+static struct SnapshotProgress snap_progress;
+static int snap_progress_fd = -1; // 检查点子进程中进度管道的写端
+
+// 把所有数据库、表结构和数据写到path，成功返回0
+// 文件格式：开头是目录（数据库、表、列定义以及每个表数据的偏移和长度），之后依次是各表的二进制列数据
+static int snapshot_write(const char *path)
+{
+    FILE *fp = fopen(path, "wb"); // 以写模式打开数据文件
+    if (!fp)
+        return -1;
+    int slot_count = 0;
+    for (struct Database *db = db_list; db; db = db->next)
+        for (struct Table *t = db->tables; t; t = t->next)
+            ++slot_count;
+    struct SaveSlot *slots = (struct SaveSlot *)malloc(sizeof(struct SaveSlot) * (slot_count ? slot_count : 1));
+    double t0 = db_now_us();
+    memset(&snap_progress, 0, sizeof(snap_progress));
+    snap_progress.tables_total = slot_count;
+    int k = 0, ok = 1;
+    // 写入目录
+    fprintf(fp, "%s\n", SNAPSHOT_MAGIC);
+    for (struct Database *db = db_list; db; db = db->next)
+    {
+        fprintf(fp, "DB %s\n", db->name); // 写入数据库名
+        for (struct Table *t = db->tables; t; t = t->next)
         {
-            // 输出所有字段
-            for (struct ColumnDef *c = t->columns; c; c = c->next)
+            long rows = 0;
+            if (t->disk_path)
+                rows = t->disk_rows;
+            for (struct Row *r = t->rows; r; r = r->next)
+                rows += !r->dead;
+            fprintf(fp, "TABLE %s %d %ld ", t->name, t->col_count, rows); // 表名、列数、行数
+            slots[k].t = t;
+            slots[k].pos = ftell(fp);
+            fprintf(fp, "%020ld %020ld\n", 0L, 0L); // 偏移和长度，写完数据后回填
+            // 写入每个字段的名字、类型、约束、文本索引（INDEX=名字 或 TRIGRAM=名字）、位图索引（BITMAP=名字）和默认值
+            int i = 0;
+            for (struct ColumnDef *c = t->columns; c; c = c->next, ++i)
             {
-                int idx = col_index(t->columns, c->name);
-                struct Value *v2 = r->values;
-                for (int i = 0; i < idx && v2; ++i)
-                    v2 = v2->next;
-                if (v2)
-                {
-                    if (v2->is_int)
-                        printf("%12d", v2->int_val);
-                    else
-                        printf("%12s", v2->str_val ? v2->str_val : "NULL");
-                }
-                else
+                struct TextIndex *tx = t->text_index_count ? t->text_indexes[i] : NULL;
+                fprintf(fp, "%s %s%s", c->name, c->type, constraint_suffix(c->constraint, 1));
+                if (tx)
+                    fprintf(fp, " %s=%s", tx->trigram ? "TRIGRAM" : "INDEX", tx->name);
+                if (t->bitmap_count && t->bitmaps[i])
+                    fprintf(fp, " BITMAP=%s", t->bitmaps[i]->name);
+                if (c->def && c->def->is_int)
+                    fprintf(fp, " DEFAULT=i:%d", c->def->int_val);
+                else if (c->def && c->def->str_val)
                 {
-                    printf("%12s", "NULL");
+                    fprintf(fp, " DEFAULT=s:");
+                    for (const char *p = c->def->str_val; *p; ++p)
+                        fprintf(fp, "%02x", (unsigned char)*p);
                 }
+                fprintf(fp, "\n");
             }
+            ++k;
         }
-        else
+    }
+    fprintf(fp, "END\n");
+    // 写入各表的数据，不在内存中的表直接拷贝原文件中的数据
+    for (k = 0; k < slot_count && ok; ++k)
+    {
+        struct Table *t = slots[k].t;
+        if (t->disk_path && !t->disk_binary)
+            table_materialize(t); // 旧格式的数据读入后按新格式写出
+        slots[k].offset = ftell(fp);
+        if (t->disk_path)
         {
-            // 只输出指定字段
-            for (struct SelectList *s = sel; s; s = s->next)
-            {
-                int idx = col_index(t->columns, s->name);
-                struct Value *v2 = r->values;
-                for (int i = 0; i < idx && v2; ++i)
-                    v2 = v2->next;
-                if (v2)
-                {
-                    if (v2->is_int)
-                        printf("%12d", v2->int_val);
-                    else
-                        printf("%12s", v2->str_val ? v2->str_val : "NULL");
-                }
-                else
-                {
-                    printf("%12s", "NULL");
-                }
-            }
+            ok = copy_disk_rows(fp, t) == 0;
+            snap_progress.rows += t->disk_rows;
         }
-        printf("\n");
+        else
+            snap_progress.rows += write_table_data(fp, t);
+        slots[k].len = ftell(fp) - slots[k].offset;
+        snap_progress.tables_done = k + 1;
+        snap_progress.bytes = ftell(fp);
+        snap_progress.ms = (db_now_us() - t0) / 1e3;
+#ifndef _WIN32
+        if (snap_progress_fd >= 0 && write(snap_progress_fd, &snap_progress, sizeof(snap_progress)) < 0)
+            snap_progress_fd = -1;
+#endif
+    }
+    // 回填目录中的偏移和长度
+    for (k = 0; k < slot_count && ok; ++k)
+    {
+        fseek(fp, slots[k].pos, SEEK_SET);
+        fprintf(fp, "%020ld %020ld", slots[k].offset, slots[k].len);
     }
+    free(slots);
+    if (fclose(fp) != 0 || !ok) // 关闭文件
+    {
+        remove(path);
+        return -1;
+    }
+    return 0;
 }
 
-// 执行update语句，按条件批量更新
-// table: 表名
-// set: 要更新的字段及新值链表
-// cond: where条件表达式
-void db_update(const char *table, struct SetItem *set, struct Condition *cond)
+// 快照文件被替换后，尚未读入的表改为引用新快照中的数据（表数据未被访问过，与新快照中的相同）
+static void snapshot_relocate()
 {
-    struct Table *t = find_table(table);
-    if (!t)
-    {
-        printf("[DB] Table not found: %s\n", table);
+    FILE *fp = fopen(db_dump_file, "rb");
+    if (!fp)
         return;
-    }
-    // 遍历所有行，判断是否满足条件
-    for (struct Row *r = t->rows; r; r = r->next)
+    char buf[512];
+    struct Database *db = NULL;
+    if (fgets(buf, sizeof(buf), fp) && strncmp(buf, SNAPSHOT_MAGIC, strlen(SNAPSHOT_MAGIC)) == 0)
     {
-        if (!row_match(r, t->columns, cond))
-            continue;
-        // 遍历所有要更新的字段
-        for (struct SetItem *s = set; s; s = s->next)
+        while (fgets(buf, sizeof(buf), fp) && strncmp(buf, "END", 3) != 0)
         {
-            int idx = col_index(t->columns, s->col);
-            struct Value *v = r->values;
-            for (int i = 0; i < idx && v; ++i)
-                v = v->next;
-            if (v)
+            char name[128];
+            if (strncmp(buf, "DB ", 3) == 0)
             {
-                if (v->is_int && s->value->is_int)
-                    v->int_val = s->value->int_val;
-                else if (!v->is_int && !s->value->is_int)
-                {
-                    if (v->str_val)
-                        free(v->str_val); // 释放原字符串
-                    v->str_val = strdup(s->value->str_val);
-                }
+                sscanf(buf + 3, "%s", name);
+                db = find_db(name);
+            }
+            else if (strncmp(buf, "TABLE ", 6) == 0)
+            {
+                int col_cnt = 0;
+                long rows = 0, offset = 0, len = 0;
+                sscanf(buf + 6, "%s %d %ld %ld %ld", name, &col_cnt, &rows, &offset, &len);
+                for (struct Table *t = db ? db->tables : NULL; t; t = t->next)
+                    if (strcasecmp_dbms(t->name, name) == 0 && t->disk_path && !t->disk_owned)
+                    {
+                        t->disk_offset = offset;
+                        t->disk_len = len;
+                        t->disk_binary = 1;
+                    }
+                // 跳过列定义
+                for (int i = 0; i < col_cnt && fgets(buf, sizeof(buf), fp); ++i)
+                    ;
             }
         }
     }
-    printf("[DB] Update %s\n", table);
+    fclose(fp);
 }
 
-// 执行delete语句，按条件批量删除
-// table: 表名
-// cond: where条件表达式
-void db_delete(const char *table, struct Condition *cond)
+// 用新写好的快照替换数据文件
+static int snapshot_install(const char *tmp_path)
 {
-    struct Table *t = find_table(table);
-    if (!t)
-    {
-        printf("[DB] Table not found: %s\n", table);
+    remove(db_dump_file);
+    if (rename(tmp_path, db_dump_file) != 0)
+        return -1;
+    snapshot_relocate();
+    return 0;
+}
+
+// 保存当前所有数据库、表结构和数据到文件，实现持久化存储
+// 加载时只读目录，表数据在首次访问时才读入
+void save_db()
+{
+    checkpoint_wait(); // 等待后台检查点结束，避免两个快照同时写入
+    double t0 = db_now_us();
+    // 先写入临时文件再替换，避免保存中途出错损坏原有快照
+    char tmp_path[300];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", db_dump_file);
+    if (snapshot_write(tmp_path) != 0 || snapshot_install(tmp_path) != 0)
         return;
-    }
-    struct Row **p = &t->rows;
-    // 遍历所有行，删除满足条件的行
-    while (*p)
+    journal_truncate();
+    stats_record(HIST_SAVE_DB, db_now_us() - t0);
+}
+
+// 解析一行数据（ROW 之后的部分），返回值链表
+static struct Value *parse_row(struct Table *t, char *p)
+{
+    struct Value *vlist = NULL, **vtail = &vlist;
+    // 依次读取每个字段的值
+    for (struct ColumnDef *c = t->columns; c; c = c->next)
     {
-        if (row_match(*p, t->columns, cond))
+        while (*p == ' ')
+            ++p;
+        if (*p == 'I')
         {
-            struct Row *del = *p;
-            *p = del->next; // 从链表中移除
-            free_value_list(del->values);
-            free(del);
+            int ival;
+            p += 2;
+            sscanf(p, "%d", &ival);
+            struct Value *v = (struct Value *)calloc(1, sizeof(struct Value));
+            v->is_int = 1;
+            v->int_val = ival;
+            *vtail = v;
+            vtail = &v->next;
+            while (*p && *p != ' ')
+                ++p;
         }
-        else
+        else if (*p == 'S')
+        {
+            char sval[128];
+            p += 2;
+            sscanf(p, "%s", sval);
+            struct Value *v = (struct Value *)calloc(1, sizeof(struct Value));
+            v->is_int = 0;
+            v->str_val = strdup(sval);
+            *vtail = v;
+            vtail = &v->next;
+            while (*p && *p != ' ')
+                ++p;
+        }
+        else if (*p == 'N')
         {
-            p = &(*p)->next;
+            struct Value *v = (struct Value *)calloc(1, sizeof(struct Value));
+            v->is_int = 1;
+            v->int_val = 0;
+            *vtail = v;
+            vtail = &v->next;
+            ++p;
         }
     }
-    printf("[DB] Delete from %s\n", table);
+    return vlist;
 }
 
-// 退出数据库系统，保存数据并释放所有内存
-void db_exit()
+// 读入文本行格式的表数据（SNAPSHOT 2）
+static void table_load_text(struct Table *t, FILE *fp, struct Row **tail)
 {
-    save_db(); // 退出时自动保存数据库
-    // 释放所有内存
-    while (db_list)
+    long end = t->disk_offset + t->disk_len;
+    char buf[4096];
+    while (ftell(fp) < end && fgets(buf, sizeof(buf), fp))
     {
-        struct Database *db = db_list;
-        db_list = db->next;
-        while (db->tables)
+        if (strncmp(buf, "ROW", 3) != 0)
+            continue;
+        struct Value *vlist = parse_row(t, buf + 3);
+        struct Row *row = (struct Row *)db_alloc(sizeof(struct Row));
+        row->values = table_row_values(t, vlist);
+        row->schema = t->schema_version;
+        free_value_list(vlist);
+        t->row_bytes += ROW_BYTES(t);
+        *tail = row;
+        tail = &row->next;
+    }
+}
+
+// 一列解码后的数据
+struct ColData
+{
+    int kind;
+    int *tags;   // COL_MIXED：每行是否为整数
+    int *ints;   // 整数值
+    int *ids;    // 字符串编号，0为NULL
+    char **dict; // 列内字典，登记到表的列字典后改为引用其中的字符串
+    int *codes;  // 字典项的等价类编号
+    int dict_count;
+};
+
+static void col_data_free(struct ColData *c)
+{
+    free(c->tags);
+    free(c->ints);
+    free(c->ids);
+    if (c->dict)
+    {
+        for (int i = 1; !c->codes && i < c->dict_count; ++i)
+            free(c->dict[i]);
+        free(c->dict);
+    }
+    free(c->codes);
+}
+
+// 解码二进制列格式的表数据，追加到 *tail；数据损坏返回-1，表保持不变
+static int table_load_binary(struct Table *t, FILE *fp, struct Row **tail)
+{
+    unsigned char head[9];
+    if (t->disk_len < (long)sizeof(head) || fread(head, 1, sizeof(head), fp) != sizeof(head))
+        return -1;
+    size_t raw_len = head[1] | head[2] << 8 | head[3] << 16 | (size_t)head[4] << 24;
+    size_t stored = head[5] | head[6] << 8 | head[7] << 16 | (size_t)head[8] << 24;
+    if (head[0] > 1 || stored != (size_t)t->disk_len - sizeof(head) || (head[0] == 0 && raw_len != stored))
+        return -1;
+    unsigned char *data = (unsigned char *)malloc(stored ? stored : 1);
+    int ok = fread(data, 1, stored, fp) == stored;
+    if (ok && head[0] == 1)
+    {
+        unsigned char *raw = (unsigned char *)malloc(raw_len ? raw_len : 1);
+        ok = lz_decompress(data, stored, raw, raw_len) == 0;
+        free(data);
+        data = raw;
+    }
+    struct ByteReader r = {data, data + raw_len, 0};
+    unsigned long long n = ok ? br_varint(&r) : 0, ncols = ok ? br_varint(&r) : 0;
+    // 行数必须与目录记录的一致（差值编码的有序列每行可以不占一位，不能按数据长度估计上限）
+    if (!ok || r.err || ncols != (unsigned long long)t->col_count || n != (unsigned long long)t->disk_rows || n > 0x7fffffffull / sizeof(int))
+    {
+        free(data);
+        return -1;
+    }
+    int rows = (int)n;
+    size_t arr = sizeof(int) * (rows ? rows : 1);
+    struct ColData *cols = (struct ColData *)calloc(t->col_count ? t->col_count : 1, sizeof(struct ColData));
+    for (int i = 0; i < t->col_count && ok; ++i)
+    {
+        struct ColData *c = &cols[i];
+        c->kind = (int)br_u8(&r);
+        if (c->kind == COL_MIXED)
         {
-            struct Table *t = db->tables;
-            db->tables = t->next;
-            free(t->name);
-            free_column_defs(t->columns);
-            struct Row *r = t->rows;
-            while (r)
+            c->tags = (int *)malloc(arr);
+            ok = dec_ints(&r, c->tags, rows) == 0;
+        }
+        if (ok && (c->kind == COL_MIXED || c->kind == COL_INT))
+        {
+            c->ints = (int *)malloc(arr);
+            ok = dec_ints(&r, c->ints, rows) == 0;
+        }
+        if (ok && (c->kind == COL_MIXED || c->kind == COL_STR))
+        {
+            c->ids = (int *)malloc(arr);
+            ok = dec_strs(&r, rows, &c->dict, &c->dict_count, c->ids) == 0;
+        }
+        if (c->kind > COL_MIXED || r.err)
+            ok = 0;
+    }
+    free(data);
+    if (ok)
+    {
+        // 列内字典的每一项只向表的列字典登记一次，各行直接引用登记后的字符串
+        for (int i = 0; i < t->col_count; ++i)
+        {
+            struct ColData *c = &cols[i];
+            if (!c->dict)
+                continue;
+            if (c->dict_count > 1 && !t->dicts[i])
+                t->dicts[i] = dict_create();
+            c->codes = (int *)malloc(sizeof(int) * c->dict_count);
+            c->codes[0] = -1;
+            for (int k = 1; k < c->dict_count; ++k)
             {
-                struct Row *tr = r;
-                r = r->next;
-                free_value_list(tr->values);
-                free(tr);
+                char *s = dict_intern(t->dicts[i], c->dict[k], &c->codes[k]);
+                free(c->dict[k]);
+                c->dict[k] = s;
             }
-            free(t);
         }
-        free(db->name);
-        free(db);
+        for (int j = 0; j < rows; ++j)
+        {
+            struct Row *row = (struct Row *)db_alloc(sizeof(struct Row));
+            struct Value **vt = &row->values;
+            row->schema = t->schema_version;
+            for (int i = 0; i < t->col_count; ++i)
+            {
+                struct ColData *c = &cols[i];
+                struct Value *nv = (struct Value *)db_alloc(sizeof(struct Value));
+                if (c->kind == COL_INT || (c->kind == COL_MIXED && c->tags[j]))
+                {
+                    nv->is_int = 1;
+                    nv->int_val = c->ints[j];
+                    nv->code = -1;
+                }
+                else
+                {
+                    nv->str_val = c->dict[c->ids[j]];
+                    nv->code = c->codes[c->ids[j]];
+                }
+                *vt = nv;
+                vt = &nv->next;
+            }
+            t->row_bytes += ROW_BYTES(t);
+            *tail = row;
+            tail = &row->next;
+        }
     }
-    printf("[DB] Exit\n");
-    exit(0);
+    for (int i = 0; i < t->col_count; ++i)
+        col_data_free(&cols[i]);
+    free(cols);
+    return ok ? 0 : -1;
 }
 
-// ================== 持久化存储 ==================
-#define DB_DUMP_FILE "data.db"
+// 读入不在内存中的表的数据，保持原有的行顺序
+static void table_materialize(struct Table *t)
+{
+    char *path = t->disk_path;
+    t->disk_path = NULL;
+    FILE *fp = fopen(path, "rb");
+    struct Row **tail = &t->rows;
+    while (*tail)
+        tail = &(*tail)->next;
+    int ok = fp && fseek(fp, t->disk_offset, SEEK_SET) == 0;
+    if (ok && t->disk_binary)
+        ok = table_load_binary(t, fp, tail) == 0;
+    else if (ok)
+        table_load_text(t, fp, tail);
+    if (!ok)
+        db_error("[DB] Cannot load table %s from %s\n", t->name, path);
+    table_rebuild_blocks(t);
+    table_rebuild_indexes(t);
+    if (fp)
+        fclose(fp);
+    if (t->disk_owned)
+        remove(path);
+    free(path);
+    t->disk_owned = 0;
+    t->disk_binary = 0;
+    t->disk_rows = 0;
+}
 
-// 保存当前所有数据库、表结构和数据到文件，实现持久化存储
-void save_db()
+// 快照目录中一列上的文本索引
+struct IndexSpec
 {
-    FILE *fp = fopen(DB_DUMP_FILE, "w"); // 以写模式打开数据文件
-    if (!fp)
-        return;
-    // 遍历所有数据库
-    for (struct Database *db = db_list; db; db = db->next)
+    char name[64]; // 空串表示没有索引
+    int trigram;
+    char bitmap[64]; // 位图索引名，空串表示没有
+};
+
+// 读取一组列定义（每行"列名 类型 [约束] [INDEX=名字|TRIGRAM=名字] [BITMAP=名字] [DEFAULT=i:整数|DEFAULT=s:十六进制]"），
+// specs非NULL时返回各列的文本索引和位图索引
+static struct ColumnDef *read_column_defs(FILE *fp, int col_cnt, struct IndexSpec *specs)
+{
+    char buf[4096];
+    struct ColumnDef *cols = NULL, **tail = &cols;
+    for (int i = 0; i < col_cnt && fgets(buf, sizeof(buf), fp); ++i)
     {
-        fprintf(fp, "DB %s\n", db->name); // 写入数据库名
-        // 遍历数据库下所有表
-        for (struct Table *t = db->tables; t; t = t->next)
+        char cname[64], ctype[64];
+        int pos = 0;
+        sscanf(buf, "%63s %63s%n", cname, ctype, &pos);
+        struct ColumnDef *c = (struct ColumnDef *)malloc(sizeof(struct ColumnDef));
+        c->name = strdup(cname);
+        c->type = strdup(ctype);
+        c->constraint = CONSTRAINT_NONE;
+        c->def = NULL;
+        for (char *tok = strtok(buf + pos, " \r\n"); tok; tok = strtok(NULL, " \r\n"))
         {
-            fprintf(fp, "TABLE %s\n", t->name); // 写入表名
-            int col_cnt = 0;
-            for (struct ColumnDef *c = t->columns; c; c = c->next)
-                ++col_cnt;
-            fprintf(fp, "COLS %d\n", col_cnt); // 写入列数
-            // 写入每个字段的名字和类型
-            for (struct ColumnDef *c = t->columns; c; c = c->next)
-                fprintf(fp, "%s %s\n", c->name, c->type);
-            // 写入所有数据行
-            for (struct Row *r = t->rows; r; r = r->next)
+            if (strcmp(tok, "PRIMARY_KEY") == 0)
+                c->constraint = CONSTRAINT_PRIMARY_KEY;
+            else if (strcmp(tok, "UNIQUE") == 0)
+                c->constraint = CONSTRAINT_UNIQUE;
+            else if (specs && (strncmp(tok, "INDEX=", 6) == 0 || strncmp(tok, "TRIGRAM=", 8) == 0))
+            {
+                specs[i].trigram = tok[0] == 'T';
+                snprintf(specs[i].name, sizeof(specs[i].name), "%s", strchr(tok, '=') + 1);
+            }
+            else if (specs && strncmp(tok, "BITMAP=", 7) == 0)
+                snprintf(specs[i].bitmap, sizeof(specs[i].bitmap), "%s", tok + 7);
+            else if (strncmp(tok, "DEFAULT=", 8) == 0 && (tok[8] == 'i' || tok[8] == 's') && tok[9] == ':')
             {
-                fprintf(fp, "ROW"); // 行起始标记
-                struct Value *v = r->values;
-                for (struct ColumnDef *c = t->columns; c; c = c->next)
+                struct Value *d = (struct Value *)calloc(1, sizeof(struct Value));
+                d->code = -1;
+                d->is_int = tok[8] == 'i';
+                if (d->is_int)
+                    d->int_val = atoi(tok + 10);
+                else
                 {
-                    if (v)
-                    {
-                        if (v->is_int)
-                            fprintf(fp, " I %d", v->int_val); // 整型数据
-                        else
-                            fprintf(fp, " S %s", v->str_val ? v->str_val : ""); // 字符串数据
-                        v = v->next;
-                    }
-                    else
+                    // 字符串按十六进制保存，可以包含空格
+                    size_t len = strlen(tok + 10) / 2;
+                    d->str_val = (char *)malloc(len + 1);
+                    for (size_t k = 0; k < len; ++k)
                     {
-                        fprintf(fp, " N"); // 空值
+                        unsigned int byte;
+                        sscanf(tok + 10 + 2 * k, "%2x", &byte);
+                        d->str_val[k] = (char)byte;
                     }
+                    d->str_val[len] = '\0';
                 }
-                fprintf(fp, "\n"); // 行结束
+                c->def = d;
             }
         }
+        c->next = NULL;
+        *tail = c;
+        tail = &c->next;
     }
-    fclose(fp); // 关闭文件
+    return cols;
 }
 
-// 从文件加载数据库、表结构和数据到内存，实现持久化恢复
-void load_db()
+// 旧格式的快照：数据库、表结构和数据行依次排列，全部读入内存
+static void load_db_legacy(FILE *fp)
 {
-    FILE *fp = fopen(DB_DUMP_FILE, "r"); // 以读模式打开数据文件
-    if (!fp)
-    {
-        printf("[LOAD_DB] Cannot open %s\n", DB_DUMP_FILE);
-        return;
-    }
     char buf[256];
     struct Table *cur_table = NULL; // 当前正在处理的表
-    int line = 0;
     while (fgets(buf, sizeof(buf), fp))
     {
-        ++line;
         // 解析数据库名
         if (strncmp(buf, "DB ", 3) == 0)
         {
@@ -915,23 +6892,8 @@ void load_db()
             sscanf(buf + 6, "%s", tname);
             int col_cnt = 0;
             fgets(buf, sizeof(buf), fp);
-            ++line;
             sscanf(buf, "COLS %d", &col_cnt);
-            struct ColumnDef *cols = NULL, **tail = &cols;
-            // 读取每个字段的名字和类型
-            for (int i = 0; i < col_cnt; ++i)
-            {
-                fgets(buf, sizeof(buf), fp);
-                ++line;
-                char cname[64], ctype[64];
-                sscanf(buf, "%s %s", cname, ctype);
-                struct ColumnDef *c = (struct ColumnDef *)malloc(sizeof(struct ColumnDef));
-                c->name = strdup(cname);
-                c->type = strdup(ctype);
-                c->next = NULL;
-                *tail = c;
-                tail = &c->next;
-            }
+            struct ColumnDef *cols = read_column_defs(fp, col_cnt, NULL);
             db_create_table(tname, cols); // 创建表
             free_column_defs(cols);       // 释放临时列定义
             cur_table = find_table(tname);
@@ -943,52 +6905,319 @@ void load_db()
             {
                 continue;
             }
-            struct Value *vlist = NULL, **vtail = &vlist;
-            char *p = buf + 3;
-            // 依次读取每个字段的值
-            for (struct ColumnDef *c = cur_table->columns; c; c = c->next)
+            struct Value *vlist = parse_row(cur_table, buf + 3);
+            db_insert(cur_table->name, NULL, vlist); // 插入数据行
+            free_value_list(vlist);                  // 释放临时值链表
+        }
+    }
+}
+
+// 从文件加载数据库和表结构，实现持久化恢复
+// 只读取快照开头的目录，各表的数据在首次访问时读入
+void load_db()
+{
+    double t0 = db_now_us();
+    FILE *fp = fopen(db_dump_file, "rb"); // 以读模式打开数据文件
+    if (!fp)
+    {
+        if (quiet < QUIET_SILENT)
+            printf("[LOAD_DB] Cannot open %s\n", db_dump_file);
+        return;
+    }
+    char buf[512];
+    loading = 1;
+    if (!fgets(buf, sizeof(buf), fp))
+        buf[0] = '\0';
+    int binary = strncmp(buf, SNAPSHOT_MAGIC, strlen(SNAPSHOT_MAGIC)) == 0;
+    if (!binary && strncmp(buf, SNAPSHOT_MAGIC_TEXT, strlen(SNAPSHOT_MAGIC_TEXT)) != 0)
+    {
+        rewind(fp);
+        load_db_legacy(fp);
+    }
+    else
+    {
+        while (fgets(buf, sizeof(buf), fp) && strncmp(buf, "END", 3) != 0)
+        {
+            // 解析数据库名
+            if (strncmp(buf, "DB ", 3) == 0)
+            {
+                char name[128];
+                sscanf(buf + 3, "%s", name);
+                db_create_database(name); // 创建数据库
+                db_use_database(name);    // 切换当前数据库
+            }
+            // 解析表结构和数据位置
+            else if (strncmp(buf, "TABLE ", 6) == 0)
             {
-                while (*p == ' ')
-                    ++p;
-                if (*p == 'I')
-                {
-                    int ival;
-                    p += 2;
-                    sscanf(p, "%d", &ival);
-                    struct Value *v = (struct Value *)calloc(1, sizeof(struct Value));
-                    v->is_int = 1;
-                    v->int_val = ival;
-                    *vtail = v;
-                    vtail = &v->next;
-                    while (*p && *p != ' ')
-                        ++p;
-                }
-                else if (*p == 'S')
+                char tname[128];
+                int col_cnt = 0;
+                long rows = 0, offset = 0, len = 0;
+                sscanf(buf + 6, "%s %d %ld %ld %ld", tname, &col_cnt, &rows, &offset, &len);
+                struct IndexSpec *specs = (struct IndexSpec *)calloc(col_cnt > 0 ? col_cnt : 1, sizeof(struct IndexSpec));
+                struct ColumnDef *cols = read_column_defs(fp, col_cnt, specs);
+                db_create_table(tname, cols); // 创建表
+                free_column_defs(cols);       // 释放临时列定义
+                struct Table *t = current_db ? current_db->tables : NULL; // 新表位于表头
+                for (int i = 0; t && i < col_cnt && i < t->col_count; ++i)
                 {
-                    char sval[128];
-                    p += 2;
-                    sscanf(p, "%s", sval);
-                    struct Value *v = (struct Value *)calloc(1, sizeof(struct Value));
-                    v->is_int = 0;
-                    v->str_val = strdup(sval);
-                    *vtail = v;
-                    vtail = &v->next;
-                    while (*p && *p != ' ')
-                        ++p;
+                    if (specs[i].name[0])
+                        table_add_text_index(t, i, specs[i].name, specs[i].trigram);
+                    if (specs[i].bitmap[0])
+                        table_add_bitmap_index(t, i, bitmap_index_create(specs[i].bitmap));
                 }
-                else if (*p == 'N')
+                free(specs);
+                if (t && len > 0)
                 {
-                    struct Value *v = (struct Value *)calloc(1, sizeof(struct Value));
-                    v->is_int = 1;
-                    v->int_val = 0;
-                    *vtail = v;
-                    vtail = &v->next;
-                    ++p;
+                    t->disk_path = strdup(db_dump_file);
+                    t->disk_offset = offset;
+                    t->disk_len = len;
+                    t->disk_rows = rows;
+                    t->disk_binary = binary;
                 }
             }
-            db_insert(cur_table->name, NULL, vlist); // 插入数据行
-            free_value_list(vlist);                  // 释放临时值链表
         }
     }
     fclose(fp); // 关闭文件
+    loading = 0;
+    stats_record(HIST_LOAD_DB, db_now_us() - t0);
+}
+
+// ================== 检查点（CHECKPOINT） ==================
+// CHECKPOINT 在后台写一份时间点一致的快照，不阻塞后续语句：
+// 持有数据库锁时fork，子进程写快照（内存由内核写时复制），父进程继续执行语句。
+// 开始时把提交日志轮换为 .old，之后提交的语句写入新日志；快照写完后由父进程替换数据文件
+// 并删除 .old。子进程失败或中途崩溃时 .old 与新日志合并，启动时依次重放两者。
+// 不支持fork的平台（Windows）退化为同步写快照
+static int checkpoint_interval = 0;  // 定期检查点的间隔（秒），0表示关闭
+static double checkpoint_last_us = 0; // 上一次检查点开始的时刻
+static double checkpoint_t0 = 0;      // 当前检查点开始的时刻
+static int checkpoint_pid = 0;        // 正在写快照的子进程
+static int checkpoint_pipe = -1;      // 进度管道的读端
+static char checkpoint_tmp[300];
+static char journal_old[300];
+
+// 上一次检查点的结果
+static struct SnapshotProgress checkpoint_last;
+static int checkpoint_last_ok = -1; // -1表示尚未做过检查点
+
+static const char *journal_old_file()
+{
+    snprintf(journal_old, sizeof(journal_old), "%s.journal.old", db_dump_file);
+    return journal_old;
+}
+
+// 提交日志在检查点进行中被轮换出的部分（启动时先于提交日志重放）
+const char *db_journal_old_path()
+{
+    return journal_old_file();
+}
+
+// 把文件src的内容追加到dst后删除src
+static void append_file(const char *src, const char *dst)
+{
+    FILE *in = fopen(src, "rb");
+    if (!in)
+        return;
+    FILE *out = fopen(dst, "ab");
+    if (out)
+    {
+        char chunk[65536];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), in)) > 0)
+            fwrite(chunk, 1, n, out);
+        fclose(out);
+    }
+    fclose(in);
+    remove(src);
+}
+
+// 轮换提交日志：已提交的语句移到 .old（上次检查点失败留下的 .old 在其后追加）
+static void journal_rotate()
+{
+    if (journal_fp)
+    {
+        fclose(journal_fp);
+        journal_fp = NULL;
+    }
+    FILE *fp = fopen(journal_old_file(), "rb");
+    if (fp)
+    {
+        fclose(fp);
+        append_file(journal_file(), journal_old);
+    }
+    else
+        rename(journal_file(), journal_old);
+    // 新日志从空白上下文开始，第一条语句前会补写USE
+    journal_db[0] = journal_db_written[0] = '\0';
+}
+
+// 检查点失败：.old 与新日志按顺序合并回提交日志
+static void journal_unrotate()
+{
+    if (journal_fp)
+    {
+        fclose(journal_fp);
+        journal_fp = NULL;
+    }
+    append_file(journal_file(), journal_old_file());
+    rename(journal_old, journal_file());
+    journal_db[0] = journal_db_written[0] = '\0';
+}
+
+// 检查点结束：成功时替换数据文件并删除被轮换的日志
+static void checkpoint_finish(int ok)
+{
+    if (ok && snapshot_install(checkpoint_tmp) == 0)
+        remove(journal_old_file());
+    else
+    {
+        ok = 0;
+        remove(checkpoint_tmp);
+        journal_unrotate();
+    }
+    checkpoint_last = snap_progress;
+    checkpoint_last_ok = ok;
+    if (ok)
+        DB_INFO("[DB] Checkpoint completed: %d tables, %ld rows, %ld bytes in %.1f ms\n", checkpoint_last.tables_done,
+                checkpoint_last.rows, checkpoint_last.bytes, checkpoint_last.ms);
+    else
+        db_error("[DB] Checkpoint failed, journal kept\n");
+}
+
+#ifndef _WIN32
+// 读取子进程报告的最新进度
+static void checkpoint_read_progress()
+{
+    struct SnapshotProgress p;
+    while (read(checkpoint_pipe, &p, sizeof(p)) == (ssize_t)sizeof(p))
+        snap_progress = p;
+}
+
+// 回收子进程；block为0时子进程未结束则直接返回
+static void checkpoint_reap(int block)
+{
+    if (checkpoint_pid <= 0)
+        return;
+    int status = 0;
+    checkpoint_read_progress();
+    pid_t r = waitpid(checkpoint_pid, &status, block ? 0 : WNOHANG);
+    if (r == 0)
+        return;
+    checkpoint_read_progress();
+    close(checkpoint_pipe);
+    checkpoint_pipe = -1;
+    checkpoint_pid = 0;
+    checkpoint_finish(r > 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+#endif
+
+// 语句开始前检查后台检查点是否已结束
+static void checkpoint_poll()
+{
+#ifndef _WIN32
+    checkpoint_reap(0);
+#endif
+}
+
+// 等待后台检查点结束
+static void checkpoint_wait()
+{
+#ifndef _WIN32
+    checkpoint_reap(1);
+#endif
+}
+
+// 输出检查点进度或上一次的结果
+static void checkpoint_show()
+{
+    checkpoint_poll();
+    if (checkpoint_pid > 0)
+        printf("[DB] Checkpoint in progress (pid %d): %d/%d tables, %ld rows, %ld bytes, %.1f ms elapsed\n",
+               checkpoint_pid, snap_progress.tables_done, snap_progress.tables_total, snap_progress.rows,
+               snap_progress.bytes, (db_now_us() - checkpoint_t0) / 1e3);
+    else if (checkpoint_last_ok >= 0)
+        printf("[DB] Last checkpoint %s: %d/%d tables, %ld rows, %ld bytes in %.1f ms\n",
+               checkpoint_last_ok ? "completed" : "failed", checkpoint_last.tables_done, checkpoint_last.tables_total,
+               checkpoint_last.rows, checkpoint_last.bytes, checkpoint_last.ms);
+    else
+        printf("[DB] No checkpoint has run\n");
+}
+
+// 开始一次检查点。事务进行中内存里有未提交的修改，不做检查点
+static void checkpoint_start()
+{
+    checkpoint_t0 = checkpoint_last_us = db_now_us();
+    journal_rotate();
+    snprintf(checkpoint_tmp, sizeof(checkpoint_tmp), "%s.ckpt", db_dump_file);
+    memset(&snap_progress, 0, sizeof(snap_progress));
+    for (struct Database *db = db_list; db; db = db->next)
+        for (struct Table *t = db->tables; t; t = t->next)
+            ++snap_progress.tables_total;
+#ifndef _WIN32
+    // 溢出文件可能在子进程读取前被父进程删除，预先打开供子进程使用
+    for (struct Database *db = db_list; db; db = db->next)
+        for (struct Table *t = db->tables; t; t = t->next)
+            if (t->disk_path && t->disk_owned)
+                t->disk_fp = fopen(t->disk_path, "rb");
+    int fds[2] = {-1, -1};
+    pid_t pid = pipe(fds) == 0 ? fork() : -1;
+    if (pid == 0)
+    {
+        // 子进程：只写快照，不执行atexit处理，也不刷出从父进程继承的输出缓冲区
+        close(fds[0]);
+        snap_progress_fd = fds[1];
+        _exit(snapshot_write(checkpoint_tmp) == 0 ? 0 : 1);
+    }
+    for (struct Database *db = db_list; db; db = db->next)
+        for (struct Table *t = db->tables; t; t = t->next)
+            if (t->disk_fp)
+            {
+                fclose(t->disk_fp);
+                t->disk_fp = NULL;
+            }
+    if (pid > 0)
+    {
+        close(fds[1]);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        checkpoint_pid = pid;
+        checkpoint_pipe = fds[0];
+        DB_INFO("[DB] Checkpoint started in background (pid %d)\n", (int)pid);
+        return;
+    }
+    if (fds[0] >= 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+    }
+    printf("[DB] Cannot start background checkpoint, writing it synchronously\n");
+#endif
+    checkpoint_finish(snapshot_write(checkpoint_tmp) == 0);
+}
+
+// CHECKPOINT 语句：已有检查点在进行时输出其进度
+void db_checkpoint()
+{
+    checkpoint_poll();
+    if (checkpoint_pid > 0)
+        checkpoint_show();
+    else if (txn_active)
+        db_error("[DB] Cannot CHECKPOINT inside a transaction\n");
+    else
+        checkpoint_start();
+}
+
+// 语句结束时检查是否到了定期检查点的时间（只在上次之后有新的提交时进行）
+static void checkpoint_tick()
+{
+    if (checkpoint_interval <= 0 || checkpoint_pid > 0 || txn_active || journal_replaying || !journal_fp)
+        return;
+    if (db_now_us() - checkpoint_last_us >= checkpoint_interval * 1e6)
+        checkpoint_start();
+}
+
+// 设置定期检查点的间隔，从设置时开始计时
+static void checkpoint_set_interval(int seconds)
+{
+    checkpoint_interval = seconds > 0 ? seconds : 0;
+    checkpoint_last_us = db_now_us();
 }
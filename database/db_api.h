@@ -7,19 +7,98 @@
 void db_create_database(const char *name);
 void db_use_database(const char *name);
 void db_create_table(const char *name, struct ColumnDef *cols);
+void db_create_index(const char *name, const char *table, const char *col, const char *method);
+void db_alter_add_column(const char *table, struct ColumnDef *col);
+void db_alter_drop_column(const char *table, const char *col);
 void db_show_tables();
 void db_show_databases();
 void db_drop_database(const char *name);
 void db_drop_table(const char *name);
 void db_insert(const char *table, struct ColumnList *cols, struct Value *values);
+void db_upsert(const char *table, struct ColumnList *cols, struct Value *values, int action, struct SetItem *set);
 void db_select(struct ColumnList *tables, struct SelectList *sel, struct Condition *cond);
 void db_update(const char *table, struct SetItem *set, struct Condition *cond);
 void db_delete(const char *table, struct Condition *cond);
 void db_exit();
+void db_close();
 void save_db();
 void load_db();
+void db_set_dump_file(const char *path);
+
+void db_set_explain(int mode);
+int db_explain_mode();
+void db_set_variable(const char *name, struct Value *value);
+void db_show(const char *name);
+void db_set_quiet(int on);
+void db_begin();
+void db_commit();
+void db_rollback();
+void db_stmt_begin(const char *text);
+void db_stmt_end();
+void db_vacuum(const char *table);
+void db_checkpoint();
+void db_journal_statement(const char *text);
+const char *db_journal_path();
+const char *db_journal_old_path();
+// 启动时重放提交日志，run解析并执行一段SQL文本（命令行程序和库接口各自提供）
+void db_replay_journals(void (*run)(const char *sql, size_t len));
+
+// 取消当前语句：只设置标志，可在信号处理函数中调用；语句在扫描或连接循环的下一次检查时中止，修改语句回滚
+// db_enable_cancel(1) 之后每条语句都检查取消标志（SET statement_timeout / statement_row_limit 时总是检查）
+void db_cancel();
+void db_enable_cancel(int on);
+
+// 错误信息：db_error 输出并记录，库接口通过出错次数的变化判断语句是否出错
+void db_error(const char *fmt, ...);
+void db_syntax_error(const char *msg);
+const char *db_last_error();
+long db_error_count();
+
+// 游标：逐行取SELECT的结果（库接口使用），取值不经过格式化输出
+struct Cursor;
+struct Cursor *db_cursor_open(struct ColumnList *tables, struct SelectList *sel, struct Condition *cond, const char *text);
+int db_cursor_next(struct Cursor *c);
+int db_cursor_column_count(struct Cursor *c);
+const char *db_cursor_column_name(struct Cursor *c, int i);
+struct Value *db_cursor_value(struct Cursor *c, int i);
+void db_cursor_close(struct Cursor *c);
+
+// 并发写入队列：多个线程不取锁地向同一个表入队行，后台写入线程按批插入并写入提交日志
+struct Ingest;
+struct Ingest *db_ingest_open(const char *table, int capacity);
+int db_ingest_push(struct Ingest *q, const struct Value *values);
+void db_ingest_flush(struct Ingest *q);
+void db_ingest_close(struct Ingest *q);
 
 // 工具函数声明
 struct Database *find_db(const char *name);
+const char *db_current_database();
+int strcasecmp_dbms(const char *a, const char *b);
+int strncasecmp_dbms(const char *a, const char *b, size_t n);
+double db_now_us();
+
+// 输出模式（db_set_quiet）
+enum
+{
+    QUIET_NONE = 0,  // 交互模式：输出结果和执行成功的提示信息
+    QUIET_INFO = 1,  // 脚本模式：不输出执行成功的提示信息
+    QUIET_SILENT = 2 // 嵌入模式（库接口）：SELECT结果和错误信息也不输出，错误只记录
+};
+
+// EXPLAIN模式
+enum
+{
+    EXPLAIN_NONE = 0,    // 正常执行
+    EXPLAIN_PLAN = 1,    // EXPLAIN：只输出执行计划
+    EXPLAIN_ANALYZE = 2  // EXPLAIN ANALYZE：执行并输出各阶段统计
+};
+
+// INSERT 遇到 PRIMARY KEY / UNIQUE 冲突时的处理方式
+enum
+{
+    CONFLICT_ERROR = 0,   // 报错，不插入
+    CONFLICT_NOTHING = 1, // ON CONFLICT DO NOTHING：跳过
+    CONFLICT_UPDATE = 2   // ON CONFLICT DO UPDATE SET ...：更新已有的行
+};
 
 #endif
@@ -0,0 +1,543 @@
+#include "db_codec.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ================== 字节缓冲区 ==================
+void bb_put(struct ByteBuf *b, const void *p, size_t n)
+{
+    if (b->len + n > b->cap)
+    {
+        while (b->len + n > b->cap)
+            b->cap = b->cap ? b->cap * 2 : 4096;
+        b->data = (unsigned char *)realloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+void bb_put_u8(struct ByteBuf *b, unsigned v)
+{
+    unsigned char c = (unsigned char)v;
+    bb_put(b, &c, 1);
+}
+
+// 小端序32位
+void bb_put_u32(struct ByteBuf *b, unsigned v)
+{
+    unsigned char c[4] = {(unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24)};
+    bb_put(b, c, 4);
+}
+
+// 无符号变长整数（每字节7位，最高位表示后面还有字节）
+void bb_put_varint(struct ByteBuf *b, unsigned long long v)
+{
+    unsigned char c[10];
+    int n = 0;
+    while (v >= 0x80)
+    {
+        c[n++] = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    c[n++] = (unsigned char)v;
+    bb_put(b, c, n);
+}
+
+void bb_free(struct ByteBuf *b)
+{
+    free(b->data);
+    b->data = NULL;
+    b->len = b->cap = 0;
+}
+
+unsigned br_u8(struct ByteReader *r)
+{
+    if (r->p >= r->end)
+    {
+        r->err = 1;
+        return 0;
+    }
+    return *r->p++;
+}
+
+unsigned br_u32(struct ByteReader *r)
+{
+    if (r->end - r->p < 4)
+    {
+        r->err = 1;
+        return 0;
+    }
+    unsigned v = r->p[0] | r->p[1] << 8 | r->p[2] << 16 | (unsigned)r->p[3] << 24;
+    r->p += 4;
+    return v;
+}
+
+unsigned long long br_varint(struct ByteReader *r)
+{
+    unsigned long long v = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        if (r->p >= r->end)
+            break;
+        unsigned c = *r->p++;
+        v |= (unsigned long long)(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return v;
+    }
+    r->err = 1;
+    return 0;
+}
+
+// ================== 位打包 ==================
+static int bit_width(unsigned x)
+{
+    return x ? 32 - __builtin_clz(x) : 0;
+}
+
+static unsigned zigzag(int v)
+{
+    return ((unsigned)v << 1) ^ (unsigned)(v >> 31);
+}
+
+static int unzigzag(unsigned z)
+{
+    return (int)((z >> 1) ^ (0u - (z & 1)));
+}
+
+// 每个值占w位，低位在前
+static void pack_bits(struct ByteBuf *b, const unsigned *v, int n, int w)
+{
+    unsigned long long acc = 0;
+    int bits = 0;
+    for (int i = 0; i < n; ++i)
+    {
+        acc |= (unsigned long long)v[i] << bits;
+        bits += w;
+        while (bits >= 8)
+        {
+            bb_put_u8(b, (unsigned)(acc & 0xff));
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+    if (bits > 0)
+        bb_put_u8(b, (unsigned)acc);
+}
+
+static int unpack_bits(struct ByteReader *r, unsigned *out, int n, int w)
+{
+    size_t bytes = ((size_t)n * w + 7) / 8;
+    if (w > 32 || (size_t)(r->end - r->p) < bytes)
+    {
+        r->err = 1;
+        return -1;
+    }
+    const unsigned char *p = r->p;
+    unsigned long long acc = 0;
+    int bits = 0;
+    unsigned mask = w == 32 ? 0xffffffffu : (1u << w) - 1;
+    for (int i = 0; i < n; ++i)
+    {
+        while (bits < w)
+        {
+            acc |= (unsigned long long)*p++ << bits;
+            bits += 8;
+        }
+        out[i] = (unsigned)acc & mask;
+        acc >>= w;
+        bits -= w;
+    }
+    r->p += bytes;
+    return 0;
+}
+
+// ================== 整数列 ==================
+#define INT_BLOCK 128
+
+enum
+{
+    INT_FOR = 0,  // 值 - 块内最小值
+    INT_DELTA = 1 // 相邻差值（zigzag）- 最小差值
+};
+
+void enc_ints(struct ByteBuf *b, const int *v, int n)
+{
+    unsigned tmp[INT_BLOCK];
+    for (int s = 0; s < n; s += INT_BLOCK)
+    {
+        int m = n - s < INT_BLOCK ? n - s : INT_BLOCK;
+        const int *x = v + s;
+        int mn = x[0], mx = x[0];
+        unsigned dmin = 0xffffffffu, dmax = 0;
+        for (int i = 0; i < m; ++i)
+        {
+            if (x[i] < mn)
+                mn = x[i];
+            if (x[i] > mx)
+                mx = x[i];
+            if (i > 0)
+            {
+                unsigned d = zigzag((int)((unsigned)x[i] - (unsigned)x[i - 1]));
+                if (d < dmin)
+                    dmin = d;
+                if (d > dmax)
+                    dmax = d;
+            }
+        }
+        int w_for = bit_width((unsigned)mx - (unsigned)mn);
+        int w_delta = m > 1 ? bit_width(dmax - dmin) : 32;
+        // 差值编码多存两个变长整数，位数明显更少时才使用（有序的自增列通常只需0~1位）
+        if ((size_t)(m - 1) * w_delta + 64 < (size_t)m * w_for)
+        {
+            bb_put_u8(b, INT_DELTA);
+            bb_put_varint(b, zigzag(x[0]));
+            bb_put_varint(b, dmin);
+            bb_put_u8(b, w_delta);
+            for (int i = 1; i < m; ++i)
+                tmp[i - 1] = zigzag((int)((unsigned)x[i] - (unsigned)x[i - 1])) - dmin;
+            pack_bits(b, tmp, m - 1, w_delta);
+        }
+        else
+        {
+            bb_put_u8(b, INT_FOR);
+            bb_put_varint(b, zigzag(mn));
+            bb_put_u8(b, w_for);
+            for (int i = 0; i < m; ++i)
+                tmp[i] = (unsigned)x[i] - (unsigned)mn;
+            pack_bits(b, tmp, m, w_for);
+        }
+    }
+}
+
+int dec_ints(struct ByteReader *r, int *out, int n)
+{
+    unsigned tmp[INT_BLOCK];
+    for (int s = 0; s < n; s += INT_BLOCK)
+    {
+        int m = n - s < INT_BLOCK ? n - s : INT_BLOCK;
+        int *x = out + s;
+        unsigned mode = br_u8(r);
+        if (mode == INT_DELTA)
+        {
+            x[0] = unzigzag((unsigned)br_varint(r));
+            unsigned dmin = (unsigned)br_varint(r);
+            int w = (int)br_u8(r);
+            if (r->err || unpack_bits(r, tmp, m - 1, w) < 0)
+                return -1;
+            for (int i = 1; i < m; ++i)
+                x[i] = (int)((unsigned)x[i - 1] + (unsigned)unzigzag(tmp[i - 1] + dmin));
+        }
+        else if (mode == INT_FOR)
+        {
+            unsigned mn = (unsigned)unzigzag((unsigned)br_varint(r));
+            int w = (int)br_u8(r);
+            if (r->err || unpack_bits(r, tmp, m, w) < 0)
+                return -1;
+            for (int i = 0; i < m; ++i)
+                x[i] = (int)(mn + tmp[i]);
+        }
+        else
+            return -1;
+    }
+    return r->err ? -1 : 0;
+}
+
+// ================== 字符串列 ==================
+enum
+{
+    STR_PACKED = 0, // 编号按位打包
+    STR_RLE = 1     // (游程长度, 编号) 对
+};
+
+static size_t varint_size(unsigned long long v)
+{
+    size_t n = 1;
+    while (v >= 0x80)
+    {
+        v >>= 7;
+        ++n;
+    }
+    return n;
+}
+
+void enc_strs(struct ByteBuf *b, char *const *v, int n)
+{
+    int cap = 16;
+    while (cap < n * 2)
+        cap <<= 1;
+    const char **keys = (const char **)calloc(cap, sizeof(char *));
+    unsigned *vals = (unsigned *)malloc(cap * sizeof(unsigned));
+    unsigned *ids = (unsigned *)malloc((n ? n : 1) * sizeof(unsigned));
+    const char **dict = (const char **)malloc((n + 1) * sizeof(char *));
+    unsigned k = 0;
+    // 按指针去重，建立列内字典
+    for (int i = 0; i < n; ++i)
+    {
+        if (!v[i])
+        {
+            ids[i] = 0;
+            continue;
+        }
+        unsigned h = (unsigned)(((uintptr_t)v[i] >> 3) * 2654435761u) & (cap - 1);
+        while (keys[h] && keys[h] != v[i])
+            h = (h + 1) & (cap - 1);
+        if (!keys[h])
+        {
+            keys[h] = v[i];
+            vals[h] = ++k;
+            dict[k] = v[i];
+        }
+        ids[i] = vals[h];
+    }
+    bb_put_varint(b, k);
+    for (unsigned i = 1; i <= k; ++i)
+    {
+        size_t len = strlen(dict[i]);
+        bb_put_varint(b, len);
+        bb_put(b, dict[i], len);
+    }
+    // 比较两种编号编码的大小
+    int w = bit_width(k);
+    size_t packed = ((size_t)n * w + 7) / 8, rle = 0;
+    for (int i = 0; i < n;)
+    {
+        int j = i;
+        while (j < n && ids[j] == ids[i])
+            ++j;
+        rle += varint_size(j - i) + varint_size(ids[i]);
+        i = j;
+    }
+    if (rle < packed)
+    {
+        bb_put_u8(b, STR_RLE);
+        for (int i = 0; i < n;)
+        {
+            int j = i;
+            while (j < n && ids[j] == ids[i])
+                ++j;
+            bb_put_varint(b, j - i);
+            bb_put_varint(b, ids[i]);
+            i = j;
+        }
+    }
+    else
+    {
+        bb_put_u8(b, STR_PACKED);
+        bb_put_u8(b, w);
+        pack_bits(b, ids, n, w);
+    }
+    free(keys);
+    free(vals);
+    free(ids);
+    free(dict);
+}
+
+static void free_dict(char **dict, unsigned count)
+{
+    for (unsigned i = 1; i < count; ++i)
+        free(dict[i]);
+    free(dict);
+}
+
+int dec_strs(struct ByteReader *r, int n, char ***dict_out, int *dict_count, int *ids)
+{
+    unsigned long long k = br_varint(r);
+    // 每个字典项至少占1字节，据此拒绝损坏的长度
+    if (r->err || k > (unsigned long long)(r->end - r->p))
+        return -1;
+    char **dict = (char **)malloc((size_t)(k + 1) * sizeof(char *));
+    dict[0] = NULL;
+    unsigned count = 1;
+    for (; count <= k; ++count)
+    {
+        unsigned long long len = br_varint(r);
+        if (r->err || len > (unsigned long long)(r->end - r->p))
+        {
+            free_dict(dict, count);
+            return -1;
+        }
+        dict[count] = (char *)malloc((size_t)len + 1);
+        memcpy(dict[count], r->p, (size_t)len);
+        dict[count][len] = '\0';
+        r->p += len;
+    }
+    unsigned mode = br_u8(r);
+    int ok = 0;
+    if (mode == STR_PACKED)
+    {
+        int w = (int)br_u8(r);
+        ok = !r->err && unpack_bits(r, (unsigned *)ids, n, w) == 0;
+        for (int i = 0; ok && i < n; ++i)
+            ok = (unsigned)ids[i] <= k;
+    }
+    else if (mode == STR_RLE)
+    {
+        int i = 0;
+        ok = 1;
+        while (ok && i < n)
+        {
+            unsigned long long run = br_varint(r), id = br_varint(r);
+            ok = !r->err && run > 0 && run <= (unsigned long long)(n - i) && id <= k;
+            for (unsigned long long j = 0; ok && j < run; ++j)
+                ids[i++] = (int)id;
+        }
+    }
+    if (!ok)
+    {
+        free_dict(dict, count);
+        return -1;
+    }
+    *dict_out = dict;
+    *dict_count = (int)count;
+    return 0;
+}
+
+// ================== LZ4块格式压缩 ==================
+// 序列：token（高4位字面量长度，低4位匹配长度-4），扩展长度字节，字面量，2字节偏移，扩展匹配长度
+// 与LZ4相同，最后5个字节总是字面量，最后一个匹配距离末尾至少12字节
+#define LZ_HASH_BITS 14
+#define LZ_MIN_MATCH 4
+#define LZ_LAST_LITERALS 5
+#define LZ_MF_LIMIT 12
+#define LZ_MAX_OFFSET 65535
+
+size_t lz_bound(size_t n)
+{
+    return n + n / 255 + 16;
+}
+
+static unsigned lz_read32(const unsigned char *p)
+{
+    unsigned v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static unsigned lz_hash(unsigned v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// 写扩展长度：每个255字节表示再加255，最后一个字节小于255
+static unsigned char *lz_put_len(unsigned char *op, size_t len)
+{
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = (unsigned char)len;
+    return op;
+}
+
+// 输出一个序列：字面量 [anchor, anchor+lit)，匹配长度mlen（0表示最后一个序列）
+static unsigned char *lz_put_sequence(unsigned char *op, const unsigned char *anchor, size_t lit, size_t off, size_t mlen)
+{
+    unsigned char *token = op++;
+    *token = (unsigned char)((lit >= 15 ? 15 : lit) << 4);
+    if (lit >= 15)
+        op = lz_put_len(op, lit - 15);
+    if (lit)
+        memcpy(op, anchor, lit);
+    op += lit;
+    if (mlen == 0)
+        return op;
+    *op++ = (unsigned char)(off & 0xff);
+    *op++ = (unsigned char)(off >> 8);
+    size_t ml = mlen - LZ_MIN_MATCH;
+    *token |= (unsigned char)(ml >= 15 ? 15 : ml);
+    if (ml >= 15)
+        op = lz_put_len(op, ml - 15);
+    return op;
+}
+
+size_t lz_compress(const unsigned char *src, size_t n, unsigned char *dst)
+{
+    unsigned *table = (unsigned *)calloc(1u << LZ_HASH_BITS, sizeof(unsigned)); // 位置+1，0表示空
+    const unsigned char *ip = src, *anchor = src, *end = src + n;
+    unsigned char *op = dst;
+    if (n > LZ_MF_LIMIT)
+    {
+        const unsigned char *mflimit = end - LZ_MF_LIMIT, *match_limit = end - LZ_LAST_LITERALS;
+        while (ip < mflimit)
+        {
+            unsigned seq = lz_read32(ip);
+            unsigned h = lz_hash(seq);
+            size_t ref = table[h];
+            table[h] = (unsigned)(ip - src) + 1;
+            if (!ref || (size_t)(ip - src) - (ref - 1) > LZ_MAX_OFFSET || lz_read32(src + ref - 1) != seq)
+            {
+                ++ip;
+                continue;
+            }
+            const unsigned char *m = src + ref - 1;
+            size_t mlen = LZ_MIN_MATCH;
+            while (ip + mlen < match_limit && m[mlen] == ip[mlen])
+                ++mlen;
+            op = lz_put_sequence(op, anchor, ip - anchor, ip - m, mlen);
+            ip += mlen;
+            anchor = ip;
+        }
+    }
+    op = lz_put_sequence(op, anchor, end - anchor, 0, 0);
+    free(table);
+    return op - dst;
+}
+
+int lz_decompress(const unsigned char *src, size_t n, unsigned char *dst, size_t dst_len)
+{
+    const unsigned char *ip = src, *iend = src + n;
+    unsigned char *op = dst, *oend = dst + dst_len;
+    while (ip < iend)
+    {
+        unsigned token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15)
+        {
+            unsigned s;
+            do
+            {
+                if (ip >= iend)
+                    return -1;
+                s = *ip++;
+                lit += s;
+            } while (s == 255);
+        }
+        if ((size_t)(iend - ip) < lit || (size_t)(oend - op) < lit)
+            return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if (ip >= iend)
+            break; // 最后一个序列只有字面量
+        if (iend - ip < 2)
+            return -1;
+        size_t off = ip[0] | (size_t)ip[1] << 8;
+        ip += 2;
+        if (off == 0 || off > (size_t)(op - dst))
+            return -1;
+        size_t ml = token & 15;
+        if (ml == 15)
+        {
+            unsigned s;
+            do
+            {
+                if (ip >= iend)
+                    return -1;
+                s = *ip++;
+                ml += s;
+            } while (s == 255);
+        }
+        ml += LZ_MIN_MATCH;
+        if ((size_t)(oend - op) < ml)
+            return -1;
+        const unsigned char *m = op - off;
+        if (off >= ml)
+            memcpy(op, m, ml);
+        else
+            for (size_t i = 0; i < ml; ++i) // 重叠拷贝（重复模式）
+                op[i] = m[i];
+        op += ml;
+    }
+    return op == oend ? 0 : -1;
+}
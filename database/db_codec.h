@@ -0,0 +1,47 @@
+#ifndef DB_CODEC_H
+#define DB_CODEC_H
+#include <stddef.h>
+
+// 可增长的字节缓冲区
+struct ByteBuf
+{
+    unsigned char *data;
+    size_t len;
+    size_t cap;
+};
+
+void bb_put(struct ByteBuf *b, const void *p, size_t n);
+void bb_put_u8(struct ByteBuf *b, unsigned v);
+void bb_put_u32(struct ByteBuf *b, unsigned v);
+void bb_put_varint(struct ByteBuf *b, unsigned long long v);
+void bb_free(struct ByteBuf *b);
+
+// 解码游标：所有读取函数越界时置 err 并返回0
+struct ByteReader
+{
+    const unsigned char *p;
+    const unsigned char *end;
+    int err;
+};
+
+unsigned br_u8(struct ByteReader *r);
+unsigned br_u32(struct ByteReader *r);
+unsigned long long br_varint(struct ByteReader *r);
+
+// 整数列：每128个值一块，按块选择FOR（减去块内最小值）或差分+FOR，再按位宽打包
+void enc_ints(struct ByteBuf *b, const int *v, int n);
+int dec_ints(struct ByteReader *r, int *out, int n);
+
+// 字符串列：列内字典 + 编号（按位打包或游程编码），编号0表示NULL
+// 相同内容的字符串通常是同一个指针（来自表的列字典），字典按指针去重
+void enc_strs(struct ByteBuf *b, char *const *v, int n);
+// 输出字典（*dict，共*dict_count项，下标0为NULL）和每个值的编号，由调用者free
+int dec_strs(struct ByteReader *r, int n, char ***dict, int *dict_count, int *ids);
+
+// LZ4块格式的通用压缩：返回压缩后的长度，dst 至少需要 lz_bound(n) 字节
+size_t lz_bound(size_t n);
+size_t lz_compress(const unsigned char *src, size_t n, unsigned char *dst);
+// 解压到 dst，返回-1表示数据损坏或长度不符
+int lz_decompress(const unsigned char *src, size_t n, unsigned char *dst, size_t dst_len);
+
+#endif
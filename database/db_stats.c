@@ -0,0 +1,252 @@
+#include "db_stats.h"
+#include "db_api.h"
+#include "db_codec.h"
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// ================== 延迟直方图 ==================
+// HDR风格的对数-线性直方图：小于32微秒的值精确计数，
+// 之后每个2的幂区间再均分为16个子桶，相对误差约6%
+#define SUB_BUCKETS 16
+#define MAX_SHIFT 32
+#define BUCKET_COUNT ((MAX_SHIFT + 2) * SUB_BUCKETS)
+
+// 所有计数器均为原子变量，记录时无需加锁
+struct Histogram
+{
+    atomic_ullong buckets[BUCKET_COUNT];
+    atomic_ullong count;  // 样本数
+    atomic_ullong sum_us; // 总耗时（微秒）
+    atomic_ullong max_us; // 最大耗时（微秒）
+};
+
+static struct Histogram hists[HIST_COUNT];
+static atomic_llong rows_read;
+static atomic_llong rows_written;
+static atomic_llong slow_count;
+
+static const char *hist_names[HIST_COUNT] = {"SELECT", "INSERT", "UPDATE", "DELETE", "CREATE", "DROP",
+                                             "USE", "SHOW", "EXPLAIN", "SET", "TXN", "VACUUM", "CHECKPOINT", "ALTER", "save_db", "load_db"};
+
+// 慢查询日志配置
+static int slow_threshold_ms = 1000;
+static char slow_log_path[256] = "slow_query.log";
+
+// 最近一条语句：开始时的出错次数、延迟、是否出错
+static long stmt_errors_begin;
+static double last_latency_us;
+static int last_failed;
+
+static void capture_statement(int type, double start_us, double us, int failed, const char *text);
+
+// 计算值所在的桶下标
+static int bucket_index(unsigned long long v)
+{
+    if (v < 2 * SUB_BUCKETS)
+        return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - 4;
+    if (shift > MAX_SHIFT)
+        return BUCKET_COUNT - 1;
+    return shift * SUB_BUCKETS + (int)(v >> shift);
+}
+
+// 桶内值的上界，作为分位数的估计值
+static unsigned long long bucket_upper(int idx)
+{
+    if (idx < 2 * SUB_BUCKETS)
+        return (unsigned long long)idx;
+    int shift = idx / SUB_BUCKETS - 1;
+    unsigned long long m = idx % SUB_BUCKETS + SUB_BUCKETS;
+    return ((m + 1) << shift) - 1;
+}
+
+// 记录一个样本（微秒）
+void stats_record(int hist, double us)
+{
+    if (hist < 0 || hist >= HIST_COUNT)
+        return;
+    struct Histogram *h = &hists[hist];
+    unsigned long long v = us > 0 ? (unsigned long long)us : 0;
+    atomic_fetch_add_explicit(&h->buckets[bucket_index(v)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_us, v, memory_order_relaxed);
+    unsigned long long old = atomic_load_explicit(&h->max_us, memory_order_relaxed);
+    while (v > old && !atomic_compare_exchange_weak_explicit(&h->max_us, &old, v, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+// 按分位数p（0~1）估计延迟
+static unsigned long long hist_percentile(struct Histogram *h, double p)
+{
+    unsigned long long total = atomic_load_explicit(&h->count, memory_order_relaxed);
+    if (total == 0)
+        return 0;
+    unsigned long long target = (unsigned long long)(p * total + 0.5), seen = 0;
+    unsigned long long max = atomic_load_explicit(&h->max_us, memory_order_relaxed);
+    if (target == 0)
+        target = 1;
+    for (int i = 0; i < BUCKET_COUNT; ++i)
+    {
+        seen += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+        // 桶上界可能超过记录到的最大值，分位数不超过最大值
+        if (seen >= target)
+            return bucket_upper(i) < max ? bucket_upper(i) : max;
+    }
+    return max;
+}
+
+// ================== 语句计时 ==================
+double stats_stmt_begin()
+{
+    stmt_errors_begin = db_error_count();
+    return db_now_us();
+}
+
+// 语句结束：记录延迟，录制中时写入录制文件，超过阈值时写入慢查询日志
+void stats_stmt_end(int type, double start_us, const char *text)
+{
+    double us = db_now_us() - start_us;
+    stats_record(type, us);
+    last_latency_us = us;
+    last_failed = db_error_count() != stmt_errors_begin;
+    capture_statement(type, start_us, us, last_failed, text);
+    if (slow_threshold_ms < 0 || us < slow_threshold_ms * 1000.0)
+        return;
+    atomic_fetch_add_explicit(&slow_count, 1, memory_order_relaxed);
+    FILE *fp = fopen(slow_log_path, "a");
+    if (!fp)
+        return;
+    char ts[32];
+    time_t now = time(NULL);
+    strftime(ts, sizeof(ts), "%Y-%m-%d %H:%M:%S", localtime(&now));
+    fprintf(fp, "%s\t%s\t%.3f ms\t%s\n", ts, hist_names[type], us / 1e3, text ? text : "");
+    fclose(fp);
+}
+
+double stats_last_latency()
+{
+    return last_latency_us;
+}
+
+int stats_last_failed()
+{
+    return last_failed;
+}
+
+// ================== 负载录制 ==================
+// 录制文件格式：
+//   头部：魔数 "MDBCAP1\n" | varint 会话号 | varint 开始时刻（Unix时间，微秒）
+//   每条语句：varint 开始时距录制开始的微秒数 | u8 语句类型（最高位表示出错） | varint 延迟（纳秒）
+//             | varint 文本长度 | 文本（词法分析器规范化后的语句文本）
+// 语句在数据库锁内结束，追加记录时不再加锁；文件按块缓冲写出，关闭时刷盘
+#define CAPTURE_MAGIC "MDBCAP1\n"
+static FILE *capture_fp = NULL;
+static double capture_start_us; // 录制开始时的单调时钟
+static struct ByteBuf capture_buf;
+
+int stats_capture_open(const char *path, unsigned session)
+{
+    stats_capture_close();
+    capture_fp = fopen(path, "wb");
+    if (!capture_fp)
+        return -1;
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    capture_start_us = db_now_us();
+    capture_buf.len = 0;
+    bb_put(&capture_buf, CAPTURE_MAGIC, 8);
+    bb_put_varint(&capture_buf, session);
+    bb_put_varint(&capture_buf, (unsigned long long)ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000);
+    return 0;
+}
+
+static void capture_flush()
+{
+    if (capture_buf.len > 0)
+        fwrite(capture_buf.data, 1, capture_buf.len, capture_fp);
+    capture_buf.len = 0;
+}
+
+void stats_capture_close()
+{
+    if (!capture_fp)
+        return;
+    capture_flush();
+    fclose(capture_fp);
+    capture_fp = NULL;
+    bb_free(&capture_buf);
+}
+
+static void capture_statement(int type, double start_us, double us, int failed, const char *text)
+{
+    if (!capture_fp || !text)
+        return;
+    size_t n = strlen(text);
+    bb_put_varint(&capture_buf, start_us > capture_start_us ? (unsigned long long)(start_us - capture_start_us) : 0);
+    bb_put_u8(&capture_buf, (unsigned)type | (failed ? 0x80 : 0));
+    bb_put_varint(&capture_buf, us > 0 ? (unsigned long long)(us * 1e3) : 0);
+    bb_put_varint(&capture_buf, n);
+    bb_put(&capture_buf, text, n);
+    if (capture_buf.len >= 65536)
+        capture_flush();
+}
+
+void stats_add_rows_read(long n)
+{
+    atomic_fetch_add_explicit(&rows_read, n, memory_order_relaxed);
+}
+
+void stats_add_rows_written(long n)
+{
+    atomic_fetch_add_explicit(&rows_written, n, memory_order_relaxed);
+}
+
+// 慢查询阈值（毫秒），负数表示关闭慢查询日志
+void stats_set_slow_threshold(int ms)
+{
+    slow_threshold_ms = ms;
+}
+
+void stats_set_slow_log(const char *path)
+{
+    snprintf(slow_log_path, sizeof(slow_log_path), "%s", path);
+}
+
+// 已执行的语句总数
+long stats_statement_count()
+{
+    long n = 0;
+    for (int i = 0; i < STMT_TYPE_COUNT; ++i)
+        n += (long)atomic_load_explicit(&hists[i].count, memory_order_relaxed);
+    return n;
+}
+
+const char *stats_type_name(int hist)
+{
+    return hist >= 0 && hist < HIST_COUNT ? hist_names[hist] : "?";
+}
+
+// 输出各类语句的延迟分布和读写计数
+void stats_show_status()
+{
+    printf("[DB] Status:\n");
+    printf("  %-10s %10s %10s %10s %10s %10s %10s\n", "Statement", "Count", "Avg(ms)", "p50(ms)", "p90(ms)", "p99(ms)", "Max(ms)");
+    for (int i = 0; i < HIST_COUNT; ++i)
+    {
+        struct Histogram *h = &hists[i];
+        unsigned long long n = atomic_load_explicit(&h->count, memory_order_relaxed);
+        if (n == 0)
+            continue;
+        unsigned long long sum = atomic_load_explicit(&h->sum_us, memory_order_relaxed);
+        printf("  %-10s %10llu %10.3f %10.3f %10.3f %10.3f %10.3f\n", hist_names[i], n, sum / 1e3 / n,
+               hist_percentile(h, 0.50) / 1e3, hist_percentile(h, 0.90) / 1e3, hist_percentile(h, 0.99) / 1e3,
+               atomic_load_explicit(&h->max_us, memory_order_relaxed) / 1e3);
+    }
+    printf("  Rows read:    %lld\n", (long long)atomic_load(&rows_read));
+    printf("  Rows written: %lld\n", (long long)atomic_load(&rows_written));
+    printf("  Slow queries: %lld (threshold %d ms, log %s)\n", (long long)atomic_load(&slow_count),
+           slow_threshold_ms, slow_log_path);
+}
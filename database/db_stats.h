@@ -0,0 +1,63 @@
+#ifndef DB_STATS_H
+#define DB_STATS_H
+
+// 语句类型（用于分类统计延迟）
+enum StmtType
+{
+    STMT_SELECT = 0,
+    STMT_INSERT,
+    STMT_UPDATE,
+    STMT_DELETE,
+    STMT_CREATE,
+    STMT_DROP,
+    STMT_USE,
+    STMT_SHOW,
+    STMT_EXPLAIN,
+    STMT_SET,
+    STMT_TXN,
+    STMT_VACUUM,
+    STMT_CHECKPOINT,
+    STMT_ALTER,
+    STMT_TYPE_COUNT
+};
+
+// 其他计时项（与语句类型共用直方图数组）
+enum
+{
+    HIST_SAVE_DB = STMT_TYPE_COUNT, // save_db 耗时
+    HIST_LOAD_DB,                   // load_db 耗时
+    HIST_COUNT
+};
+
+// 语句计时与慢查询日志
+double stats_stmt_begin();
+void stats_stmt_end(int type, double start_us, const char *text);
+void stats_record(int hist, double us);
+
+// 行读写计数
+void stats_add_rows_read(long n);
+void stats_add_rows_written(long n);
+
+// 配置项
+void stats_set_slow_threshold(int ms);
+void stats_set_slow_log(const char *path);
+
+// 已执行的语句总数
+long stats_statement_count();
+
+// 语句类型或计时项的名字（SHOW STATUS 中显示的名字）
+const char *stats_type_name(int hist);
+
+// 负载录制：之后每条语句的开始时刻、类型、延迟、是否出错和文本追加到录制文件，供 MiniDBMS_replay 重放
+// session 区分同时录制的多个进程；返回-1表示无法创建文件
+int stats_capture_open(const char *path, unsigned session);
+void stats_capture_close();
+
+// 最近一条语句的延迟（微秒）和是否出错
+double stats_last_latency();
+int stats_last_failed();
+
+// SHOW STATUS
+void stats_show_status();
+
+#endif
@@ -3,7 +3,111 @@
 #include <stdlib.h>
 #include <string.h>
 
+// ================== 语法树内存池 ==================
+#define ARENA_CHUNK 4096         // 第一块的大小
+#define ARENA_KEEP_MAX (1 << 16) // 回收时保留的块的最大字节数，更大的块直接释放
+
+struct ArenaChunk
+{
+    struct ArenaChunk *next;
+    size_t size;
+    char data[];
+};
+
+// 从内存池分配n字节（8字节对齐），当前块不够时新建一块，大小至少为上一块的两倍
+void *arena_alloc(struct Arena *a, size_t n)
+{
+    n = (n + 7) & ~(size_t)7;
+    if ((size_t)(a->end - a->ptr) < n)
+    {
+        size_t size = a->chunks ? a->chunks->size * 2 : ARENA_CHUNK;
+        while (size < n)
+            size *= 2;
+        struct ArenaChunk *c = (struct ArenaChunk *)malloc(sizeof(struct ArenaChunk) + size);
+        c->size = size;
+        c->next = a->chunks;
+        a->chunks = c;
+        a->ptr = c->data;
+        a->end = c->data + size;
+    }
+    void *p = a->ptr;
+    a->ptr += n;
+    return p;
+}
+
+// 把s的前n个字符拷贝到内存池中，补上结尾的'\0'
+char *arena_strndup(struct Arena *a, const char *s, size_t n)
+{
+    char *p = (char *)arena_alloc(a, n + 1);
+    memcpy(p, s, n);
+    p[n] = '\0';
+    return p;
+}
+
+// 回收内存池中的所有分配：只保留最近一块（也是最大的一块）供下次使用
+void arena_reset(struct Arena *a)
+{
+    struct ArenaChunk *keep = a->chunks;
+    if (!keep)
+        return;
+    if (keep->size > ARENA_KEEP_MAX)
+        keep = NULL;
+    struct ArenaChunk *c = a->chunks;
+    while (c)
+    {
+        struct ArenaChunk *next = c->next;
+        if (c != keep)
+            free(c);
+        c = next;
+    }
+    if (keep)
+        keep->next = NULL;
+    a->chunks = keep;
+    a->ptr = keep ? keep->data : NULL;
+    a->end = keep ? keep->data + keep->size : NULL;
+}
+
+// 释放内存池的所有块
+void arena_free(struct Arena *a)
+{
+    arena_reset(a);
+    free(a->chunks);
+    a->chunks = NULL;
+    a->ptr = a->end = NULL;
+}
+
+static struct Arena *ast_arena = NULL; // 构造函数当前使用的内存池，NULL表示用malloc
+
+void ast_set_arena(struct Arena *a)
+{
+    ast_arena = a;
+}
+
+struct Arena *ast_get_arena(void)
+{
+    return ast_arena;
+}
+
+static void *ast_alloc(size_t n)
+{
+    return ast_arena ? arena_alloc(ast_arena, n) : malloc(n);
+}
+
+static void *ast_calloc(size_t n)
+{
+    void *p = ast_alloc(n);
+    memset(p, 0, n);
+    return p;
+}
+
+static char *ast_strdup(const char *s)
+{
+    return ast_arena ? arena_strndup(ast_arena, s, strlen(s)) : strdup(s);
+}
+
+// ================== 语法树节点 ==================
 // 创建列定义链表，将 new_item 插入 list 尾部
+// 每次追加都要遍历到表尾，逐个追加n项为O(n²)；语法分析器用尾指针直接追加
 struct ColumnDef *create_column_defs(struct ColumnDef *list, struct ColumnDef *new_item)
 {
     if (!list)
@@ -19,9 +123,11 @@ struct ColumnDef *create_column_defs(struct ColumnDef *list, struct ColumnDef *n
 // 创建单个列定义节点
 struct ColumnDef *create_column_def(char *name, char *type)
 {
-    struct ColumnDef *c = (struct ColumnDef *)malloc(sizeof(struct ColumnDef));
-    c->name = strdup(name);
-    c->type = strdup(type);
+    struct ColumnDef *c = (struct ColumnDef *)ast_alloc(sizeof(struct ColumnDef));
+    c->name = ast_strdup(name);
+    c->type = ast_strdup(type);
+    c->constraint = CONSTRAINT_NONE;
+    c->def = NULL;
     c->next = NULL;
     return c;
 }
@@ -37,6 +143,7 @@ void free_column_defs(struct ColumnDef *list)
             free(tmp->name);
         if (tmp->type)
             free(tmp->type);
+        free_value_list(tmp->def);
         free(tmp);
     }
 }
@@ -44,8 +151,9 @@ void free_column_defs(struct ColumnDef *list)
 // 创建列名链表节点
 struct ColumnList *create_column_list(char *name, struct ColumnList *next)
 {
-    struct ColumnList *c = (struct ColumnList *)malloc(sizeof(struct ColumnList));
-    c->name = strdup(name);
+    struct ColumnList *c = (struct ColumnList *)ast_alloc(sizeof(struct ColumnList));
+    c->name = ast_strdup(name);
+    c->sample = 0;
     c->next = next;
     return c;
 }
@@ -66,10 +174,11 @@ void free_column_list(struct ColumnList *list)
 // 创建整型值节点
 struct Value *create_value_int(int v)
 {
-    struct Value *val = (struct Value *)malloc(sizeof(struct Value));
+    struct Value *val = (struct Value *)ast_alloc(sizeof(struct Value));
     val->is_int = 1;
     val->int_val = v;
     val->str_val = NULL;
+    val->code = -1;
     val->next = NULL;
     return val;
 }
@@ -77,9 +186,10 @@ struct Value *create_value_int(int v)
 // 创建字符串值节点
 struct Value *create_value_str(char *s)
 {
-    struct Value *val = (struct Value *)malloc(sizeof(struct Value));
+    struct Value *val = (struct Value *)ast_alloc(sizeof(struct Value));
     val->is_int = 0;
-    val->str_val = strdup(s);
+    val->str_val = ast_strdup(s);
+    val->code = -1;
     val->next = NULL;
     return val;
 }
@@ -108,8 +218,9 @@ void free_value_list(struct Value *list)
 // 创建字段选择链表节点
 struct SelectList *create_select_list(char *name, struct SelectList *next)
 {
-    struct SelectList *s = (struct SelectList *)malloc(sizeof(struct SelectList));
-    s->name = strdup(name);
+    struct SelectList *s = (struct SelectList *)ast_alloc(sizeof(struct SelectList));
+    s->name = ast_strdup(name);
+    s->agg = AGG_NONE;
     s->next = next;
     return s;
 }
@@ -129,38 +240,97 @@ void free_select_list(struct SelectList *list)
 // 创建简单条件节点（如 col op value）
 struct Condition *create_condition(char *col, int op, struct Value *v)
 {
-    struct Condition *c = (struct Condition *)malloc(sizeof(struct Condition));
-    c->col = strdup(col);
+    struct Condition *c = (struct Condition *)ast_alloc(sizeof(struct Condition));
+    c->col = col ? ast_strdup(col) : NULL;
     c->op = op;
     c->value = v;
     c->left = c->right = NULL;
+    c->tbl_idx = c->col_idx = c->code = -1;
+    c->like = NULL;
+    c->sub = NULL;
+    c->ref_table = c->ref_col = NULL;
+    c->set = NULL;
+    c->bitmap = NULL;
     return c;
 }
 
 // 创建 AND 条件节点
 struct Condition *create_condition_and(struct Condition *l, struct Condition *r)
 {
-    struct Condition *c = (struct Condition *)malloc(sizeof(struct Condition));
+    struct Condition *c = (struct Condition *)ast_alloc(sizeof(struct Condition));
     c->op = 6;
     c->left = l;
     c->right = r;
     c->col = NULL;
     c->value = NULL;
+    c->tbl_idx = c->col_idx = c->code = -1;
+    c->like = NULL;
+    c->sub = NULL;
+    c->ref_table = c->ref_col = NULL;
+    c->set = NULL;
+    c->bitmap = NULL;
     return c;
 }
 
 // 创建 OR 条件节点
 struct Condition *create_condition_or(struct Condition *l, struct Condition *r)
 {
-    struct Condition *c = (struct Condition *)malloc(sizeof(struct Condition));
+    struct Condition *c = (struct Condition *)ast_alloc(sizeof(struct Condition));
     c->op = 7;
     c->left = l;
     c->right = r;
     c->col = NULL;
     c->value = NULL;
+    c->tbl_idx = c->col_idx = c->code = -1;
+    c->like = NULL;
+    c->sub = NULL;
+    c->ref_table = c->ref_col = NULL;
+    c->set = NULL;
+    c->bitmap = NULL;
     return c;
 }
 
+// 创建 NOT 条件节点
+struct Condition *create_condition_not(struct Condition *l)
+{
+    struct Condition *c = create_condition_and(l, NULL);
+    c->op = NOT_OP;
+    return c;
+}
+
+// 创建 col IN (v1, v2, ...) 条件节点，list为值链表
+struct Condition *create_condition_in(char *col, struct Value *list)
+{
+    return create_condition(col, IN_OP, list);
+}
+
+// 创建带子查询的条件节点：col IN (SELECT ...)（op为IN_OP）或 EXISTS (SELECT ...)（op为EXISTS_OP，col为NULL）
+struct Condition *create_condition_sub(char *col, int op, struct SubQuery *sub)
+{
+    struct Condition *c = create_condition(col, op, NULL);
+    c->sub = sub;
+    return c;
+}
+
+// 创建关联条件节点 col = ref_table.ref_col
+struct Condition *create_condition_ref(char *col, char *ref_table, char *ref_col)
+{
+    struct Condition *c = create_condition(col, REF_EQ, NULL);
+    c->ref_table = ast_strdup(ref_table);
+    c->ref_col = ast_strdup(ref_col);
+    return c;
+}
+
+// 创建子查询
+struct SubQuery *create_subquery(char *col, char *table, struct Condition *cond)
+{
+    struct SubQuery *q = (struct SubQuery *)ast_alloc(sizeof(struct SubQuery));
+    q->col = col ? ast_strdup(col) : NULL;
+    q->table = ast_strdup(table);
+    q->cond = cond;
+    return q;
+}
+
 // 递归释放条件表达式树
 void free_condition(struct Condition *c)
 {
@@ -170,17 +340,80 @@ void free_condition(struct Condition *c)
         free(c->col);
     if (c->value)
         free_value_list(c->value);
+    if (c->sub)
+    {
+        free(c->sub->col);
+        free(c->sub->table);
+        free_condition(c->sub->cond);
+        free(c->sub);
+    }
+    free(c->ref_table);
+    free(c->ref_col);
     free_condition(c->left);
     free_condition(c->right);
     free(c);
 }
 
-// 创建 SET 子句节点（如 col = value）
-struct SetItem *create_set_item(char *col, struct Value *v)
+// 创建常量表达式节点
+struct Expr *create_expr_value(struct Value *v)
+{
+    struct Expr *e = (struct Expr *)ast_calloc(sizeof(struct Expr));
+    e->kind = EXPR_CONST;
+    e->value = v;
+    e->col_idx = -1;
+    return e;
+}
+
+// 创建列引用表达式节点
+struct Expr *create_expr_col(char *col)
+{
+    struct Expr *e = (struct Expr *)ast_calloc(sizeof(struct Expr));
+    e->kind = EXPR_COL;
+    e->col = ast_strdup(col);
+    e->col_idx = -1;
+    return e;
+}
+
+// 创建 EXCLUDED.col 表达式节点
+struct Expr *create_expr_excluded(char *col)
+{
+    struct Expr *e = create_expr_col(col);
+    e->kind = EXPR_EXCLUDED;
+    return e;
+}
+
+// 创建二元运算表达式节点
+struct Expr *create_expr_binop(int op, struct Expr *l, struct Expr *r)
+{
+    struct Expr *e = (struct Expr *)ast_calloc(sizeof(struct Expr));
+    e->kind = EXPR_BINOP;
+    e->op = op;
+    e->left = l;
+    e->right = r;
+    e->col_idx = -1;
+    return e;
+}
+
+// 递归释放表达式树
+void free_expr(struct Expr *e)
+{
+    if (!e)
+        return;
+    if (e->value)
+        free_value_list(e->value);
+    if (e->col)
+        free(e->col);
+    free_expr(e->left);
+    free_expr(e->right);
+    free(e);
+}
+
+// 创建 SET 子句节点（如 col = expr）
+struct SetItem *create_set_item(char *col, struct Expr *e)
 {
-    struct SetItem *s = (struct SetItem *)malloc(sizeof(struct SetItem));
-    s->col = strdup(col);
-    s->value = v;
+    struct SetItem *s = (struct SetItem *)ast_alloc(sizeof(struct SetItem));
+    s->col = ast_strdup(col);
+    s->expr = e;
     s->next = NULL;
     return s;
 }
@@ -200,8 +433,7 @@ void free_set_list(struct SetItem *list)
         struct SetItem *tmp = list;
         list = list->next;
         free(tmp->col);
-        if (tmp->value)
-            free_value_list(tmp->value);
+        free_expr(tmp->expr);
         free(tmp);
     }
 }
@@ -225,6 +457,7 @@ struct Value *copy_value(const struct Value *v)
         {
             nv->str_val = v->str_val ? strdup(v->str_val) : NULL;
         }
+        nv->code = -1;
         nv->next = NULL;
         *tail = nv;
         tail = &nv->next;
@@ -6,12 +6,15 @@ struct ColumnDef
 {
     char *name;
     char *type;
+    int constraint; // 列约束：CONSTRAINT_NONE / CONSTRAINT_UNIQUE / CONSTRAINT_PRIMARY_KEY
+    struct Value *def; // 默认值（DEFAULT），NULL表示INT列为0、CHAR列为NULL
     struct ColumnDef *next;
 };
 
 struct ColumnList
 {
     char *name;
+    int sample; // FROM 表名链表：TABLESAMPLE SYSTEM 抽样的块百分比，0表示不抽样
     struct ColumnList *next;
 };
 
@@ -20,31 +23,102 @@ struct Value
     int is_int;
     int int_val;
     char *str_val;
+    int code; // 表内字符串的字典等价类编号，-1表示未编码
     struct Value *next;
 };
 
 struct SelectList
 {
     char *name;
+    int agg; // 聚合函数：AGG_NONE 表示普通字段
     struct SelectList *next;
 };
 
+struct LikeSet;
+struct ValueSet;
+struct BitmapMatch;
+struct SubQuery;
 struct Condition
 {
     char *col;
     int op;
-    struct Value *value;
+    struct Value *value;        // 比较的常量；IN 列表时为值链表
     struct Condition *left;
     struct Condition *right;
+    int tbl_idx; // 绑定后：字段所属表的下标
+    int col_idx; // 绑定后：字段在表中的列下标，-1表示字段不存在
+    int code;    // 绑定后：字符串常量在该列字典中的等价类编号
+    struct LikeSet *like; // 绑定后：LIKE 模式在该列字典上的匹配结果，NULL表示逐行匹配
+    struct SubQuery *sub; // IN (SELECT ...) / EXISTS (SELECT ...) 的子查询
+    char *ref_table;      // 关联条件 col = 表.列 中外层查询的表名和列名
+    char *ref_col;
+    struct ValueSet *set; // 绑定后：IN 列表或子查询结果的哈希集合
+    struct BitmapMatch *bitmap; // 绑定后：列上有位图索引时满足比较的键，NULL表示没有位图索引
+};
+
+// 子查询：SELECT col FROM table [WHERE cond]，col为NULL表示 SELECT *
+struct SubQuery
+{
+    char *col;
+    char *table;
+    struct Condition *cond;
+};
+
+// SET 右侧表达式：常量、列引用或四则运算
+struct Expr
+{
+    int kind;           // EXPR_CONST / EXPR_COL / EXPR_EXCLUDED / EXPR_BINOP
+    int op;             // 运算符：'+' '-' '*' '/' '%'
+    struct Value *value; // 常量值
+    char *col;          // 列名
+    int col_idx;        // 绑定后：列下标
+    struct Expr *left;
+    struct Expr *right;
 };
 
 struct SetItem
 {
     char *col;
-    struct Value *value;
+    struct Expr *expr;
     struct SetItem *next;
 };
 
+// 预编译的语句（库接口 mdb_prepare）：预编译模式下解析器只构造语法树，不执行语句
+struct ParsedStmt
+{
+    int type;                  // 语句类型：STMT_SELECT / STMT_INSERT / STMT_UPDATE / STMT_DELETE
+    int count;                 // 解析出的语句数
+    char *table;               // INSERT/UPDATE/DELETE 的表名
+    struct ColumnList *tables; // SELECT 的表名链表
+    struct ColumnList *cols;   // INSERT 的列名链表
+    struct SelectList *sel;    // SELECT 的字段链表
+    struct Value *values;      // INSERT 的值链表
+    struct SetItem *set;       // UPDATE / ON CONFLICT DO UPDATE 的SET链表
+    struct Condition *cond;    // WHERE 条件
+    int action;                // INSERT 的冲突处理方式
+    struct Value **params;     // '?' 参数对应的值节点，按出现顺序
+    int param_count;
+    int param_cap;
+};
+
+// 语法树内存池：一条语句的所有节点和字符串从池中顺序分配，语句结束后整体回收
+struct ArenaChunk;
+struct Arena
+{
+    struct ArenaChunk *chunks; // 块链表，表头为当前块
+    char *ptr;                 // 当前块中下一个可用位置
+    char *end;                 // 当前块的结束位置
+};
+
+void *arena_alloc(struct Arena *a, size_t n);
+char *arena_strndup(struct Arena *a, const char *s, size_t n);
+void arena_reset(struct Arena *a);
+void arena_free(struct Arena *a);
+// 设置下列构造函数使用的内存池：非NULL时节点从池中分配、随池回收，不能再调用free_*；
+// NULL时用malloc分配，由free_*释放
+void ast_set_arena(struct Arena *a);
+struct Arena *ast_get_arena(void);
+
 // 构造/释放/copy函数声明
 struct ColumnDef *create_column_defs(struct ColumnDef *list, struct ColumnDef *new_item);
 struct ColumnDef *create_column_def(char *name, char *type);
@@ -60,8 +134,18 @@ void free_select_list(struct SelectList *list);
 struct Condition *create_condition(char *col, int op, struct Value *v);
 struct Condition *create_condition_and(struct Condition *l, struct Condition *r);
 struct Condition *create_condition_or(struct Condition *l, struct Condition *r);
+struct Condition *create_condition_not(struct Condition *c);
+struct Condition *create_condition_in(char *col, struct Value *list);
+struct Condition *create_condition_sub(char *col, int op, struct SubQuery *sub);
+struct Condition *create_condition_ref(char *col, char *ref_table, char *ref_col);
+struct SubQuery *create_subquery(char *col, char *table, struct Condition *cond);
 void free_condition(struct Condition *c);
-struct SetItem *create_set_item(char *col, struct Value *v);
+struct Expr *create_expr_value(struct Value *v);
+struct Expr *create_expr_col(char *col);
+struct Expr *create_expr_excluded(char *col);
+struct Expr *create_expr_binop(int op, struct Expr *l, struct Expr *r);
+void free_expr(struct Expr *e);
+struct SetItem *create_set_item(char *col, struct Expr *e);
 struct SetItem *create_set_list(struct SetItem *item, struct SetItem *next);
 void free_set_list(struct SetItem *list);
 struct Value *copy_value(const struct Value *v);
@@ -74,6 +158,35 @@ enum
     GT = 2,
     LT = 3,
     GE = 4,
-    LE = 5
+    LE = 5,
+    LIKE_OP = 8, // 6、7为AND/OR节点
+    IN_OP = 9,     // col IN (值列表) / col IN (SELECT ...)
+    EXISTS_OP = 10, // EXISTS (SELECT ...)
+    REF_EQ = 11,   // col = 表.列：EXISTS 子查询中与外层查询的关联条件
+    NOT_OP = 12    // NOT 条件：子条件在left中
+};
+
+// Expr节点类型
+enum
+{
+    EXPR_CONST = 0,
+    EXPR_COL = 1,
+    EXPR_BINOP = 2,
+    EXPR_EXCLUDED = 3 // EXCLUDED.col：INSERT ... ON CONFLICT DO UPDATE 中因冲突未插入的值
+};
+
+// SELECT 字段的聚合函数
+enum
+{
+    AGG_NONE = 0,
+    AGG_APPROX_DISTINCT = 1 // APPROX_COUNT_DISTINCT(col)
+};
+
+// 列约束
+enum
+{
+    CONSTRAINT_NONE = 0,
+    CONSTRAINT_UNIQUE = 1,
+    CONSTRAINT_PRIMARY_KEY = 2
 };
 #endif
@@ -0,0 +1,6 @@
+cd .\compiler\
+bison -d parser.y
+flex lexer.l
+cd ..
+gcc -O2 -c lib/minidbms.c compiler/parser.tab.c compiler/lex.yy.c database/sql_struct.c database/db_api.c database/db_stats.c database/db_codec.c
+ar rcs libminidbms.a minidbms.o parser.tab.o lex.yy.o sql_struct.o db_api.o db_stats.o db_codec.o
@@ -0,0 +1,446 @@
+// libminidbms：句柄和预编译语句接口的实现
+// 语句仍由词法/语法分析器解析；预编译时解析器处于预编译模式，只构造语法树（保存在语句自己的内存池中），
+// 执行时直接调用 db_* 函数，SELECT 通过游标逐行取值
+#include "minidbms.h"
+#include "../database/db_api.h"
+#include "../database/db_stats.h"
+#include "../database/sql_struct.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef void *YY_BUFFER_STATE;
+extern YY_BUFFER_STATE yy_scan_bytes(const char *bytes, int len);
+extern void yy_delete_buffer(YY_BUFFER_STATE buffer);
+extern int yyparse(void);
+extern struct ParsedStmt *parse_capture;
+extern int parse_allow_exit;
+void lex_set_arena(struct Arena *a);
+void lex_reset_statement(void);
+
+#define STMT_TEXT -1 // 按文本执行的语句（不能预编译的语句类型）
+
+struct MdbHandle
+{
+    char *path;             // 数据文件路径
+    struct MdbStmt *stmts;  // 未释放的预编译语句
+    char errmsg[256];
+};
+
+struct MdbStmt
+{
+    struct MdbHandle *h;
+    char *sql;             // 语句文本（以';'结尾）
+    struct Arena arena;    // 语法树和词法单元字符串
+    struct ParsedStmt ps;  // 语法树，ps.type 为 STMT_TEXT 表示按文本执行
+    char **bound_strs;     // 每个参数绑定的字符串（拷贝）
+    char *bound;           // 每个参数是否已绑定
+    struct Cursor *cursor; // SELECT 执行中的游标
+    int done;              // 已执行完毕，需 mdb_reset 后才能再次执行
+    char num_buf[16];      // mdb_column_text 转换INT列的缓冲区
+    struct MdbStmt *next;
+};
+
+static struct MdbHandle *open_handle = NULL;
+
+static void set_error(struct MdbHandle *h, const char *msg)
+{
+    snprintf(h->errmsg, sizeof(h->errmsg), "%s", msg);
+}
+
+// 出错次数与 errs 不同时说明期间有语句出错，取最近一条错误信息
+static int check_error(struct MdbHandle *h, long errs)
+{
+    if (db_error_count() == errs)
+        return MDB_OK;
+    set_error(h, db_last_error());
+    return MDB_ERROR;
+}
+
+// 跳过空白和 -- 注释
+static const char *skip_blank(const char *s)
+{
+    while (1)
+    {
+        while (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n')
+            ++s;
+        if (s[0] != '-' || s[1] != '-')
+            return s;
+        while (*s && *s != '\n')
+            ++s;
+    }
+}
+
+// 第一条语句结束的';'（引号和注释之外）之后的位置，没有';'时返回NULL
+static const char *statement_end(const char *s)
+{
+    for (; *s; ++s)
+    {
+        if (*s == '\'')
+        {
+            const char *q = strchr(s + 1, '\'');
+            if (!q)
+                return NULL;
+            s = q;
+        }
+        else if (s[0] == '-' && s[1] == '-')
+        {
+            while (s[1] && s[1] != '\n')
+                ++s;
+        }
+        else if (*s == ';')
+            return s + 1;
+    }
+    return NULL;
+}
+
+// 解析并执行一段SQL文本
+static void run_sql(const char *sql, size_t len)
+{
+    YY_BUFFER_STATE bp = yy_scan_bytes(sql, (int)len);
+    yyparse();
+    yy_delete_buffer(bp);
+}
+
+int mdb_open(const char *path, struct MdbHandle **out)
+{
+    *out = NULL;
+    if (open_handle)
+        return MDB_MISUSE;
+    struct MdbHandle *h = (struct MdbHandle *)calloc(1, sizeof(struct MdbHandle));
+    h->path = strdup(path ? path : "data.db");
+    db_set_dump_file(h->path);
+    db_set_quiet(QUIET_SILENT);
+    parse_allow_exit = 0;
+    load_db();
+    if (!find_db("default"))
+        db_create_database("default");
+    db_use_database("default");
+    db_replay_journals(run_sql);
+    open_handle = h;
+    *out = h;
+    return MDB_OK;
+}
+
+int mdb_close(struct MdbHandle *h)
+{
+    if (!h || h != open_handle)
+        return MDB_MISUSE;
+    while (h->stmts)
+        mdb_finalize(h->stmts);
+    db_close();
+    db_set_dump_file(NULL);
+    db_set_quiet(QUIET_NONE);
+    parse_allow_exit = 1;
+    free(h->path);
+    free(h);
+    open_handle = NULL;
+    return MDB_OK;
+}
+
+int mdb_exec(struct MdbHandle *h, const char *sql)
+{
+    if (!h || h != open_handle || !sql)
+        return MDB_MISUSE;
+    long errs = db_error_count();
+    // 最后一条语句没有';'时补上
+    const char *rest = sql;
+    for (const char *e; (e = statement_end(rest));)
+        rest = e;
+    if (*skip_blank(rest))
+    {
+        size_t n = strlen(sql);
+        char *buf = (char *)malloc(n + 2);
+        memcpy(buf, sql, n);
+        buf[n] = ';';
+        buf[n + 1] = '\0';
+        run_sql(buf, n + 1);
+        free(buf);
+    }
+    else
+        run_sql(sql, strlen(sql));
+    return check_error(h, errs);
+}
+
+const char *mdb_errmsg(struct MdbHandle *h)
+{
+    return h ? h->errmsg : "";
+}
+
+// 语句的第一个关键字是否为 kw（忽略大小写）
+static int starts_with_keyword(const char *s, const char *kw)
+{
+    size_t n = strlen(kw);
+    for (size_t i = 0; i < n; ++i)
+        if ((s[i] | 0x20) != kw[i])
+            return 0;
+    char c = s[n];
+    return !((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_');
+}
+
+static void stmt_free(struct MdbStmt *st)
+{
+    arena_free(&st->arena);
+    for (int i = 0; st->bound_strs && i < st->ps.param_count; ++i)
+        free(st->bound_strs[i]);
+    free(st->ps.params);
+    free(st->bound_strs);
+    free(st->bound);
+    free(st->sql);
+    free(st);
+}
+
+int mdb_prepare(struct MdbHandle *h, const char *sql, struct MdbStmt **out)
+{
+    *out = NULL;
+    if (!h || h != open_handle || !sql)
+        return MDB_MISUSE;
+    const char *p = skip_blank(sql);
+    const char *end = statement_end(p);
+    size_t len = end ? (size_t)(end - p) : strlen(p);
+    if (len == 0)
+    {
+        set_error(h, "Empty statement");
+        return MDB_ERROR;
+    }
+    if (end && *skip_blank(end))
+    {
+        set_error(h, "Only one statement can be prepared");
+        return MDB_ERROR;
+    }
+    struct MdbStmt *st = (struct MdbStmt *)calloc(1, sizeof(struct MdbStmt));
+    st->h = h;
+    st->sql = (char *)malloc(len + 2);
+    memcpy(st->sql, p, len);
+    if (!end)
+        st->sql[len++] = ';';
+    st->sql[len] = '\0';
+    st->ps.type = STMT_TEXT;
+    if (starts_with_keyword(p, "select") || starts_with_keyword(p, "insert") || starts_with_keyword(p, "update") ||
+        starts_with_keyword(p, "delete"))
+    {
+        long errs = db_error_count();
+        parse_capture = &st->ps;
+        lex_set_arena(&st->arena);
+        lex_reset_statement();
+        run_sql(st->sql, len);
+        lex_set_arena(NULL);
+        parse_capture = NULL;
+        if (check_error(h, errs) != MDB_OK || st->ps.count != 1)
+        {
+            if (st->ps.count != 1 && db_error_count() == errs)
+                set_error(h, "Cannot prepare statement");
+            stmt_free(st);
+            return MDB_ERROR;
+        }
+        st->bound_strs = (char **)calloc(st->ps.param_count + 1, sizeof(char *));
+        st->bound = (char *)calloc(st->ps.param_count + 1, 1);
+    }
+    st->next = h->stmts;
+    h->stmts = st;
+    *out = st;
+    return MDB_OK;
+}
+
+int mdb_bind_count(struct MdbStmt *st)
+{
+    return st->ps.param_count;
+}
+
+// 绑定前检查：下标有效且没有执行中的游标，返回参数对应的值节点
+static struct Value *bind_target(struct MdbStmt *st, int idx)
+{
+    if (idx < 1 || idx > st->ps.param_count || st->cursor)
+        return NULL;
+    free(st->bound_strs[idx - 1]);
+    st->bound_strs[idx - 1] = NULL;
+    st->bound[idx - 1] = 1;
+    return st->ps.params[idx - 1];
+}
+
+int mdb_bind_int(struct MdbStmt *st, int idx, int v)
+{
+    struct Value *val = bind_target(st, idx);
+    if (!val)
+        return MDB_MISUSE;
+    val->is_int = 1;
+    val->int_val = v;
+    val->str_val = NULL;
+    return MDB_OK;
+}
+
+int mdb_bind_text(struct MdbStmt *st, int idx, const char *v)
+{
+    if (!v)
+        return MDB_MISUSE;
+    if (strchr(v, '\''))
+    {
+        set_error(st->h, "Text values cannot contain a single quote");
+        return MDB_ERROR;
+    }
+    struct Value *val = bind_target(st, idx);
+    if (!val)
+        return MDB_MISUSE;
+    val->is_int = 0;
+    val->int_val = 0;
+    val->str_val = st->bound_strs[idx - 1] = strdup(v);
+    return MDB_OK;
+}
+
+// 把参数替换为绑定的值，得到语句的完整文本（用于提交日志、慢查询日志和查询缓存）
+static char *render_sql(struct MdbStmt *st)
+{
+    size_t cap = strlen(st->sql) + 1;
+    for (int i = 0; i < st->ps.param_count; ++i)
+        cap += st->bound_strs[i] ? strlen(st->bound_strs[i]) + 2 : 12;
+    char *out = (char *)malloc(cap);
+    size_t n = 0;
+    int k = 0;
+    for (const char *s = st->sql; *s; ++s)
+    {
+        if (*s == '\'' || (s[0] == '-' && s[1] == '-'))
+        {
+            // 字符串和注释原样拷贝
+            const char *e = *s == '\'' ? strchr(s + 1, '\'') : strchr(s, '\n');
+            size_t len = e ? (size_t)(e - s) + (*s == '\'') : strlen(s);
+            memcpy(out + n, s, len);
+            n += len;
+            s += len - 1;
+        }
+        else if (*s == '?' && k < st->ps.param_count)
+        {
+            struct Value *v = st->ps.params[k++];
+            if (v->is_int)
+                n += sprintf(out + n, "%d", v->int_val);
+            else
+                n += sprintf(out + n, "'%s'", v->str_val);
+        }
+        else
+            out[n++] = *s;
+    }
+    out[n] = '\0';
+    return out;
+}
+
+static int cursor_step(struct MdbStmt *st)
+{
+    if (db_cursor_next(st->cursor))
+        return MDB_ROW;
+    st->done = 1;
+    return MDB_DONE;
+}
+
+int mdb_step(struct MdbStmt *st)
+{
+    struct MdbHandle *h = st->h;
+    if (st->cursor)
+        return st->done ? MDB_DONE : cursor_step(st);
+    if (st->done)
+        return MDB_DONE;
+    for (int i = 0; i < st->ps.param_count; ++i)
+        if (!st->bound[i])
+        {
+            snprintf(h->errmsg, sizeof(h->errmsg), "Parameter %d is not bound", i + 1);
+            return MDB_ERROR;
+        }
+    if (st->ps.type == STMT_TEXT)
+    {
+        st->done = 1;
+        return mdb_exec(h, st->sql) == MDB_OK ? MDB_DONE : MDB_ERROR;
+    }
+    long errs = db_error_count();
+    struct ParsedStmt *ps = &st->ps;
+    char *text = render_sql(st);
+    db_stmt_begin(text);
+    if (ps->type == STMT_SELECT)
+    {
+        st->cursor = db_cursor_open(ps->tables, ps->sel, ps->cond, text);
+        db_stmt_end();
+        free(text);
+        if (!st->cursor)
+        {
+            st->done = 1;
+            return check_error(h, errs);
+        }
+        return cursor_step(st);
+    }
+    // 与解析器中的 STMT_BEGIN / STMT_END 相同：计时、写提交日志
+    double t0 = stats_stmt_begin();
+    if (ps->type == STMT_INSERT)
+        db_upsert(ps->table, ps->cols, ps->values, ps->action, ps->set);
+    else if (ps->type == STMT_UPDATE)
+        db_update(ps->table, ps->set, ps->cond);
+    else
+        db_delete(ps->table, ps->cond);
+    stats_stmt_end(ps->type, t0, text);
+    db_journal_statement(text);
+    db_stmt_end();
+    free(text);
+    st->done = 1;
+    return check_error(h, errs) == MDB_OK ? MDB_DONE : MDB_ERROR;
+}
+
+int mdb_reset(struct MdbStmt *st)
+{
+    db_cursor_close(st->cursor);
+    st->cursor = NULL;
+    st->done = 0;
+    return MDB_OK;
+}
+
+int mdb_finalize(struct MdbStmt *st)
+{
+    if (!st)
+        return MDB_OK;
+    mdb_reset(st);
+    for (struct MdbStmt **p = &st->h->stmts; *p; p = &(*p)->next)
+        if (*p == st)
+        {
+            *p = st->next;
+            break;
+        }
+    stmt_free(st);
+    return MDB_OK;
+}
+
+int mdb_column_count(struct MdbStmt *st)
+{
+    return st->cursor ? db_cursor_column_count(st->cursor) : 0;
+}
+
+const char *mdb_column_name(struct MdbStmt *st, int i)
+{
+    return st->cursor ? db_cursor_column_name(st->cursor, i) : NULL;
+}
+
+static struct Value *column_value(struct MdbStmt *st, int i)
+{
+    return st->cursor && !st->done ? db_cursor_value(st->cursor, i) : NULL;
+}
+
+int mdb_column_type(struct MdbStmt *st, int i)
+{
+    struct Value *v = column_value(st, i);
+    if (!v)
+        return MDB_NULL;
+    return v->is_int ? MDB_INT : v->str_val ? MDB_TEXT : MDB_NULL;
+}
+
+int mdb_column_int(struct MdbStmt *st, int i)
+{
+    struct Value *v = column_value(st, i);
+    if (!v)
+        return 0;
+    return v->is_int ? v->int_val : v->str_val ? atoi(v->str_val) : 0;
+}
+
+const char *mdb_column_text(struct MdbStmt *st, int i)
+{
+    struct Value *v = column_value(st, i);
+    if (!v)
+        return NULL;
+    if (!v->is_int)
+        return v->str_val;
+    snprintf(st->num_buf, sizeof(st->num_buf), "%d", v->int_val);
+    return st->num_buf;
+}
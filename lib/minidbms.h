@@ -0,0 +1,59 @@
+#ifndef MINIDBMS_H
+#define MINIDBMS_H
+
+// libminidbms：在进程内嵌入MiniDBMS的C接口
+// 执行语句不经过文本输出：SELECT的结果由游标逐行产生，通过 mdb_column_* 取得类型化的值
+// 引擎的状态是全局的，同一时刻只能打开一个句柄，所有调用须在同一线程中进行
+
+struct MdbHandle;
+struct MdbStmt;
+
+// 返回码
+enum
+{
+    MDB_OK = 0,
+    MDB_ERROR = 1,  // 语句出错，错误信息见 mdb_errmsg
+    MDB_MISUSE = 2, // 接口用法错误（已有打开的句柄、参数下标越界、游标未重置就绑定等）
+    MDB_ROW = 100,  // mdb_step 取到一行
+    MDB_DONE = 101  // mdb_step 语句执行完毕
+};
+
+// 列值的类型
+enum
+{
+    MDB_NULL = 0,
+    MDB_INT = 1,
+    MDB_TEXT = 2
+};
+
+// 打开数据库：path 为数据文件（NULL表示 data.db），读取快照目录并重放提交日志
+int mdb_open(const char *path, struct MdbHandle **out);
+// 关闭数据库：释放所有预编译语句，回滚未提交的事务，保存数据
+int mdb_close(struct MdbHandle *h);
+// 执行一条或多条以';'分隔的语句，SELECT的结果被丢弃；最后一条语句可以省略';'
+int mdb_exec(struct MdbHandle *h, const char *sql);
+// 最近一次出错的错误信息
+const char *mdb_errmsg(struct MdbHandle *h);
+
+// 预编译一条语句，可以包含 '?' 参数（只支持 SELECT / INSERT / UPDATE / DELETE）
+// 其他语句在 mdb_step 时按文本执行
+int mdb_prepare(struct MdbHandle *h, const char *sql, struct MdbStmt **out);
+int mdb_bind_count(struct MdbStmt *st);
+// 绑定参数，下标从1开始；字符串被拷贝，不能包含单引号（提交日志以SQL文本保存）
+int mdb_bind_int(struct MdbStmt *st, int idx, int v);
+int mdb_bind_text(struct MdbStmt *st, int idx, const char *v);
+// 执行：SELECT每次返回一行（MDB_ROW），取完返回 MDB_DONE；其他语句执行后返回 MDB_DONE
+int mdb_step(struct MdbStmt *st);
+// 重置到执行前的状态（关闭未取完的游标），已绑定的参数保留
+int mdb_reset(struct MdbStmt *st);
+int mdb_finalize(struct MdbStmt *st);
+
+// 当前行的列：第一次 mdb_step 之后有效，下标从0开始
+// mdb_column_text 返回的字符串在下一次 mdb_step 之前有效，INT列转换成的文本在下一次调用之前有效
+int mdb_column_count(struct MdbStmt *st);
+const char *mdb_column_name(struct MdbStmt *st, int i);
+int mdb_column_type(struct MdbStmt *st, int i);
+int mdb_column_int(struct MdbStmt *st, int i);
+const char *mdb_column_text(struct MdbStmt *st, int i);
+
+#endif
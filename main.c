@@ -1,35 +1,220 @@
+#include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#include <process.h>
+#define isatty _isatty
+#define fileno _fileno
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
 #include "database/db_api.h"
+#include "database/db_stats.h"
 #include "database/sql_struct.h"
 #include "compiler/parser.tab.h"
 
 typedef void *YY_BUFFER_STATE;
 extern YY_BUFFER_STATE yy_scan_string(const char *str);
+extern YY_BUFFER_STATE yy_scan_bytes(const char *bytes, int len);
 extern void yy_delete_buffer(YY_BUFFER_STATE buffer);
 extern int yyparse(void);
 
-int main()
+// 可增长的输入缓冲区
+struct InputBuf
 {
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+static void buf_append(struct InputBuf *b, const char *s, size_t n)
+{
+    if (b->len + n + 1 > b->cap)
+    {
+        while (b->len + n + 1 > b->cap)
+            b->cap = b->cap ? b->cap * 2 : 4096;
+        b->data = (char *)realloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, s, n);
+    b->len += n;
+    b->data[b->len] = '\0';
+}
+
+// 读取一整行追加到缓冲区（不限长度），到达文件末尾返回0
+static int read_line(FILE *fp, struct InputBuf *b)
+{
+    char chunk[1024];
+    int got = 0;
+    while (fgets(chunk, sizeof(chunk), fp))
+    {
+        size_t n = strlen(chunk);
+        buf_append(b, chunk, n);
+        got = 1;
+        if (n > 0 && chunk[n - 1] == '\n')
+            break;
+    }
+    return got;
+}
+
+// 判断缓冲区中的语句是否已结束：引号和注释之外最后一个非空白字符为';'
+static int statement_complete(const char *s)
+{
+    int in_quote = 0, last = 0;
+    for (; *s; ++s)
+    {
+        if (in_quote)
+        {
+            if (*s == '\'')
+                in_quote = 0;
+            continue;
+        }
+        if (s[0] == '-' && s[1] == '-')
+        {
+            while (s[1] && s[1] != '\n')
+                ++s;
+            continue;
+        }
+        if (*s == '\'')
+            in_quote = 1;
+        if (*s != ' ' && *s != '\t' && *s != '\r' && *s != '\n')
+            last = *s;
+    }
+    return !in_quote && last == ';';
+}
+
+// 解析并执行一段SQL文本（重放提交日志时由 db_replay_journals 调用）
+static void run_sql(const char *sql, size_t len)
+{
+    YY_BUFFER_STATE bp = yy_scan_bytes(sql, (int)len);
+    yyparse();
+    yy_delete_buffer(bp);
+}
+
+static double script_start_us;
+static long script_start_count; // 脚本开始前已执行的语句数（含日志重放）
+static long script_start_errors; // 脚本开始前的出错次数（语法错误和执行错误都经过db_error计数）
+
+// 脚本模式结束时输出汇总信息（EXIT语句会直接退出进程，因此注册为atexit）
+static void report_script_totals()
+{
+    double elapsed = (db_now_us() - script_start_us) / 1e6;
+    long n = stats_statement_count() - script_start_count;
+    fprintf(stderr, "[SCRIPT] %ld statements, %ld errors, %.3f s (%.0f stmt/s)\n", n, db_error_count() - script_start_errors, elapsed,
+            elapsed > 0 ? n / elapsed : 0.0);
+}
+
+// 脚本模式：整个输入读入一个缓冲区，由一个扫描器缓冲区连续解析所有语句
+static void run_script(FILE *fp)
+{
+    struct InputBuf b = {0};
+    char chunk[65536];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+        buf_append(&b, chunk, n);
+    script_start_us = db_now_us();
+    script_start_count = stats_statement_count();
+    script_start_errors = db_error_count();
+    atexit(report_script_totals);
+    if (b.len > 0)
+    {
+        YY_BUFFER_STATE bp = yy_scan_bytes(b.data, (int)b.len);
+        yyparse();
+        yy_delete_buffer(bp);
+    }
+    free(b.data);
+    db_exit(); // 脚本执行完毕，保存数据并退出
+}
+
+// 交互模式下的Ctrl-C：取消正在执行的语句，不结束进程
+static void on_interrupt(int sig)
+{
+    signal(sig, on_interrupt); // 部分平台处理一次后恢复为默认处理
+    db_cancel();
+}
+
+int main(int argc, char **argv)
+{
+    const char *script = NULL;
+    const char *capture = NULL;
+    unsigned session = (unsigned)getpid();
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+            script = argv[++i];
+        else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+            capture = argv[++i];
+        else if (strcmp(argv[i], "--session") == 0 && i + 1 < argc)
+            session = (unsigned)strtoul(argv[++i], NULL, 10);
+        else
+        {
+            fprintf(stderr, "Usage: %s [-f script.sql] [--capture workload.cap [--session N]]\n", argv[0]);
+            return 1;
+        }
+    }
+    // 脚本文件或管道输入时不显示提示符和执行成功信息
+    int interactive = !script && isatty(fileno(stdin));
+    db_set_quiet(interactive ? QUIET_NONE : QUIET_INFO);
     load_db(); // 启动时自动加载数据库
     if (!find_db("default"))
     {
         db_create_database("default");
     }
     db_use_database("default"); // 自动切换到 DEFAULT 数据库
+    // 在快照之上重放上次保存后提交的修改
+    db_replay_journals(run_sql);
+    // 录制从这里开始：重放的日志语句不计入负载
+    if (capture)
+    {
+        if (stats_capture_open(capture, session) < 0)
+        {
+            fprintf(stderr, "Cannot open %s\n", capture);
+            return 1;
+        }
+        atexit(stats_capture_close);
+    }
+    if (script)
+    {
+        FILE *fp = fopen(script, "r");
+        if (!fp)
+        {
+            fprintf(stderr, "Cannot open %s\n", script);
+            return 1;
+        }
+        run_script(fp);
+        fclose(fp);
+        return 0;
+    }
+    if (!interactive)
+    {
+        run_script(stdin);
+        return 0;
+    }
+    db_enable_cancel(1);
+    signal(SIGINT, on_interrupt);
     printf("Welcome to MiniDBMS Shell. Type SQL and press Enter.\n");
-    char input[2048];
+    struct InputBuf input = {0};
     while (1)
     {
-        printf("MiniDBMS> ");
+        printf(input.len ? "      -> " : "MiniDBMS> ");
         fflush(stdout);
-        if (!fgets(input, sizeof(input), stdin))
+        if (!read_line(stdin, &input))
             break;
-        // 跳过空行
-        if (input[0] == '\0' || input[0] == '\n')
+        // 语句以';'结束，未结束时继续读取下一行
+        if (!statement_complete(input.data))
+        {
+            // 跳过空行
+            if (strspn(input.data, " \t\r\n") == input.len)
+                input.len = 0;
             continue;
-        YY_BUFFER_STATE bp = yy_scan_string(input);
+        }
+        YY_BUFFER_STATE bp = yy_scan_string(input.data);
         yyparse();
         yy_delete_buffer(bp);
+        input.len = 0;
     }
+    free(input.data);
     return 0;
 }
@@ -0,0 +1,5 @@
+cd .\compiler\
+bison -d parser.y
+flex lexer.l
+cd ..
+gcc -O2 -o MiniDBMS_replay bench/replay.c compiler/parser.tab.c compiler/lex.yy.c database/sql_struct.c database/db_api.c database/db_stats.c database/db_codec.c -lm
\ No newline at end of file